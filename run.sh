@@ -4,7 +4,7 @@ make clean
 make
 if [ $? -eq 0 ]; then
   cd ..
-  bin/zrt > image1.ppm
+  bin/zrt image1.ppm
   feh image1.ppm
 else
   echo "Build failed."
@@ -31,13 +31,18 @@ public:
     }
 
     bool hit(const ray& r, interval ray_t) const {
-        point3 ori = r.origin();
-        vec3 dir = r.direction();
+        return clip(r, ray_t);
+    }
+
+    //把ray_t缩小为光线在盒内的一段，不相交时返回false
+    bool clip(const ray& r, interval& ray_t) const {
+        const point3& ori = r.origin();
+        const vec3& inv_dir = r.inv_direction();
         for (int axis = 0; axis < 3; ++axis) {
-            interval ax = axis_interval(axis);
-            double dir_inv = 1.0 / dir[axis];
-            double t0 = (ax.min - ori[axis]) * dir_inv;
-            double t1 = (ax.max - ori[axis]) * dir_inv;
+            const interval& ax = axis_interval(axis);
+            real dir_inv = inv_dir[axis];
+            real t0 = (ax.min - ori[axis]) * dir_inv;
+            real t1 = (ax.max - ori[axis]) * dir_inv;
             if (t0 < t1) {
                 if (t0 > ray_t.min) {
                     ray_t.min = t0;
@@ -68,11 +73,18 @@ public:
         }
     }
 
+    //表面积，用于SAH代价估计；空盒返回0
+    double surface_area() const {
+        double dx = x.size(), dy = y.size(), dz = z.size();
+        if (dx < 0 || dy < 0 || dz < 0) return 0.0;
+        return 2.0 * (dx * dy + dy * dz + dz * dx);
+    }
+
     static const aabb empty, universe;
 
 private:
     void pad_to_mininums() {
-        double delta = 0.0001;
+        real delta = real(0.0001);
         if (x.size() < delta) x = x.expand(delta);
         if (y.size() < delta) y = y.expand(delta);
         if (z.size() < delta) z = z.expand(delta);
@@ -0,0 +1,205 @@
+#ifndef ACCUMULATION_H
+#define ACCUMULATION_H
+
+#include "rtweekend.h"
+#include "pixel_stats.h"
+#include "denoiser.h"
+#include "mapped_file.h"
+#include "file_replace.h"
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+
+//实现了累积缓冲文件(.zacc)：每个像素的样本统计(样本数、样本和、Welford统计量)，记录了特征时还有每个像素的特征之和。
+//每个样本的随机序列只由(像素, 样本编号)决定，像素已有的样本数就是继续采样需要的全部采样器状态，
+//读入后从下一个样本编号接着采样，结果与一次渲染完成相同。
+//断点续渲用它保存进度，分片渲染的每个分片也输出一个累积文件，zrt_merge按像素合并后再输出图像。
+//写文件时整体替换旧文件，见file_replace.h
+
+//累积文件头，之后依次是每个像素的统计量(12个double)，有特征时再接每个像素的特征之和(7个double)
+struct accumulation_header {
+    char magic[4];          //"ZACC"
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t flags;         //accumulation_has_features | accumulation_adaptive | accumulation_shard_samples
+    uint32_t samples_per_pixel;
+    uint32_t shard_index;
+    uint32_t shard_count;
+    uint32_t strata;        //均匀采样的分层格子每边的数目
+    uint32_t fingerprint[2];//场景和相机的指纹，低32位在前
+    uint32_t reserved;
+};
+
+static_assert(sizeof(accumulation_header) == 48, "accumulation_header must stay 48 bytes");
+
+const uint32_t accumulation_version = 4;
+const uint32_t accumulation_has_features = 1;
+const uint32_t accumulation_adaptive = 2;
+const uint32_t accumulation_shard_samples = 4;
+
+class accumulation_buffer {
+public:
+    int width{ 0 };
+    int height{ 0 };
+    vector<pixel_stats> pixels;           //按行优先排列
+    vector<surface_features> features;    //每个像素全部样本的特征之和，没有记录特征时为空
+    //渲染设置，合成图像时按与相机相同的方式缩放
+    int  samples_per_pixel{ 0 };
+    bool adaptive{ false };
+    //样本所用的分层格子每边的数目。续渲时即使改变了采样数也沿用这个格子，新旧样本才能均匀覆盖像素
+    int  strata{ 0 };
+    //分片：第shard_index片(共shard_count片)，shard_samples为真时按样本编号分片，否则按块分片
+    int  shard_index{ 0 };
+    int  shard_count{ 1 };
+    bool shard_samples{ false };
+    //样本所属的场景和视角，见camera::fingerprint。不同的场景或相机的样本不能合并
+    uint64_t fingerprint{ 0 };
+
+    void assign(int w, int h, bool with_features) {
+        width = w;
+        height = h;
+        pixels.assign(size_t(w) * h, pixel_stats());
+        features.assign(with_features ? size_t(w) * h : 0, surface_features());
+    }
+
+    bool has_features() const { return !features.empty(); }
+
+    color pixel_value(size_t index) const { return pixels[index].value(samples_per_pixel, adaptive); }
+
+    //渲染设置和分片方式相同时才能合并，否则返回false并给出原因
+    bool compatible(const accumulation_buffer& other, std::string& reason) const {
+        std::ostringstream out;
+        if (fingerprint != other.fingerprint)
+            out << "it was rendered from a different scene or camera";
+        else if (width != other.width || height != other.height)
+            out << "image size " << other.width << 'x' << other.height << " differs from " << width << 'x' << height;
+        else if (samples_per_pixel != other.samples_per_pixel || adaptive != other.adaptive || strata != other.strata)
+            out << "sampling settings differ";
+        else if (has_features() != other.has_features())
+            out << "only one of them has feature buffers";
+        else if (shard_count != other.shard_count || shard_samples != other.shard_samples)
+            out << "shard layout differs";
+        reason = out.str();
+        return reason.empty();
+    }
+
+    //按像素并入另一个累积缓冲，两者的大小必须相同
+    void merge(const accumulation_buffer& other) {
+        for (size_t p = 0; p < pixels.size(); ++p) pixels[p].merge(other.pixels[p]);
+        for (size_t p = 0; p < features.size(); ++p) features[p].add(other.features[p]);
+    }
+
+    bool save(const std::string& path) const {
+        return replace_file(path, [this](std::ostream& out) {
+            accumulation_header header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, "ZACC", 4);
+            header.version = accumulation_version;
+            header.width = uint32_t(width);
+            header.height = uint32_t(height);
+            header.flags = (has_features() ? accumulation_has_features : 0) | (adaptive ? accumulation_adaptive : 0)
+                | (shard_samples ? accumulation_shard_samples : 0);
+            header.samples_per_pixel = uint32_t(samples_per_pixel);
+            header.shard_index = uint32_t(shard_index);
+            header.shard_count = uint32_t(shard_count);
+            header.strata = uint32_t(strata);
+            header.fingerprint[0] = uint32_t(fingerprint);
+            header.fingerprint[1] = uint32_t(fingerprint >> 32);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+            vector<double> values;
+            values.reserve(pixels.size() * (pixel_values + (has_features() ? feature_values : 0)));
+            for (const pixel_stats& p : pixels) {
+                values.push_back(p.count);
+                push(values, p.sum);
+                push(values, p.mean);
+                push(values, p.m2);
+                values.push_back(p.luminance_mean);
+                values.push_back(p.luminance_m2);
+            }
+            for (const surface_features& f : features) {
+                push(values, f.albedo);
+                push(values, f.normal);
+                values.push_back(f.depth);
+            }
+            out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(double));
+        });
+    }
+
+    //失败时返回false且不修改缓冲
+    bool load(const std::string& path) {
+        mapped_file file;
+        if (!file.open(path, mapped_file::access_sequential)) {
+            std::cerr << "ERROR: Could not open accumulation file '" << path << "'.\n";
+            return false;
+        }
+        accumulation_header header;
+        if (file.size() < sizeof(header)) {
+            std::cerr << "ERROR: Accumulation file '" << path << "' is truncated.\n";
+            return false;
+        }
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.magic, "ZACC", 4) != 0 || header.version != accumulation_version) {
+            std::cerr << "ERROR: '" << path << "' is not a version " << accumulation_version << " accumulation file.\n";
+            return false;
+        }
+        size_t count = size_t(header.width) * header.height;
+        bool with_features = (header.flags & accumulation_has_features) != 0;
+        size_t doubles = count * (pixel_values + (with_features ? feature_values : 0));
+        if (file.size() != sizeof(header) + doubles * sizeof(double)) {
+            std::cerr << "ERROR: Accumulation file '" << path << "' is truncated.\n";
+            return false;
+        }
+
+        vector<double> values(doubles);
+        if (doubles > 0) std::memcpy(values.data(), file.data() + sizeof(header), doubles * sizeof(double));
+        if (header.shard_count == 0 || header.shard_index >= header.shard_count || header.strata == 0) {
+            std::cerr << "ERROR: Accumulation file '" << path << "' is corrupt.\n";
+            return false;
+        }
+        accumulation_buffer loaded;
+        loaded.assign(int(header.width), int(header.height), with_features);
+        loaded.samples_per_pixel = int(header.samples_per_pixel);
+        loaded.adaptive = (header.flags & accumulation_adaptive) != 0;
+        loaded.strata = int(header.strata);
+        loaded.shard_index = int(header.shard_index);
+        loaded.shard_count = int(header.shard_count);
+        loaded.shard_samples = (header.flags & accumulation_shard_samples) != 0;
+        loaded.fingerprint = uint64_t(header.fingerprint[0]) | (uint64_t(header.fingerprint[1]) << 32);
+        const double* v = values.data();
+        for (pixel_stats& p : loaded.pixels) {
+            if (!(v[0] >= 0.0 && v[0] < 2147483648.0)) {
+                std::cerr << "ERROR: Accumulation file '" << path << "' is corrupt.\n";
+                return false;
+            }
+            p.count = int(v[0]);
+            p.sum = color(v[1], v[2], v[3]);
+            p.mean = color(v[4], v[5], v[6]);
+            p.m2 = color(v[7], v[8], v[9]);
+            p.luminance_mean = v[10];
+            p.luminance_m2 = v[11];
+            v += pixel_values;
+        }
+        for (surface_features& f : loaded.features) {
+            f.albedo = color(v[0], v[1], v[2]);
+            f.normal = vec3(v[3], v[4], v[5]);
+            f.depth = v[6];
+            v += feature_values;
+        }
+        *this = std::move(loaded);
+        return true;
+    }
+
+private:
+    static const size_t pixel_values = 12;
+    static const size_t feature_values = 7;
+
+    static void push(vector<double>& values, const vec3& v) {
+        values.push_back(v.x());
+        values.push_back(v.y());
+        values.push_back(v.z());
+    }
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef AFFINE_H
+#define AFFINE_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+//实现了3x4的仿射变换矩阵，前三列为线性部分，最后一列为平移。提供平移、缩放、绕任意轴旋转、复合与求逆，
+//以及对点、向量、法线和包围盒的变换。矩阵用double保存，多次复合后误差不会随real为float而放大
+
+class affine {
+public:
+    double m[3][4];
+
+    affine() {
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j) m[i][j] = (i == j) ? 1.0 : 0.0;
+    }
+
+    static affine translation(const vec3& offset) {
+        affine a;
+        a.m[0][3] = offset.x();
+        a.m[1][3] = offset.y();
+        a.m[2][3] = offset.z();
+        return a;
+    }
+
+    static affine scaling(const vec3& s) {
+        affine a;
+        a.m[0][0] = s.x();
+        a.m[1][1] = s.y();
+        a.m[2][2] = s.z();
+        return a;
+    }
+
+    //绕过原点的axis轴逆时针(右手)旋转degree度
+    static affine rotation(const vec3& axis, double degree) {
+        vec3 k = normalize(axis);
+        double x = k.x(), y = k.y(), z = k.z();
+        double radians = degree_to_radian(degree);
+        double c = cos(radians), s = sin(radians), t = 1.0 - c;
+        affine a;
+        a.m[0][0] = t * x * x + c;     a.m[0][1] = t * x * y - s * z; a.m[0][2] = t * x * z + s * y;
+        a.m[1][0] = t * x * y + s * z; a.m[1][1] = t * y * y + c;     a.m[1][2] = t * y * z - s * x;
+        a.m[2][0] = t * x * z - s * y; a.m[2][1] = t * y * z + s * x; a.m[2][2] = t * z * z + c;
+        return a;
+    }
+
+    //复合变换，先做b再做*this
+    affine operator*(const affine& b) const {
+        affine r;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                double sum = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] + m[i][2] * b.m[2][j];
+                r.m[i][j] = (j == 3) ? sum + m[i][3] : sum;
+            }
+        }
+        return r;
+    }
+
+    double determinant() const {
+        return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+            - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+            + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    }
+
+    //逆变换，线性部分用伴随矩阵求逆。调用者需保证矩阵可逆(缩放分量不为0)
+    affine inverse() const {
+        double inv_det = 1.0 / determinant();
+        affine r;
+        r.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * inv_det;
+        r.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+        r.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+        r.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * inv_det;
+        r.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+        r.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+        r.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * inv_det;
+        r.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+        r.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+        for (int i = 0; i < 3; ++i) {
+            r.m[i][3] = -(r.m[i][0] * m[0][3] + r.m[i][1] * m[1][3] + r.m[i][2] * m[2][3]);
+        }
+        return r;
+    }
+
+    point3 point(const point3& p) const {
+        return point3(m[0][0] * p.x() + m[0][1] * p.y() + m[0][2] * p.z() + m[0][3],
+            m[1][0] * p.x() + m[1][1] * p.y() + m[1][2] * p.z() + m[1][3],
+            m[2][0] * p.x() + m[2][1] * p.y() + m[2][2] * p.z() + m[2][3]);
+    }
+
+    vec3 vector(const vec3& v) const {
+        return vec3(m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+            m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+            m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z());
+    }
+
+    //法线按线性部分的转置变换。对逆矩阵调用即得到法线从物体坐标到世界坐标的变换(逆转置)，结果未单位化
+    vec3 transpose_vector(const vec3& n) const {
+        return vec3(m[0][0] * n.x() + m[1][0] * n.y() + m[2][0] * n.z(),
+            m[0][1] * n.x() + m[1][1] * n.y() + m[2][1] * n.z(),
+            m[0][2] * n.x() + m[1][2] * n.y() + m[2][2] * n.z());
+    }
+
+    //变换后包围盒八个角点的包围盒，空盒仍为空盒
+    aabb bounds(const aabb& box) const {
+        if (box.x.size() < 0 || box.y.size() < 0 || box.z.size() < 0) return aabb::empty;
+        point3 min(infinity, infinity, infinity);
+        point3 max(-infinity, -infinity, -infinity);
+        for (int i = 0; i < 2; i++) {
+            for (int j = 0; j < 2; j++) {
+                for (int k = 0; k < 2; k++) {
+                    point3 corner = point(point3(i ? box.x.max : box.x.min, j ? box.y.max : box.y.min, k ? box.z.max : box.z.min));
+                    for (int c = 0; c < 3; c++) {
+                        min[c] = fmin(min[c], corner[c]);
+                        max[c] = fmax(max[c], corner[c]);
+                    }
+                }
+            }
+        }
+        return aabb(min, max);
+    }
+};
+
+#endif
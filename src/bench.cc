@@ -0,0 +1,377 @@
+#include "rtweekend.h"
+#include "scenes.h"
+#include "perlin.h"
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <sstream>
+
+//zrt_bench：固定种子的微基准测试和整帧基准测试，结果以JSON输出到标准输出，便于比较不同提交的性能。
+//微基准测试在单线程上反复调用一个函数(aabb::hit、sphere::hit、bvh遍历、三角形网格、perlin::turb等)，输入预先生成好；
+//整帧基准测试用低分辨率、少量样本渲染scenes.h中的每个场景。
+//遍历bvh和网格的测试以及每个场景另外输出树的节点数和SAH代价，用于比较不同的构建方法。
+//用法：zrt_bench [--kernels-only] [--scenes-only] [--width N] [--spp N] [--scene 名字] [--min-time 秒]
+
+struct kernel_result {
+    std::string name;
+    long long iterations;
+    double seconds;
+    size_t node_count;      //遍历加速结构的测试带上树的节点数和SAH代价，其他为0
+    double sah_cost;
+};
+
+struct scene_result {
+    std::string name;
+    int width, height, spp;
+    long long samples;
+    double build_seconds;
+    double seconds;
+    size_t node_count;      //场景中各棵bvh的节点数和SAH代价之和，见hittable::accumulate_bvh_stats
+    double sah_cost;
+};
+
+//防止编译器把被测调用当作无用代码删掉
+static volatile double bench_sink = 0.0;
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//每轮调用body(i)共batch次，直到累计时间超过min_time。body返回值累加到sink
+static kernel_result run_kernel(const std::string& name, double min_time, const std::function<double(int)>& body) {
+    const int batch = 4096;
+    long long iterations = 0;
+    double acc = 0.0;
+    thread_rng().seed(0, 0);
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    do {
+        for (int i = 0; i < batch; ++i) acc += body(i);
+        iterations += batch;
+        elapsed = seconds_since(start);
+    } while (elapsed < min_time);
+    bench_sink = bench_sink + acc;
+    return kernel_result{ name, iterations, elapsed, 0, 0.0 };
+}
+
+template <class T>
+static kernel_result with_tree(kernel_result r, const T& tree) {
+    r.node_count = tree.node_count();
+    r.sah_cost = tree.sah_cost();
+    return r;
+}
+
+//固定种子生成的测试输入：光线从单位立方体外的球面射向立方体附近，大约一半命中
+class bench_inputs {
+public:
+    static const int count = 4096;
+    vector<ray> rays;
+    vector<point3> points;
+    vector<vec3> directions;
+
+    explicit bench_inputs(double scale) {
+        sampler_rng rng(12345, 0);
+        auto uniform = [&rng](double lo, double hi) { return lo + (hi - lo) * rng.next_double(); };
+        for (int i = 0; i < count; ++i) {
+            vec3 d(uniform(-1, 1), uniform(-1, 1), uniform(-1, 1));
+            point3 origin = 3.0 * scale * normalize(d);
+            point3 target(uniform(-scale, scale), uniform(-scale, scale), uniform(-scale, scale));
+            rays.push_back(ray(origin, target - origin, uniform(0, 1)));
+            points.push_back(point3(uniform(-4, 4), uniform(-4, 4), uniform(-4, 4)));
+            directions.push_back(normalize(vec3(uniform(-1, 1), uniform(-1, 1), uniform(-1, 1))));
+        }
+    }
+};
+
+static vector<kernel_result> run_kernels(double min_time) {
+    vector<kernel_result> results;
+    const int mask = bench_inputs::count - 1;
+    bench_inputs in(1.0);
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+
+    aabb box(point3(-0.5, -0.5, -0.5), point3(0.5, 0.5, 0.5));
+    results.push_back(run_kernel("aabb::hit", min_time, [&](int i) {
+        return box.hit(in.rays[i & mask], interval(0.001, infinity)) ? 1.0 : 0.0;
+    }));
+
+    sphere ball(point3(0, 0, 0), 0.5, white);
+    results.push_back(run_kernel("sphere::hit", min_time, [&](int i) {
+        hit_record rec;
+        return ball.hit(in.rays[i & mask], interval(0.001, infinity), rec) ? rec.t : 0.0;
+    }));
+
+    sphere moving_ball(point3(-0.2, 0, 0), point3(0.2, 0, 0), 0.5, white);
+    results.push_back(run_kernel("sphere::hit(moving)", min_time, [&](int i) {
+        hit_record rec;
+        return moving_ball.hit(in.rays[i & mask], interval(0.001, infinity), rec) ? rec.t : 0.0;
+    }));
+
+    quad face(point3(-0.5, -0.5, 0), vec3(1, 0, 0), vec3(0, 1, 0), white);
+    results.push_back(run_kernel("quad::hit", min_time, [&](int i) {
+        hit_record rec;
+        return face.hit(in.rays[i & mask], interval(0.001, infinity), rec) ? rec.t : 0.0;
+    }));
+
+    //1000个小球的bvh，与final_scene中的球簇相同的规模
+    thread_rng().seed(1, 0);
+    hittable_list cluster;
+    vector<point3> centers;
+    for (int j = 0; j < 1000; ++j) {
+        centers.push_back(point3::random(-1, 1));
+        cluster.add(make_shared<sphere>(centers.back(), 0.06, white));
+    }
+    bvh_node tree(cluster);
+    results.push_back(with_tree(run_kernel("bvh_node::hit", min_time, [&](int i) {
+        hit_record rec;
+        return tree.hit(in.rays[i & mask], interval(0.001, infinity), rec) ? rec.t : 0.0;
+    }), tree));
+
+    results.push_back(with_tree(run_kernel("bvh_node::occluded", min_time, [&](int i) {
+        return tree.occluded(in.rays[i & mask], interval(0.001, infinity)) ? 1.0 : 0.0;
+    }), tree));
+
+    //同样的球簇，每个球在快门时间内移动约一个直径，节点包围盒按光线时间插值
+    hittable_list moving_cluster;
+    for (const point3& center : centers) {
+        moving_cluster.add(make_shared<sphere>(center, center + 0.12 * random_unit_vector(), 0.06, white));
+    }
+    bvh_node moving_tree(moving_cluster);
+    results.push_back(with_tree(run_kernel("bvh_node::hit(moving)", min_time, [&](int i) {
+        hit_record rec;
+        return moving_tree.hit(in.rays[i & mask], interval(0.001, infinity), rec) ? rec.t : 0.0;
+    }), moving_tree));
+
+    //8万个三角形的网格球
+    triangle_mesh mesh(icosphere(point3(0, 0, 0), 0.5, 6), white);
+    results.push_back(with_tree(run_kernel("triangle_mesh::hit", min_time, [&](int i) {
+        hit_record rec;
+        return mesh.hit(in.rays[i & mask], interval(0.001, infinity), rec) ? rec.t : 0.0;
+    }), mesh));
+    results.push_back(with_tree(run_kernel("triangle_mesh::occluded", min_time, [&](int i) {
+        return mesh.occluded(in.rays[i & mask], interval(0.001, infinity)) ? 1.0 : 0.0;
+    }), mesh));
+
+    auto boundary = make_shared<sphere>(point3(0, 0, 0), 0.5, white);
+    constant_medium fog(boundary, 2.0, color(1, 1, 1));
+    results.push_back(run_kernel("constant_medium::hit", min_time, [&](int i) {
+        hit_record rec;
+        return fog.hit(in.rays[i & mask], interval(0.001, infinity), rec) ? rec.t : 0.0;
+    }));
+    results.push_back(run_kernel("constant_medium::transmittance", min_time, [&](int i) {
+        return fog.transmittance(in.rays[i & mask], interval(0.001, infinity));
+    }));
+
+    homogeneous_fog haze;
+    haze.density = 0.5;
+    results.push_back(run_kernel("homogeneous_fog::sample", min_time, [&](int i) {
+        real t = 0;
+        return haze.sample(in.rays[i & mask], interval(0.001, 4.0), t) ? t : 0.0;
+    }));
+
+    //球形云团，密度由噪声调制，中心最大约为4
+    perlin cloud_noise;
+    grid_medium cloud(aabb(point3(-0.5, -0.5, -0.5), point3(0.5, 0.5, 0.5)), 64, [&](const point3& p) {
+        return fmax(0.0, 1.0 - 4.0 * p.length_squared()) * 8.0 * cloud_noise.turb(4.0 * p, 5);
+    }, color(1, 1, 1));
+    results.push_back(run_kernel("grid_medium::hit", min_time, [&](int i) {
+        hit_record rec;
+        return cloud.hit(in.rays[i & mask], interval(0.001, infinity), rec) ? rec.t : 0.0;
+    }));
+    results.push_back(run_kernel("grid_medium::transmittance", min_time, [&](int i) {
+        return cloud.transmittance(in.rays[i & mask], interval(0.001, infinity));
+    }));
+
+    perlin noise;
+    results.push_back(run_kernel("perlin::turb", min_time, [&](int i) {
+        return noise.turb(in.points[i & mask], 7);
+    }));
+
+    noise_texture baked_marble(4, aabb(point3(-4, -4, -4), point3(4, 4, 4)), 64);
+    results.push_back(run_kernel("noise_texture::value (baked)", min_time, [&](int i) {
+        return baked_marble.value(0, 0, in.points[i & mask]).x();
+    }));
+
+    image_texture earth_map("earthmap.jpg");
+    results.push_back(run_kernel("image_texture::value", min_time, [&](int i) {
+        const vec3& d = in.directions[i & mask];
+        return earth_map.value(0.5 + 0.5 * d.x(), 0.5 + 0.5 * d.y(), d).x();
+    }));
+
+    sphere_pdf uniform;
+    results.push_back(run_kernel("sphere_pdf::generate", min_time, [&](int) {
+        return uniform.generate().x();
+    }));
+    results.push_back(run_kernel("sphere_pdf::value", min_time, [&](int i) {
+        return uniform.value(in.directions[i & mask]);
+    }));
+
+    cosine_pdf cosine(vec3(0, 1, 0));
+    results.push_back(run_kernel("cosine_pdf::generate", min_time, [&](int) {
+        return cosine.generate().x();
+    }));
+    results.push_back(run_kernel("cosine_pdf::value", min_time, [&](int i) {
+        return cosine.value(in.directions[i & mask]);
+    }));
+
+    scatter_pdf tagged;
+    tagged.set_cosine(vec3(0, 1, 0));
+    results.push_back(run_kernel("scatter_pdf::generate", min_time, [&](int) {
+        return tagged.generate().x();
+    }));
+    results.push_back(run_kernel("scatter_pdf::value", min_time, [&](int i) {
+        return tagged.value(in.directions[i & mask]);
+    }));
+
+    //与cornell_box相同的光源列表，从盒子中心附近的点采样
+    hittable_list lights;
+    auto m = shared_ptr<material>();
+    lights.add(make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), m));
+    lights.add(make_shared<sphere>(point3(190, 90, 190), 90, m));
+    hittable_pdf light_pdf(lights, point3(278, 278, 278));
+    results.push_back(run_kernel("hittable_pdf::generate", min_time, [&](int) {
+        return light_pdf.generate().x();
+    }));
+    results.push_back(run_kernel("hittable_pdf::value", min_time, [&](int i) {
+        return light_pdf.value(in.directions[i & mask]);
+    }));
+
+    mixture_pdf mixture(light_pdf, tagged);
+    results.push_back(run_kernel("mixture_pdf::generate", min_time, [&](int) {
+        return mixture.generate().x();
+    }));
+    results.push_back(run_kernel("mixture_pdf::value", min_time, [&](int i) {
+        return mixture.value(in.directions[i & mask]);
+    }));
+
+    //many_lights场景的320个光源，在地面附近的点上比较逐个求和的列表和两种光源选择方式
+    scene lit = many_lights();
+    vector<shared_ptr<hittable>> emitters;
+    lit.world.collect_emitters(emitters);
+    hittable_list emitter_list;
+    for (const auto& light : emitters) emitter_list.add(light);
+    light_sampler by_power(lit.world, hittable_list(), light_sampler::select_power);
+    light_sampler spatial(lit.world, hittable_list(), light_sampler::select_spatial);
+    point3 shade(1, 0.5, 4);
+    results.push_back(run_kernel("hittable_list::random (320 lights)", min_time, [&](int) {
+        return emitter_list.random(shade).x();
+    }));
+    results.push_back(run_kernel("hittable_list::pdf_value (320 lights)", min_time, [&](int i) {
+        return emitter_list.pdf_value(shade, in.directions[i & mask]);
+    }));
+    results.push_back(run_kernel("light_sampler::random (power)", min_time, [&](int) {
+        return by_power.random(shade).x();
+    }));
+    results.push_back(run_kernel("light_sampler::pdf_value (power)", min_time, [&](int i) {
+        return by_power.pdf_value(shade, in.directions[i & mask]);
+    }));
+    results.push_back(run_kernel("light_sampler::random (spatial)", min_time, [&](int) {
+        return spatial.random(shade).x();
+    }));
+    results.push_back(run_kernel("light_sampler::pdf_value (spatial)", min_time, [&](int i) {
+        return spatial.pdf_value(shade, in.directions[i & mask]);
+    }));
+    results.push_back(run_kernel("light_sampler::sample_light (spatial)", min_time, [&](int) {
+        hit_record rec;
+        double pdf = 0.0;
+        return spatial.sample_light(shade, rec, pdf) ? pdf : 0.0;
+    }));
+
+    return results;
+}
+
+static scene_result run_scene(const std::string& name, int width, int spp) {
+    //场景构建也使用random_double，固定种子保证每次构建出相同的场景
+    thread_rng().seed(0, 0);
+    auto build_start = std::chrono::steady_clock::now();
+    scene s;
+    make_scene(name, s);
+    double build_seconds = seconds_since(build_start);
+    bvh_stats trees;
+    s.world.accumulate_bvh_stats(trees);
+
+    s.cam.image_width = width;
+    s.cam.samples_per_pixel = spp;
+    s.cam.output_file.clear();
+    s.cam.show_progress = false;
+
+    auto start = std::chrono::steady_clock::now();
+    s.render();
+    double seconds = seconds_since(start);
+    return scene_result{ name, width, s.cam.height(), spp, s.cam.samples_taken(), build_seconds, seconds, trees.nodes, trees.sah_cost };
+}
+
+static std::string json_number(double x) {
+    std::ostringstream out;
+    out.precision(6);
+    out << x;
+    return out.str();
+}
+
+static void write_json(std::ostream& out, const vector<kernel_result>& kernels, const vector<scene_result>& scenes) {
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    out << "{\n  \"threads\": " << threads << ",\n  \"kernels\": [";
+    for (size_t k = 0; k < kernels.size(); ++k) {
+        const kernel_result& r = kernels[k];
+        out << (k ? "," : "") << "\n    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+            << ", \"ns_per_call\": " << json_number(r.seconds * 1e9 / r.iterations)
+            << ", \"calls_per_sec\": " << json_number(r.iterations / r.seconds);
+        if (r.node_count > 0) out << ", \"node_count\": " << r.node_count << ", \"sah_cost\": " << json_number(r.sah_cost);
+        out << "}";
+    }
+    out << (kernels.empty() ? "" : "\n  ") << "],\n  \"scenes\": [";
+    for (size_t k = 0; k < scenes.size(); ++k) {
+        const scene_result& r = scenes[k];
+        out << (k ? "," : "") << "\n    {\"name\": \"" << r.name << "\", \"width\": " << r.width
+            << ", \"height\": " << r.height << ", \"spp\": " << r.spp
+            << ", \"build_seconds\": " << json_number(r.build_seconds)
+            << ", \"seconds\": " << json_number(r.seconds)
+            << ", \"samples_per_sec\": " << json_number(r.samples / r.seconds)
+            << ", \"node_count\": " << r.node_count << ", \"sah_cost\": " << json_number(r.sah_cost) << "}";
+    }
+    out << (scenes.empty() ? "" : "\n  ") << "]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+    bool kernels = true;
+    bool scenes = true;
+    int width = 64;
+    int spp = 16;
+    double min_time = 0.2;
+    vector<std::string> names;
+
+    for (int a = 1; a < argc; ++a) {
+        std::string arg = argv[a];
+        bool has_value = a + 1 < argc;
+        if (arg == "--kernels-only") scenes = false;
+        else if (arg == "--scenes-only") kernels = false;
+        else if (arg == "--width" && has_value) width = std::atoi(argv[++a]);
+        else if (arg == "--spp" && has_value) spp = std::atoi(argv[++a]);
+        else if (arg == "--min-time" && has_value) min_time = std::atof(argv[++a]);
+        else if (arg == "--scene" && has_value) names.push_back(argv[++a]);
+        else {
+            std::cerr << "Usage: zrt_bench [--kernels-only] [--scenes-only] [--width N] [--spp N] [--scene NAME] [--min-time SECONDS]\n";
+            return 1;
+        }
+    }
+    if (names.empty()) names = scene_names();
+    for (const auto& name : names) {
+        if (std::find(scene_names().begin(), scene_names().end(), name) == scene_names().end()) {
+            std::cerr << "Unknown scene '" << name << "'.\n";
+            return 1;
+        }
+    }
+
+    vector<kernel_result> kernel_results;
+    vector<scene_result> scene_results;
+    if (kernels) kernel_results = run_kernels(min_time);
+    if (scenes) {
+        for (const auto& name : names) {
+            std::clog << "Rendering " << name << "...\n";
+            scene_results.push_back(run_scene(name, width, spp));
+        }
+    }
+    write_json(std::cout, kernel_results, scene_results);
+}
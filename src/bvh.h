@@ -5,69 +5,1063 @@
 #include "hittable.h"
 #include "hittable_list.h"
 #include "aabb.h"
+#include "bvh_wide.h"
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
 
-//实现了bvh类树结构，字段包括左右子节点和bbox。成员函数有构造函数和hit函数
-class bvh_node : public hittable
+//实现了扁平化的bvh。所有节点按深度优先顺序存放在一个连续数组里，左孩子紧跟父节点，右孩子用下标记录；
+//叶子节点记录一段连续的图元范围。求交时用显式栈迭代遍历，按光线方向符号先访问近的孩子
+//构建使用分箱SAH，叶子可以容纳多个图元，顶层子树以OpenMP任务并行构建。
+//二叉树构建完成后可以再压缩为4叉或8叉的宽bvh，一次用SIMD检测一个节点的全部孩子，见bvh_wide.h
+//bvh_tree只根据图元的包围盒建树，不关心图元是什么；bvh_node用它组织hittable物体，triangle_mesh用它组织网格内的三角形
+//图元在运动时建成运动bvh：节点同时记录时间段开头的包围盒和到末尾的变化量，遍历时按光线时间插值，
+//包围盒只需覆盖物体在该时刻的位置，而不是整个运动范围。运动较快时把[0,1]等分为几个时间段，每段单独建一棵树
+
+//32字节的线性节点，包围盒以float保存并向外取整，保证不会比原始包围盒小
+struct bvh_linear_node {
+    float bmin[3];
+    float bmax[3];
+    int32_t offset;            //叶子：第一个图元下标；内部节点：右孩子下标
+    uint16_t primitive_count;  //为0表示内部节点
+    uint8_t axis;              //内部节点的划分轴
+    uint8_t pad;
+};
+
+static_assert(sizeof(bvh_linear_node) == 32, "bvh_linear_node must stay 32 bytes");
+
+//运动bvh中与线性节点一一对应：节点包围盒在时间段末尾相对开头的变化量，向外取整，插值后不会比真实的包围盒小
+struct bvh_motion_delta {
+    float dmin[3];
+    float dmax[3];
+};
+
+//bvh构建参数。默认使用分箱SAH，也可以退回最长轴中位数划分，用于比较不同构建方法
+class bvh_build_options {
+public:
+    enum split_method { split_sah, split_median };
+
+    split_method method{ split_sah };
+    int max_leaf_size{ 4 };             //叶子最多图元数，图元数不超过它时才会考虑做叶子
+    int bin_count{ 16 };                //每个轴的分箱数
+    double traversal_cost{ 1.0 };       //访问一个内部节点的相对代价
+    double intersection_cost{ 1.0 };    //求交一个图元的相对代价
+    size_t parallel_threshold{ 4096 };  //子树图元数超过该值时作为OpenMP任务并行构建
+    int width{ 4 };                     //遍历用的树宽：2为二叉线性树，4或8为压缩后的宽bvh
+    int max_time_segments{ 4 };         //运动bvh最多把时间分成几段，每段一棵树；1表示不分段
+};
+
+class bvh_tree
 {
 private:
-    shared_ptr<hittable> left;
-    shared_ptr<hittable> right;
+    //构建时缓存每个图元的包围盒和中心
+    struct primitive_info {
+        size_t index;
+        aabb box;
+        point3 centroid;
+    };
+
+    //构建阶段的临时树，子树可以由不同线程构建，完成后再按深度优先顺序展开成线性数组
+    struct build_node {
+        aabb box;
+        std::unique_ptr<build_node> children[2];
+        size_t start{ 0 };
+        size_t count{ 0 };
+        int axis{ 0 };
+        size_t subtree_size{ 1 };
+    };
+
+    vector<bvh_linear_node> nodes;
+    vector<bvh_wide_node<4>> wide4;
+    vector<bvh_wide_node<8>> wide8;
     aabb bbox;
+    bvh_build_options options;
+    //运动bvh：motion与nodes一一对应，静止的树为空。第k个时间段的树从roots[k]开始，宽树从wide_roots[k]开始，
+    //各段的节点依次存放，叶子的图元下标也按段错开，每段都有全部图元的一份
+    vector<bvh_motion_delta> motion;
+    vector<bvh_wide_motion<4>> wide4_motion;
+    vector<bvh_wide_motion<8>> wide8_motion;
+    vector<int32_t> roots;
+    vector<int32_t> wide_roots;
+
+    static const int max_bins = 64;
+    static const int max_sah_depth = 64;  //超过该深度后只做中位数划分，保证遍历栈够用
+    static const int stack_size = 128;
+    static const int max_segments = 8;
 
-    static bool compare_x(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
-        return a->bounding_box().x.min < b->bounding_box().x.min;
+    static float round_down(double x) {
+        float f = float(x);
+        return double(f) > x ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
     }
 
-    static bool compare_y(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
-        return a->bounding_box().y.min < b->bounding_box().y.min;
+    static float round_up(double x) {
+        float f = float(x);
+        return double(f) < x ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
     }
 
-    static bool compare_z(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
-        return a->bounding_box().z.min < b->bounding_box().z.min;
+    void clear() {
+        nodes.clear();
+        wide4.clear();
+        wide8.clear();
+        motion.clear();
+        wide4_motion.clear();
+        wide8_motion.clear();
+        roots.clear();
+        wide_roots.clear();
+        bbox = aabb::empty;
     }
 
-public:
-    bvh_node(hittable_list& list) :bvh_node(list.objects, 0, list.objects.size()) {}
-    bvh_node(vector<shared_ptr<hittable>>& objects, size_t start, size_t end) {
+    void collapse_wide() {
+        wide_roots.clear();
+        for (int32_t root : roots) {
+            if (options.width == 4) wide_roots.push_back(collapse(wide4, wide4_motion, root));
+            if (options.width == 8) wide_roots.push_back(collapse(wide8, wide8_motion, root));
+        }
+    }
+
+    vector<size_t> build_nodes(const vector<aabb>& boxes) {
+        bbox = aabb::empty;
+        for (const aabb& box : boxes) {
+            bbox = aabb(bbox, box);
+        }
+        vector<size_t> order = build_segment(boxes, 0);
+        if (!nodes.empty()) {
+            roots.push_back(0);
+            collapse_wide();
+        }
+        return order;
+    }
+
+    //按boxes建一棵树并展开到nodes的末尾，叶子的图元下标加上base。返回叶子顺序
+    vector<size_t> build_segment(const vector<aabb>& boxes, size_t base) {
+        long long count = (long long)boxes.size();
+        vector<primitive_info> info(boxes.size());
+#pragma omp parallel for schedule(static) if(count > 4096)
+        for (long long i = 0; i < count; ++i) {
+            const aabb& box = boxes[i];
+            info[i].index = size_t(i);
+            info[i].box = box;
+            info[i].centroid = point3(0.5 * (box.x.min + box.x.max), 0.5 * (box.y.min + box.y.max), 0.5 * (box.z.min + box.z.max));
+        }
+        vector<size_t> order;
+        if (info.empty()) return order;
+
+        std::unique_ptr<build_node> root;
+#pragma omp parallel if(info.size() > options.parallel_threshold)
+#pragma omp single
+        root.reset(build_recursive(info, 0, info.size(), 0));
+
+        nodes.reserve(nodes.size() + root->subtree_size);
+        flatten(root.get(), base);
+
+        order.reserve(info.size());
+        for (const primitive_info& p : info) {
+            order.push_back(p.index);
+        }
+        return order;
+    }
+
+    build_node* make_leaf(build_node* node, size_t start, size_t count) const {
+        node->start = start;
+        node->count = count;
+        return node;
+    }
+
+    //递归构建[start, end)范围内的子树。叶子的图元范围直接对应info中划分后的顺序
+    build_node* build_recursive(vector<primitive_info>& info, size_t start, size_t end, int depth) const {
+        build_node* node = new build_node;
+        aabb centroid_box = aabb::empty;
+        node->box = aabb::empty;
+        for (size_t i = start; i < end; ++i) {
+            node->box = aabb(node->box, info[i].box);
+            centroid_box = aabb(centroid_box, aabb(info[i].centroid, info[i].centroid));
+        }
+
+        size_t count = end - start;
+        if (count == 1) return make_leaf(node, start, count);
+
+        size_t mid = start;
+        int axis = centroid_box.longest_axis();
+        if (options.method == bvh_build_options::split_sah && depth < max_sah_depth) {
+            mid = partition_sah(info, start, end, node->box, centroid_box, axis);
+            if (mid == start) {
+                //叶子代价更低或无法划分
+                if (count <= 65535) return make_leaf(node, start, count);
+            }
+        }
+        else if (count <= size_t(options.max_leaf_size)) {
+            return make_leaf(node, start, count);
+        }
+
+        if (mid == start || mid == end) {
+            mid = start + count / 2;
+            std::nth_element(info.begin() + start, info.begin() + mid, info.begin() + end,
+                [axis](const primitive_info& a, const primitive_info& b) {
+                    return a.centroid[axis] < b.centroid[axis];
+                });
+        }
+
+        node->axis = axis;
+        if (count > options.parallel_threshold) {
+#pragma omp task shared(info) firstprivate(node, start, mid, depth)
+            node->children[0].reset(build_recursive(info, start, mid, depth + 1));
+            node->children[1].reset(build_recursive(info, mid, end, depth + 1));
+#pragma omp taskwait
+        }
+        else {
+            node->children[0].reset(build_recursive(info, start, mid, depth + 1));
+            node->children[1].reset(build_recursive(info, mid, end, depth + 1));
+        }
+        node->subtree_size = 1 + node->children[0]->subtree_size + node->children[1]->subtree_size;
+        return node;
+    }
+
+    //中心坐标所在的箱子。空包围盒的中心是NaN，与越界的值一起截断到两端的箱子
+    static int bin_index(double centroid, double min, double scale, int nbins) {
+        double t = (centroid - min) * scale;
+        if (!(t > 0.0)) return 0;
+        return t < nbins - 1 ? int(t) : nbins - 1;
+    }
+
+    //分箱SAH：在三个轴上各把中心包围盒等分为bin_count段，扫描所有分割面，取代价最小者。
+    //返回划分点；若做叶子更划算(且图元数允许)或无法划分，返回start
+    size_t partition_sah(vector<primitive_info>& info, size_t start, size_t end,
+        const aabb& box, const aabb& centroid_box, int& best_axis) const {
+        struct bin {
+            aabb box{ aabb::empty };
+            size_t count{ 0 };
+        };
+
+        const int nbins = options.bin_count;
+        size_t count = end - start;
+        double area = box.surface_area();
+        double leaf_cost = options.intersection_cost * count;
+        double best_cost = infinity;
+        int best_split = -1;
+
+        for (int axis = 0; axis < 3; ++axis) {
+            const interval& extent = centroid_box.axis_interval(axis);
+            if (!(extent.size() > 0.0)) continue;
+
+            bin bins[max_bins];
+            double scale = nbins / extent.size();
+            for (size_t i = start; i < end; ++i) {
+                int b = bin_index(info[i].centroid[axis], extent.min, scale, nbins);
+                bins[b].count++;
+                bins[b].box = aabb(bins[b].box, info[i].box);
+            }
+
+            //从右向左累积右侧的面积和数量，再从左向右求每个分割面的代价
+            double right_area[max_bins];
+            size_t right_count[max_bins];
+            aabb acc = aabb::empty;
+            size_t acc_count = 0;
+            for (int b = nbins - 1; b > 0; --b) {
+                acc = aabb(acc, bins[b].box);
+                acc_count += bins[b].count;
+                right_area[b] = acc.surface_area();
+                right_count[b] = acc_count;
+            }
+            acc = aabb::empty;
+            acc_count = 0;
+            for (int b = 1; b < nbins; ++b) {
+                acc = aabb(acc, bins[b - 1].box);
+                acc_count += bins[b - 1].count;
+                if (acc_count == 0 || right_count[b] == 0) continue;
+                double cost = options.traversal_cost + options.intersection_cost
+                    * (acc_count * acc.surface_area() + right_count[b] * right_area[b]) / area;
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = b;
+                }
+            }
+        }
+
+        if (best_split < 0) return start;
+        if (count <= size_t(options.max_leaf_size) && leaf_cost <= best_cost) return start;
+
+        const interval& extent = centroid_box.axis_interval(best_axis);
+        double scale = nbins / extent.size();
+        int axis = best_axis;
+        auto middle = std::partition(info.begin() + start, info.begin() + end,
+            [=](const primitive_info& p) {
+                return bin_index(p.centroid[axis], extent.min, scale, nbins) < best_split;
+            });
+        return size_t(middle - info.begin());
+    }
+
+    //深度优先展开临时树，左孩子紧跟父节点
+    int flatten(const build_node* node, size_t base) {
+        int index = int(nodes.size());
+        nodes.push_back(bvh_linear_node{});
+        set_bounds(nodes[index], node->box);
+        if (!node->children[0]) {
+            nodes[index].offset = int32_t(base + node->start);
+            nodes[index].primitive_count = uint16_t(node->count);
+            return index;
+        }
+        flatten(node->children[0].get(), base);
+        int right = flatten(node->children[1].get(), base);
+        nodes[index].offset = right;
+        nodes[index].primitive_count = 0;
+        nodes[index].axis = uint8_t(node->axis);
+        return index;
+    }
+
+    static void set_bounds(bvh_linear_node& node, const aabb& box) {
+        for (int axis = 0; axis < 3; ++axis) {
+            const interval& ax = box.axis_interval(axis);
+            node.bmin[axis] = round_down(ax.min);
+            node.bmax[axis] = round_up(ax.max);
+        }
+    }
+
+    static aabb node_box(const bvh_linear_node& node) {
+        return aabb(interval(node.bmin[0], node.bmax[0]), interval(node.bmin[1], node.bmax[1]), interval(node.bmin[2], node.bmax[2]));
+    }
+
+    //节点在时间段内u处的包围盒，静止的树与u无关
+    aabb node_box(int index, double u) const {
+        const bvh_linear_node& node = nodes[index];
+        if (motion.empty()) return node_box(node);
+        const bvh_motion_delta& m = motion[index];
+        interval axes[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            axes[axis] = interval(node.bmin[axis] + u * m.dmin[axis], node.bmax[axis] + u * m.dmax[axis]);
+        }
+        return aabb(axes[0], axes[1], axes[2]);
+    }
+
+    //向外取整的变化量：开头的包围盒加上它，不会比end小。空包围盒等无穷大的情况记为0
+    static void set_motion(bvh_motion_delta& m, const bvh_linear_node& node, const aabb& end) {
+        for (int axis = 0; axis < 3; ++axis) {
+            const interval& ax = end.axis_interval(axis);
+            double dmin = ax.min - double(node.bmin[axis]);
+            double dmax = ax.max - double(node.bmax[axis]);
+            m.dmin[axis] = std::isfinite(dmin) ? round_down(dmin) : 0.0f;
+            m.dmax[axis] = std::isfinite(dmax) ? round_up(dmax) : 0.0f;
+        }
+    }
+
+    //图元在时间t(0到1之间)的包围盒
+    static aabb lerp_box(const aabb& start, const aabb& end, double t) {
+        interval axes[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            const interval& a = start.axis_interval(axis);
+            const interval& b = end.axis_interval(axis);
+            axes[axis] = a.min == b.min && a.max == b.max ? a : interval(a.min + t * (b.min - a.min), a.max + t * (b.max - a.max));
+        }
+        return aabb(axes[0], axes[1], axes[2]);
+    }
+
+    //把[0,1]分成segments段，每段按图元在段内扫过的包围盒建树，再自底向上求出节点在段首和段尾的包围盒。
+    //线性运动的图元在段内任一时刻都在两者的插值之内；多个图元的并集的上界是凸函数、下界是凹函数，
+    //所以节点的插值包围盒同样覆盖子树中的全部图元
+    vector<size_t> build_motion(const vector<aabb>& start, const vector<aabb>& end, int segments) {
+        size_t n = start.size();
         bbox = aabb::empty;
-        for (size_t object_index = start; object_index < end; ++object_index) {
-            bbox = aabb(bbox, objects[object_index]->bounding_box());
+        for (size_t i = 0; i < n; ++i) {
+            bbox = aabb(bbox, aabb(start[i], end[i]));
+        }
+        vector<size_t> order;
+        order.reserve(n * segments);
+        vector<aabb> seg_start(n), seg_end(n), swept(n);
+        for (int k = 0; k < segments; ++k) {
+            double t0 = double(k) / segments, t1 = double(k + 1) / segments;
+            for (size_t i = 0; i < n; ++i) {
+                seg_start[i] = lerp_box(start[i], end[i], t0);
+                seg_end[i] = lerp_box(start[i], end[i], t1);
+                swept[i] = aabb(seg_start[i], seg_end[i]);
+            }
+            int root = int(nodes.size());
+            size_t base = n * k;
+            vector<size_t> seg_order = build_segment(swept, base);
+            roots.push_back(root);
+
+            //孩子的下标总是大于父节点，倒序扫描时孩子的包围盒已经求出
+            int count = int(nodes.size()) - root;
+            vector<aabb> box0(count), box1(count);
+            motion.resize(nodes.size());
+            for (int local = count - 1; local >= 0; --local) {
+                bvh_linear_node& node = nodes[root + local];
+                if (node.primitive_count > 0) {
+                    box0[local] = aabb::empty;
+                    box1[local] = aabb::empty;
+                    for (int p = 0; p < node.primitive_count; ++p) {
+                        size_t index = seg_order[node.offset - base + p];
+                        box0[local] = aabb(box0[local], seg_start[index]);
+                        box1[local] = aabb(box1[local], seg_end[index]);
+                    }
+                }
+                else {
+                    int right = node.offset - root;
+                    box0[local] = aabb(box0[local + 1], box0[right]);
+                    box1[local] = aabb(box1[local + 1], box1[right]);
+                }
+                set_bounds(node, box0[local]);
+                set_motion(motion[root + local], node, box1[local]);
+            }
+            order.insert(order.end(), seg_order.begin(), seg_order.end());
+        }
+        return order;
+    }
+
+    //射中各节点的期望代价，不除以根的面积：节点的表面积在时间段内是时间的二次函数，用Simpson公式求平均正好精确；
+    //分段时一条光线只遍历其中一棵树，按段数取平均
+    double expected_cost() const {
+        double cost = 0.0;
+        for (int i = 0; i < int(nodes.size()); ++i) {
+            double area = node_box(i, 0.0).surface_area();
+            if (!motion.empty()) {
+                area = (area + 4.0 * node_box(i, 0.5).surface_area() + node_box(i, 1.0).surface_area()) / 6.0;
+            }
+            if (nodes[i].primitive_count > 0)
+                cost += options.intersection_cost * nodes[i].primitive_count * area;
+            else
+                cost += options.traversal_cost * area;
+        }
+        return roots.empty() ? 0.0 : cost / roots.size();
+    }
+
+    //光线时间所在的时间段，u为在段内的位置。时间限制在[0,1]内
+    int segment_of(real time, double& u) const {
+        int count = int(roots.size());
+        double x = std::min(std::max(double(time), 0.0), 1.0) * count;
+        int k = std::min(int(x), count - 1);
+        u = x - k;
+        return k;
+    }
+
+    //slab检测，inv_dir和dir_is_neg在整个遍历过程中只计算一次
+    static bool hit_bounds(const bvh_linear_node& node, const point3& ori, const vec3& inv_dir,
+        const int dir_is_neg[3], double t_min, double t_max) {
+        for (int axis = 0; axis < 3; ++axis) {
+            double near_plane = dir_is_neg[axis] ? node.bmax[axis] : node.bmin[axis];
+            double far_plane = dir_is_neg[axis] ? node.bmin[axis] : node.bmax[axis];
+            double t0 = (near_plane - ori[axis]) * inv_dir[axis];
+            double t1 = (far_plane - ori[axis]) * inv_dir[axis];
+            if (t0 > t_min) t_min = t0;
+            if (t1 < t_max) t_max = t1;
+            if (t_min > t_max) return false;
+        }
+        return true;
+    }
+
+    //运动节点：包围盒先插值到u处
+    static bool hit_bounds(const bvh_linear_node& node, const bvh_motion_delta& m, double u, const point3& ori,
+        const vec3& inv_dir, const int dir_is_neg[3], double t_min, double t_max) {
+        for (int axis = 0; axis < 3; ++axis) {
+            double lo = node.bmin[axis] + u * m.dmin[axis];
+            double hi = node.bmax[axis] + u * m.dmax[axis];
+            double t0 = ((dir_is_neg[axis] ? hi : lo) - ori[axis]) * inv_dir[axis];
+            double t1 = ((dir_is_neg[axis] ? lo : hi) - ori[axis]) * inv_dir[axis];
+            if (t0 > t_min) t_min = t0;
+            if (t1 < t_max) t_max = t1;
+            if (t_min > t_max) return false;
+        }
+        return true;
+    }
+
+    //any_hit为真时第一个命中的图元就返回，用于遮挡查询。moving为真时按u插值运动节点的包围盒
+    template <bool any_hit, bool moving, class F>
+    bool hit_binary(int root, double u, const ray& r, interval ray_t, F& hit_primitive) const {
+        const point3& ori = r.origin();
+        const vec3& inv_dir = r.inv_direction();
+        int dir_is_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+
+        int stack[stack_size];
+        int stack_top = 0;
+        int current = root;
+        bool hit_anything = false;
+
+        while (true) {
+            const bvh_linear_node& node = nodes[current];
+            bool inside = moving ? hit_bounds(node, motion[current], u, ori, inv_dir, dir_is_neg, ray_t.min, ray_t.max)
+                : hit_bounds(node, ori, inv_dir, dir_is_neg, ray_t.min, ray_t.max);
+            if (inside) {
+                if (node.primitive_count > 0) {
+                    //找到交点后缩短ray_t.max，被遮挡的部分不再需要考虑
+                    for (int i = 0; i < node.primitive_count; ++i) {
+                        if (hit_primitive(node.offset + i, ray_t)) {
+                            if (any_hit) return true;
+                            hit_anything = true;
+                        }
+                    }
+                    if (stack_top == 0) break;
+                    current = stack[--stack_top];
+                }
+                else if (dir_is_neg[node.axis]) {
+                    stack[stack_top++] = current + 1;
+                    current = node.offset;
+                }
+                else {
+                    stack[stack_top++] = node.offset;
+                    current = current + 1;
+                }
+            }
+            else {
+                if (stack_top == 0) break;
+                current = stack[--stack_top];
+            }
+        }
+        return hit_anything;
+    }
+
+    //单轴的slab，按方向的符号选择近平面和远平面，只用条件选择，便于向量化
+    static void slab(double bmin, double bmax, double ori, double inv, double& tn, double& tf) {
+        double t_lo = (bmin - ori) * inv;
+        double t_hi = (bmax - ori) * inv;
+        double t0 = inv < 0 ? t_hi : t_lo;
+        double t1 = inv < 0 ? t_lo : t_hi;
+        tn = t0 > tn ? t0 : tn;
+        tf = t1 < tf ? t1 : tf;
+    }
+
+    //对光线包中mask内的光线同时做slab检测，返回仍然命中节点包围盒的光线掩码。
+    //moving为真时每条光线按自己的u插值运动节点的包围盒
+    template <bool moving>
+    static uint32_t hit_bounds_packet(const bvh_linear_node& node, const bvh_motion_delta* m, const double u[],
+        const ray_packet& packet, uint32_t mask, double t_min, const real t_max[]) {
+        int inside[max_packet_size];
+        const double min_x = node.bmin[0], min_y = node.bmin[1], min_z = node.bmin[2];
+        const double max_x = node.bmax[0], max_y = node.bmax[1], max_z = node.bmax[2];
+#pragma omp simd
+        for (int k = 0; k < max_packet_size; ++k) {
+            double tn = t_min;
+            double tf = t_max[k];
+            if (moving) {
+                slab(min_x + u[k] * m->dmin[0], max_x + u[k] * m->dmax[0], packet.ox[k], packet.inv_dx[k], tn, tf);
+                slab(min_y + u[k] * m->dmin[1], max_y + u[k] * m->dmax[1], packet.oy[k], packet.inv_dy[k], tn, tf);
+                slab(min_z + u[k] * m->dmin[2], max_z + u[k] * m->dmax[2], packet.oz[k], packet.inv_dz[k], tn, tf);
+            }
+            else {
+                slab(min_x, max_x, packet.ox[k], packet.inv_dx[k], tn, tf);
+                slab(min_y, max_y, packet.oy[k], packet.inv_dy[k], tn, tf);
+                slab(min_z, max_z, packet.oz[k], packet.inv_dz[k], tn, tf);
+            }
+            inside[k] = tn <= tf;
         }
-        int random_com = bbox.longest_axis();
+        uint32_t result = 0;
+        for_each_lane(mask, [&](int k) {
+            if (inside[k]) result |= 1u << k;
+        });
+        return result;
+    }
 
-        auto comparator = random_com == 0 ? compare_x
-                        : random_com == 1 ? compare_y
-                                          : compare_z;
-        size_t slide = end - start;
-        if (slide == 1) {
-            left = right = objects[start];
+    //把二叉树压缩成N叉树：反复展开当前孩子中表面积最大的内部节点，直到凑满N个孩子。返回新宽节点的下标
+    //运动bvh同时在wide_motion中记录孩子包围盒的变化量
+    template <int N>
+    int collapse(vector<bvh_wide_node<N>>& wide, vector<bvh_wide_motion<N>>& wide_motion, int binary_index) {
+        int index = int(wide.size());
+        wide.push_back(bvh_wide_node<N>());
+        wide[index].clear();
+        if (!motion.empty()) {
+            wide_motion.push_back(bvh_wide_motion<N>());
+            wide_motion[index].clear();
         }
-        else if (slide == 2)
-        {
-            left = objects[start];
-            right = objects[start+1];
+
+        int slots[N];
+        int used = 0;
+        const bvh_linear_node& root = nodes[binary_index];
+        if (root.primitive_count > 0) {
+            slots[used++] = binary_index;
         }
         else {
-            std::sort(objects.begin() + start, objects.begin() + end, comparator);
-            size_t mid = start + slide / 2;
-            left = make_shared<bvh_node>(objects, start, mid);
-            right = make_shared<bvh_node>(objects, mid, end);
-        }        
+            slots[used++] = binary_index + 1;
+            slots[used++] = root.offset;
+        }
+        while (used < N) {
+            int best = -1;
+            double best_area = -1.0;
+            for (int i = 0; i < used; ++i) {
+                const bvh_linear_node& node = nodes[slots[i]];
+                if (node.primitive_count > 0) continue;
+                double area = node_box(node).surface_area();
+                if (area > best_area) {
+                    best_area = area;
+                    best = i;
+                }
+            }
+            if (best < 0) break;
+            int expanded = slots[best];
+            slots[best] = expanded + 1;
+            slots[used++] = nodes[expanded].offset;
+        }
+
+        for (int i = 0; i < used; ++i) {
+            const bvh_linear_node& node = nodes[slots[i]];
+            for (int axis = 0; axis < 3; ++axis) {
+                wide[index].bmin[axis][i] = node.bmin[axis];
+                wide[index].bmax[axis][i] = node.bmax[axis];
+                if (!motion.empty()) {
+                    wide_motion[index].dmin[axis][i] = motion[slots[i]].dmin[axis];
+                    wide_motion[index].dmax[axis][i] = motion[slots[i]].dmax[axis];
+                }
+            }
+            if (node.primitive_count > 0) {
+                wide[index].child[i] = node.offset;
+                wide[index].count[i] = node.primitive_count;
+            }
+            else {
+                //递归会扩容wide，不能在调用前后持有元素引用
+                int child = collapse(wide, wide_motion, slots[i]);
+                wide[index].child[i] = child;
+            }
+        }
+        return index;
+    }
+
+    //宽bvh遍历：一次检测节点的全部孩子，叶子按进入距离由近到远立即求交，内部节点由远到近压栈，
+    //出栈时若进入距离已经超过当前最近交点则跳过
+    template <bool any_hit, bool moving, int N, class F>
+    bool hit_wide(const vector<bvh_wide_node<N>>& wide, const vector<bvh_wide_motion<N>>& wide_motion, int root, double u,
+        const ray& r, interval ray_t, F& hit_primitive) const {
+        struct entry {
+            int index;
+            double t_near;
+        };
+
+        wide_ray wr(r);
+        entry stack[stack_size * N];
+        int stack_top = 0;
+        stack[stack_top++] = entry{ root, ray_t.min };
+        bool hit_anything = false;
+
+        while (stack_top > 0) {
+            entry current = stack[--stack_top];
+            if (current.t_near > ray_t.max) continue;
+
+            const bvh_wide_node<N>& node = wide[current.index];
+            double t_near[N];
+            int mask = intersect_children<N, moving>(node, moving ? &wide_motion[current.index] : nullptr, u,
+                wr, ray_t.min, ray_t.max, t_near);
+            if (mask == 0) continue;
+
+            //命中的孩子按进入距离插入排序，N最多为8
+            int order[N];
+            int hits = 0;
+            for (int i = 0; i < N; ++i) {
+                if (!(mask & (1 << i))) continue;
+                int k = hits++;
+                while (k > 0 && t_near[order[k - 1]] > t_near[i]) {
+                    order[k] = order[k - 1];
+                    --k;
+                }
+                order[k] = i;
+            }
+
+            for (int k = hits - 1; k >= 0; --k) {
+                int i = order[k];
+                if (!node.is_leaf(i)) stack[stack_top++] = entry{ node.child[i], t_near[i] };
+            }
+            for (int k = 0; k < hits; ++k) {
+                int i = order[k];
+                if (!node.is_leaf(i) || t_near[i] > ray_t.max) continue;
+                for (int p = 0; p < node.count[i]; ++p) {
+                    if (hit_primitive(node.child[i] + p, ray_t)) {
+                        if (any_hit) return true;
+                        hit_anything = true;
+                    }
+                }
+            }
+        }
+        return hit_anything;
+    }
+
+    //按光线时间选择时间段的根，再按树宽和是否运动选择遍历方式
+    template <bool any_hit, class F>
+    bool dispatch(const ray& r, interval ray_t, F& hit_primitive) const {
+        if (nodes.empty()) return false;
+        double u = 0.0;
+        int k = roots.size() > 1 || !motion.empty() ? segment_of(r.time(), u) : 0;
+        if (motion.empty()) {
+            if (options.width == 4) return hit_wide<any_hit, false>(wide4, wide4_motion, wide_roots[k], u, r, ray_t, hit_primitive);
+            if (options.width == 8) return hit_wide<any_hit, false>(wide8, wide8_motion, wide_roots[k], u, r, ray_t, hit_primitive);
+            return hit_binary<any_hit, false>(roots[k], u, r, ray_t, hit_primitive);
+        }
+        if (options.width == 4) return hit_wide<any_hit, true>(wide4, wide4_motion, wide_roots[k], u, r, ray_t, hit_primitive);
+        if (options.width == 8) return hit_wide<any_hit, true>(wide8, wide8_motion, wide_roots[k], u, r, ray_t, hit_primitive);
+        return hit_binary<any_hit, true>(roots[k], u, r, ray_t, hit_primitive);
+    }
+
+    //从root开始遍历光线包中mask内的光线
+    template <bool moving, class F>
+    uint32_t packet_segment(int root, const double u[], const ray_packet& packet, uint32_t active, real t_min, const real t_max[],
+        F& hit_primitive) const {
+        struct entry {
+            int node;
+            uint32_t mask;
+        };
+        entry stack[stack_size];
+        int stack_top = 0;
+        entry current{ root, active };
+        uint32_t hits = 0;
+
+        while (true) {
+            const bvh_linear_node& node = nodes[current.node];
+            uint32_t mask = hit_bounds_packet<moving>(node, moving ? &motion[current.node] : nullptr, u, packet, current.mask, t_min, t_max);
+            if (mask != 0 && node.primitive_count > 0) {
+                for (int i = 0; i < node.primitive_count; ++i) {
+                    hits |= hit_primitive(node.offset + i, mask);
+                }
+            }
+            else if (mask != 0) {
+                int lane = 0;
+                while (!(mask & (1u << lane))) ++lane;
+                const real* inv_dir[3] = { packet.inv_dx, packet.inv_dy, packet.inv_dz };
+                if (inv_dir[node.axis][lane] < 0) {
+                    stack[stack_top++] = entry{ current.node + 1, mask };
+                    current = entry{ node.offset, mask };
+                }
+                else {
+                    stack[stack_top++] = entry{ node.offset, mask };
+                    current = entry{ current.node + 1, mask };
+                }
+                continue;
+            }
+            if (stack_top == 0) break;
+            current = stack[--stack_top];
+        }
+        return hits;
+    }
+
+public:
+    bvh_tree(const bvh_build_options& opt = bvh_build_options()) :options{ opt } {
+        options.max_leaf_size = std::max(1, std::min(options.max_leaf_size, 65535));
+        options.bin_count = std::max(2, std::min(options.bin_count, int(max_bins)));
+        if (options.width != 4 && options.width != 8) options.width = 2;
+        options.max_time_segments = std::max(1, std::min(options.max_time_segments, int(max_segments)));
+    }
+
+    //按图元包围盒建树，返回叶子顺序：第i个图元是原来的boxes[order[i]]，叶子的offset指向新顺序中的下标
+    vector<size_t> build(const vector<aabb>& boxes) {
+        clear();
+        return build_nodes(boxes);
+    }
+
+    //按图元在时间0和1的包围盒建树。全部图元都静止时与build(boxes)相同；否则建成运动bvh，
+    //时间段数从1开始加倍，直到期望代价不再明显下降或达到max_time_segments。
+    //返回的顺序长度为段数乘以图元数，第k段的图元位于[k*n, (k+1)*n)，调用者为每段保存一份图元
+    vector<size_t> build(const vector<aabb>& start, const vector<aabb>& end) {
+        bool moving = false;
+        for (size_t i = 0; i < start.size() && !moving; ++i) {
+            for (int axis = 0; axis < 3; ++axis) {
+                const interval& a = start[i].axis_interval(axis);
+                const interval& b = end[i].axis_interval(axis);
+                if (a.min != b.min || a.max != b.max) moving = true;
+            }
+        }
+        if (!moving) return build(start);
+
+        clear();
+        vector<size_t> order = build_motion(start, end, 1);
+        double cost = expected_cost();
+        if (options.max_time_segments > 1) {
+            //以中间时刻的静态树为参照，运动带来的额外代价超过一成才考虑分段
+            bvh_build_options binary = options;
+            binary.width = 2;
+            bvh_tree reference(binary);
+            vector<aabb> middle(start.size());
+            for (size_t i = 0; i < start.size(); ++i) middle[i] = lerp_box(start[i], end[i], 0.5);
+            reference.build_nodes(middle);
+            double static_cost = reference.expected_cost();
+            for (int segments = 2; segments <= options.max_time_segments && cost > 1.1 * static_cost; segments *= 2) {
+                bvh_tree candidate(options);
+                vector<size_t> candidate_order = candidate.build_motion(start, end, segments);
+                double candidate_cost = candidate.expected_cost();
+                //多一倍的节点和图元副本，至少要消去四分之一的额外代价
+                if (!(candidate_cost < cost - 0.25 * (cost - static_cost))) break;
+                *this = std::move(candidate);
+                order = std::move(candidate_order);
+                cost = candidate_cost;
+            }
+        }
+        collapse_wide();
+        return order;
+    }
+
+    //直接使用已经建好的二叉节点(例如从文件读入)，只重新生成宽节点。节点来自外部，先检查孩子下标、
+    //叶子的图元范围和树的深度，不合法时返回false且树保持为空。运动bvh另外给出每个节点的变化量和各时间段的根
+    bool assign(vector<bvh_linear_node> linear_nodes, size_t primitive_count,
+        vector<bvh_motion_delta> deltas = vector<bvh_motion_delta>(), vector<int32_t> segment_roots = vector<int32_t>(1, 0)) {
+        clear();
+
+        size_t count = linear_nodes.size();
+        if (count == 0) return deltas.empty();
+        if (!deltas.empty() && deltas.size() != count) return false;
+        if (segment_roots.empty() || segment_roots.size() > max_segments || segment_roots[0] != 0) return false;
+        vector<int> depth(count, 0);
+        for (size_t k = 0; k < segment_roots.size(); ++k) {
+            //每段的节点占据[begin, end)，孩子不能越出本段
+            size_t begin = size_t(segment_roots[k]);
+            size_t end = k + 1 < segment_roots.size() ? size_t(segment_roots[k + 1]) : count;
+            if (end <= begin || end > count) return false;
+            for (size_t n = begin; n < end; ++n) {
+                const bvh_linear_node& node = linear_nodes[n];
+                if (node.primitive_count > 0) {
+                    if (node.offset < 0 || size_t(node.offset) + node.primitive_count > primitive_count) return false;
+                    continue;
+                }
+                //左孩子紧跟父节点，右孩子在左子树之后，下标只会增大，因此不会出现环
+                size_t right = size_t(node.offset);
+                if (node.axis > 2 || node.offset < 0 || n + 1 >= end || right <= n + 1 || right >= end) return false;
+                if (depth[n] + 1 >= stack_size) return false;
+                depth[n + 1] = depth[right] = depth[n] + 1;
+            }
+        }
+
+        nodes = std::move(linear_nodes);
+        motion = std::move(deltas);
+        roots = std::move(segment_roots);
+        for (size_t k = 0; k < roots.size(); ++k) {
+            bbox = aabb(bbox, aabb(node_box(roots[k], 0.0), node_box(roots[k], 1.0)));
+        }
+        collapse_wide();
+        return true;
+    }
+
+    //求光线在ray_t内与树中图元最近的交点。hit_primitive(index, ray_t)检测图元index，
+    //命中时负责把ray_t.max缩小为交点的t并返回true
+    template <class F>
+    bool traverse(const ray& r, interval ray_t, F hit_primitive) const {
+        return dispatch<false>(r, ray_t, hit_primitive);
+    }
+
+    //遮挡查询：ray_t内有任何图元被命中即返回true，不再寻找最近的交点。occludes_primitive(index, ray_t)检测图元index
+    template <class F>
+    bool traverse_any(const ray& r, interval ray_t, F occludes_primitive) const {
+        return dispatch<true>(r, ray_t, occludes_primitive);
+    }
+
+    //光线包遍历二叉节点(宽节点只用于单光线)。所有光线共用一个栈，栈中每一项带有可能命中该子树的光线掩码，
+    //出栈时按当前各光线的t_max重新检测；孩子的访问顺序取第一条有效光线在划分轴上的方向
+    //hit_primitive(index, mask)对mask内的光线检测图元index，与hittable::hit_packet一样缩小t_max并返回命中掩码
+    template <class F>
+    uint32_t traverse_packet(const ray_packet& packet, uint32_t active, real t_min, const real t_max[], F hit_primitive) const {
+        if (nodes.empty() || active == 0) return 0;
+        double u[max_packet_size] = {};
+        if (motion.empty() && roots.size() == 1) return packet_segment<false>(roots[0], u, packet, active, t_min, t_max, hit_primitive);
+
+        //运动bvh：按时间段把光线分组，每组从该段的根开始遍历
+        uint32_t group[max_segments] = {};
+        for_each_lane(active, [&](int k) {
+            group[segment_of(packet.time[k], u[k])] |= 1u << k;
+        });
+        uint32_t hits = 0;
+        for (size_t k = 0; k < roots.size(); ++k) {
+            if (group[k] == 0) continue;
+            if (motion.empty()) hits |= packet_segment<false>(roots[k], u, packet, group[k], t_min, t_max, hit_primitive);
+            else hits |= packet_segment<true>(roots[k], u, packet, group[k], t_min, t_max, hit_primitive);
+        }
+        return hits;
+    }
+
+    aabb bounding_box() const {
+        return bbox;
+    }
+
+    //整棵树在时间0和1的包围盒，含义与hittable::motion_bounds相同。分段时取第一段的开头和最后一段的末尾：
+    //各段的节点包围盒覆盖图元的线性包围盒，而图元包围盒的并集在这两者的插值之内
+    void motion_bounds(aabb& start, aabb& end) const {
+        if (motion.empty()) {
+            start = end = bbox;
+            return;
+        }
+        start = node_box(roots.front(), 0.0);
+        end = node_box(roots.back(), 1.0);
+    }
+
+    const vector<bvh_linear_node>& linear_nodes() const { return nodes; }
+    const vector<bvh_motion_delta>& motion_deltas() const { return motion; }
+    const vector<int32_t>& segment_roots() const { return roots; }
+    int segment_count() const { return std::max(1, int(roots.size())); }
+    bool is_moving() const { return !motion.empty(); }
+    const bvh_build_options& build_options() const { return options; }
+    size_t node_count() const { return nodes.size(); }
+
+    //快照(scene_snapshot.h)保存构建参数、包围盒和线性节点，读入时不再建树
+    template <class W>
+    void save_snapshot(W& w) const {
+        w.u32(uint32_t(options.method));
+        w.u32(uint32_t(options.max_leaf_size));
+        w.u32(uint32_t(options.bin_count));
+        w.u32(uint32_t(options.width));
+        w.f64(options.traversal_cost);
+        w.f64(options.intersection_cost);
+        w.u64(options.parallel_threshold);
+        w.u32(uint32_t(options.max_time_segments));
+        w.box(bbox);
+        w.data(nodes.data(), nodes.size() * sizeof(bvh_linear_node));
+        //运动bvh的节点变化量和各时间段的根，静止的树变化量为空
+        w.data(motion.data(), motion.size() * sizeof(bvh_motion_delta));
+        w.data(roots.data(), roots.size() * sizeof(int32_t));
+    }
+
+    //节点经过assign检查，包围盒用保存的值，由节点重新求出的可能更宽
+    template <class R>
+    bool load_snapshot(R& r, size_t primitive_count) {
+        bvh_build_options opt;
+        opt.method = bvh_build_options::split_method(r.u32());
+        opt.max_leaf_size = int(r.u32());
+        opt.bin_count = int(r.u32());
+        opt.width = int(r.u32());
+        opt.traversal_cost = r.f64();
+        opt.intersection_cost = r.f64();
+        opt.parallel_threshold = size_t(r.u64());
+        opt.max_time_segments = int(r.u32());
+        aabb box = r.box();
+        *this = bvh_tree(opt);
+
+        size_t n;
+        const char* data = r.data(n);
+        if (r.failed || n % sizeof(bvh_linear_node) != 0) return false;
+        vector<bvh_linear_node> linear_nodes(n / sizeof(bvh_linear_node));
+        if (n > 0) std::memcpy(linear_nodes.data(), data, n);
+        data = r.data(n);
+        if (r.failed || n % sizeof(bvh_motion_delta) != 0) return false;
+        vector<bvh_motion_delta> deltas(n / sizeof(bvh_motion_delta));
+        if (n > 0) std::memcpy(deltas.data(), data, n);
+        data = r.data(n);
+        if (r.failed || n % sizeof(int32_t) != 0) return false;
+        vector<int32_t> segment_roots(n / sizeof(int32_t));
+        if (n > 0) std::memcpy(segment_roots.data(), data, n);
+        if (segment_roots.empty()) segment_roots.push_back(0);
+        if (!assign(std::move(linear_nodes), primitive_count, std::move(deltas), std::move(segment_roots))) return false;
+        bbox = box;
+        return true;
+    }
+
+    //按构建参数中的代价模型计算整棵树的SAH代价，用于比较不同构建方法得到的树。
+    //运动bvh的节点面积取时间上的平均，根的面积取整个运动范围的包围盒
+    double sah_cost() const {
+        if (nodes.empty()) return 0.0;
+        double root_area = motion.empty() ? node_box(nodes[0]).surface_area() : bbox.surface_area();
+        if (!(root_area > 0.0) || root_area == infinity) return 0.0;
+        return expected_cost() / root_area;
+    }
+};
+
+class bvh_node : public hittable
+{
+private:
+    vector<shared_ptr<hittable>> primitives;
+    bvh_tree tree;
+
+    bvh_node() = default;
+
+    //嵌套的hittable_list没有坐标变换，直接展开成图元，使其内部的物体也进入bvh
+    static void gather(const vector<shared_ptr<hittable>>& objects, size_t start, size_t end, vector<shared_ptr<hittable>>& out) {
+        for (size_t i = start; i < end; ++i) {
+            auto list = std::dynamic_pointer_cast<hittable_list>(objects[i]);
+            if (list) {
+                gather(list->objects, 0, list->objects.size(), out);
+            }
+            else {
+                out.push_back(objects[i]);
+            }
+        }
+    }
+
+public:
+    bvh_node(const hittable_list& list, const bvh_build_options& opt = bvh_build_options())
+        :bvh_node(list.objects, 0, list.objects.size(), opt) {}
+    bvh_node(const vector<shared_ptr<hittable>>& objects, size_t start, size_t end,
+        const bvh_build_options& opt = bvh_build_options()) :tree{ opt } {
+        vector<shared_ptr<hittable>> flat;
+        gather(objects, start, end, flat);
 
+        long long count = (long long)flat.size();
+        vector<aabb> start_boxes(flat.size()), end_boxes(flat.size());
+#pragma omp parallel for schedule(static) if(count > 4096)
+        for (long long i = 0; i < count; ++i) {
+            flat[i]->motion_bounds(start_boxes[i], end_boxes[i]);
+        }
+        //有运动的图元时建成运动bvh，每个时间段保存一份图元指针
+        vector<size_t> order = tree.build(start_boxes, end_boxes);
+        primitives.reserve(order.size());
+        for (size_t index : order) {
+            primitives.push_back(flat[index]);
+        }
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        if (!bbox.hit(r, ray_t)) return false;
-        bool hit_left = left->hit(r, ray_t, rec);
-        //如果hit_left为真，那么左边递归结果为真说明已经和一个hittable相交，那么被这个物体遮挡的后续光线不需要考虑，因此可以缩短ray_t.max
-        bool hit_right = right->hit(r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
-        return hit_left || hit_right;
+        return tree.traverse(r, ray_t, [&](int index, interval& t) {
+            if (!primitives[index]->hit(r, t, rec)) return false;
+            t.max = rec.t;
+            return true;
+        });
+    }
+
+    uint32_t hit_packet(ray_packet& packet, uint32_t active, real t_min, real t_max[], hit_record recs[]) const override {
+        return tree.traverse_packet(packet, active, t_min, t_max, [&](int index, uint32_t mask) {
+            return primitives[index]->hit_packet(packet, mask, t_min, t_max, recs);
+        });
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        return tree.traverse_any(r, ray_t, [&](int index, interval& t) {
+            return primitives[index]->occluded(r, t);
+        });
     }
+
+    //透射率降为0即提前结束遍历
+    double transmittance(const ray& r, interval ray_t) const override {
+        double result = 1.0;
+        tree.traverse_any(r, ray_t, [&](int index, interval& t) {
+            result *= primitives[index]->transmittance(r, t);
+            return result <= 0.0;
+        });
+        return result;
+    }
+
     aabb bounding_box() const override {
-        return bbox;
+        return tree.bounding_box();
+    }
+
+    template <class W>
+    void save_snapshot(W& w) const {
+        w.u32(uint32_t(primitives.size()));
+        for (const auto& object : primitives) w.ref(object);
+        tree.save_snapshot(w);
     }
+    template <class R>
+    static shared_ptr<bvh_node> load_snapshot(R& r) {
+        shared_ptr<bvh_node> bvh(new bvh_node());
+        uint32_t count = r.u32();
+        for (uint32_t i = 0; i < count && !r.failed; ++i) {
+            auto object = r.object_ref();
+            if (!object) return nullptr;
+            bvh->primitives.push_back(object);
+        }
+        if (!bvh->tree.load_snapshot(r, bvh->primitives.size())) return nullptr;
+        return bvh;
+    }
+
+    void motion_bounds(aabb& start, aabb& end) const override {
+        tree.motion_bounds(start, end);
+    }
+
+    //分段的运动bvh中每个图元出现多次，只收集第一段中的
+    void collect_emitters(vector<shared_ptr<hittable>>& out) const override {
+        for (size_t i = 0; i < primitive_count(); ++i) {
+            collect_emitter(primitives[i], out);
+        }
+    }
+
+    void accumulate_bvh_stats(bvh_stats& stats) const override {
+        if (!stats.first_visit(this)) return;
+        stats.nodes += tree.node_count();
+        stats.sah_cost += tree.sah_cost();
+        for (size_t i = 0; i < primitive_count(); ++i) {
+            primitives[i]->accumulate_bvh_stats(stats);
+        }
+    }
+
+    size_t node_count() const { return tree.node_count(); }
+    size_t primitive_count() const { return primitives.size() / tree.segment_count(); }
+    int segment_count() const { return tree.segment_count(); }
+    double sah_cost() const { return tree.sah_cost(); }
 };
 
 #endif
-
@@ -0,0 +1,160 @@
+#ifndef BVH_WIDE_H
+#define BVH_WIDE_H
+
+#include "rtweekend.h"
+#include <cstdint>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+//实现了N叉(4或8)的宽bvh节点以及一次检测全部N个孩子包围盒的slab求交。
+//孩子包围盒按SoA存放为float(向外取整)，求交时转换为double计算，结果与aabb::hit一致。
+//编译器开启AVX时每次处理4个孩子，否则用SSE2每次处理2个，其他平台退回标量循环。
+//运动bvh的宽节点另外记录孩子包围盒在时间段内的变化量，求交前按光线时间线性插值
+
+template <int N>
+struct bvh_wide_node {
+    float bmin[3][N];
+    float bmax[3][N];
+    int32_t child[N];    //叶子：第一个图元下标；内部：宽节点下标；空位为-1
+    uint16_t count[N];   //叶子的图元数，内部节点和空位为0
+
+    bool is_leaf(int i) const { return count[i] > 0; }
+    bool is_empty(int i) const { return child[i] < 0; }
+
+    //空位的包围盒设为反向无穷，任何光线都不会命中
+    void clear() {
+        for (int i = 0; i < N; ++i) {
+            for (int axis = 0; axis < 3; ++axis) {
+                bmin[axis][i] = std::numeric_limits<float>::infinity();
+                bmax[axis][i] = -std::numeric_limits<float>::infinity();
+            }
+            child[i] = -1;
+            count[i] = 0;
+        }
+    }
+};
+
+//孩子包围盒在时间段末尾相对开头的变化量，向外取整。空位为0，插值后仍是反向无穷
+template <int N>
+struct bvh_wide_motion {
+    float dmin[3][N];
+    float dmax[3][N];
+
+    void clear() {
+        for (int axis = 0; axis < 3; ++axis) {
+            for (int i = 0; i < N; ++i) {
+                dmin[axis][i] = 0.0f;
+                dmax[axis][i] = 0.0f;
+            }
+        }
+    }
+};
+
+//每条光线在遍历开始前准备好的数据，避免在每个节点重复计算
+struct wide_ray {
+    double ori[3];
+    double inv_dir[3];
+    int dir_is_neg[3];
+
+    wide_ray(const ray& r) {
+        for (int axis = 0; axis < 3; ++axis) {
+            ori[axis] = r.origin()[axis];
+            inv_dir[axis] = r.inv_direction()[axis];
+            dir_is_neg[axis] = inv_dir[axis] < 0;
+        }
+    }
+};
+
+//检测节点的全部孩子，返回命中孩子的位掩码，t_near保存每个孩子的进入距离。
+//moving为真时孩子包围盒取开头的包围盒加上u倍的变化量，u是光线时间在时间段内的位置
+template <int N, bool moving = false>
+inline int intersect_children(const bvh_wide_node<N>& node, const bvh_wide_motion<N>* motion, double u,
+    const wide_ray& wr, double t_min, double t_max, double t_near[N]) {
+    int mask = 0;
+#if defined(__AVX__)
+    static_assert(N % 4 == 0, "AVX path handles children in groups of 4");
+    for (int g = 0; g < N; g += 4) {
+        __m256d tn = _mm256_set1_pd(t_min);
+        __m256d tf = _mm256_set1_pd(t_max);
+        for (int axis = 0; axis < 3; ++axis) {
+            const float* near_plane = wr.dir_is_neg[axis] ? node.bmax[axis] : node.bmin[axis];
+            const float* far_plane = wr.dir_is_neg[axis] ? node.bmin[axis] : node.bmax[axis];
+            __m256d o = _mm256_set1_pd(wr.ori[axis]);
+            __m256d inv = _mm256_set1_pd(wr.inv_dir[axis]);
+            __m256d near4 = _mm256_cvtps_pd(_mm_loadu_ps(near_plane + g));
+            __m256d far4 = _mm256_cvtps_pd(_mm_loadu_ps(far_plane + g));
+            if (moving) {
+                const float* near_delta = wr.dir_is_neg[axis] ? motion->dmax[axis] : motion->dmin[axis];
+                const float* far_delta = wr.dir_is_neg[axis] ? motion->dmin[axis] : motion->dmax[axis];
+                __m256d uu = _mm256_set1_pd(u);
+                near4 = _mm256_add_pd(near4, _mm256_mul_pd(uu, _mm256_cvtps_pd(_mm_loadu_ps(near_delta + g))));
+                far4 = _mm256_add_pd(far4, _mm256_mul_pd(uu, _mm256_cvtps_pd(_mm_loadu_ps(far_delta + g))));
+            }
+            __m256d t0 = _mm256_mul_pd(_mm256_sub_pd(near4, o), inv);
+            __m256d t1 = _mm256_mul_pd(_mm256_sub_pd(far4, o), inv);
+            //t0或t1为NaN(平面恰好过原点且方向分量为0)时保留原值
+            tn = _mm256_max_pd(t0, tn);
+            tf = _mm256_min_pd(t1, tf);
+        }
+        mask |= _mm256_movemask_pd(_mm256_cmp_pd(tn, tf, _CMP_LE_OQ)) << g;
+        _mm256_storeu_pd(t_near + g, tn);
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    static_assert(N % 2 == 0, "SSE2 path handles children in pairs");
+    for (int g = 0; g < N; g += 2) {
+        __m128d tn = _mm_set1_pd(t_min);
+        __m128d tf = _mm_set1_pd(t_max);
+        for (int axis = 0; axis < 3; ++axis) {
+            const float* near_plane = wr.dir_is_neg[axis] ? node.bmax[axis] : node.bmin[axis];
+            const float* far_plane = wr.dir_is_neg[axis] ? node.bmin[axis] : node.bmax[axis];
+            __m128d o = _mm_set1_pd(wr.ori[axis]);
+            __m128d inv = _mm_set1_pd(wr.inv_dir[axis]);
+            __m128 near2 = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(near_plane + g)));
+            __m128 far2 = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(far_plane + g)));
+            __m128d near_d = _mm_cvtps_pd(near2);
+            __m128d far_d = _mm_cvtps_pd(far2);
+            if (moving) {
+                const float* near_delta = wr.dir_is_neg[axis] ? motion->dmax[axis] : motion->dmin[axis];
+                const float* far_delta = wr.dir_is_neg[axis] ? motion->dmin[axis] : motion->dmax[axis];
+                __m128d uu = _mm_set1_pd(u);
+                __m128 dn = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(near_delta + g)));
+                __m128 df = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(far_delta + g)));
+                near_d = _mm_add_pd(near_d, _mm_mul_pd(uu, _mm_cvtps_pd(dn)));
+                far_d = _mm_add_pd(far_d, _mm_mul_pd(uu, _mm_cvtps_pd(df)));
+            }
+            __m128d t0 = _mm_mul_pd(_mm_sub_pd(near_d, o), inv);
+            __m128d t1 = _mm_mul_pd(_mm_sub_pd(far_d, o), inv);
+            tn = _mm_max_pd(t0, tn);
+            tf = _mm_min_pd(t1, tf);
+        }
+        mask |= _mm_movemask_pd(_mm_cmple_pd(tn, tf)) << g;
+        _mm_storeu_pd(t_near + g, tn);
+    }
+#else
+    for (int i = 0; i < N; ++i) {
+        double tn = t_min;
+        double tf = t_max;
+        for (int axis = 0; axis < 3; ++axis) {
+            double near_plane = wr.dir_is_neg[axis] ? node.bmax[axis][i] : node.bmin[axis][i];
+            double far_plane = wr.dir_is_neg[axis] ? node.bmin[axis][i] : node.bmax[axis][i];
+            if (moving) {
+                near_plane += u * (wr.dir_is_neg[axis] ? motion->dmax[axis][i] : motion->dmin[axis][i]);
+                far_plane += u * (wr.dir_is_neg[axis] ? motion->dmin[axis][i] : motion->dmax[axis][i]);
+            }
+            double t0 = (near_plane - wr.ori[axis]) * wr.inv_dir[axis];
+            double t1 = (far_plane - wr.ori[axis]) * wr.inv_dir[axis];
+            if (t0 > tn) tn = t0;
+            if (t1 < tf) tf = t1;
+        }
+        if (tn <= tf) mask |= 1 << i;
+        t_near[i] = tn;
+    }
+#endif
+    return mask;
+}
+
+#endif
@@ -4,6 +4,13 @@
 #include "rtweekend.h"
 #include "hittable.h"
 #include "material.h"
+#include "light_sampler.h"
+#include "volume.h"
+#include "tile.h"
+#include "image_output.h"
+#include "pixel_stats.h"
+#include "denoiser.h"
+#include "accumulation.h"
 #include <iomanip>
 #include <sstream>
 
@@ -31,6 +38,84 @@ public:
     point3 lookat{ 0.0,0.0,-1.0 };
     vec3 vup{ 0.0,1.0,0.0 };
 
+    //分块渲染：块的边长以及块的处理顺序
+    int        tile_size{ 16 };
+    tile_order tile_ordering{ tile_order::morton };
+
+    //输出文件，"-"表示标准输出，为空则不输出；编码器为空时按扩展名选择，见image_output.h
+    std::string output_file{ "image.ppm" };
+    shared_ptr<image_encoder> output_encoder;
+
+    //自适应采样：每个像素先采min_samples个样本，之后每adaptive_batch个样本检查一次，
+    //亮度均值的相对标准误差低于adaptive_threshold即停止，未收敛的像素最多采samples_per_pixel个样本
+    bool   adaptive_sampling{ false };
+    int    min_samples{ 16 };
+    int    adaptive_batch{ 8 };
+    double adaptive_threshold{ 0.02 };
+
+    //俄罗斯轮盘赌：从第rr_min_depth次弹射开始，按路径吞吐量的最大分量决定存活概率
+    bool   russian_roulette{ true };
+    int    rr_min_depth{ 3 };
+
+    //次事件估计：每个非镜面的交点向光源上的一个采样点发一条阴影光线，再按材质采样一条光线，两者的贡献用
+    //多重重要性采样的启发式合并。关闭时退回光源和材质各占一半的混合pdf，每次弹射只有一个样本
+    enum mis_heuristic { mis_balance, mis_power };
+    bool          next_event_estimation{ true };
+    mis_heuristic heuristic{ mis_power };
+
+    //充满场景(或限制在fog.bounds内)的均匀雾，density为0时关闭。雾的散射点也做次事件估计
+    homogeneous_fog fog;
+
+    //可选输出每个像素的采样数图和均值方差图，为空则不输出。建议用.pfm/.hdr保存原始数值
+    std::string sample_count_file;
+    std::string variance_file;
+
+    //降噪：输出之前用反照率、法线和深度引导的à-trous滤波器处理图像，见denoiser.h。
+    //几十个样本加一次降噪可以代替上千个样本；自适应采样时样本方差同样用来决定每个像素的模糊程度
+    bool            denoise{ false };
+    atrous_denoiser denoiser;
+
+    //可选输出特征图，为空则不输出。开启降噪或输出任何一张特征图时才记录特征
+    std::string albedo_file;
+    std::string normal_file;
+    std::string depth_file;
+
+    //主光线包的大小：4、8或16条光线分别对应2x2、4x2、4x4的像素块，同一样本编号的主光线一起遍历场景；
+    //其他值表示逐条追踪。二次弹射的光线方向不相干，总是逐条追踪
+    int packet_size{ 16 };
+
+    //断点续渲：checkpoint_file不为空时，后台线程每隔checkpoint_interval秒把已完成的块的样本统计写入该文件(.zacc，
+    //见accumulation.h)，渲染结束时再写一次。开始渲染时文件已经存在，就读入每个像素已有的样本，
+    //只补足到samples_per_pixel；提高samples_per_pixel后再次渲染会在原有样本上继续追加。追加的样本沿用文件中记录的
+    //分层格子，每轮遍历全部格子，最后凑不满一轮的样本在整个像素内均匀分布，新旧样本合起来仍然无偏
+    std::string checkpoint_file;
+    double      checkpoint_interval{ 60.0 };
+
+    //分片渲染：把一帧拆给shard_count次独立的渲染，这次只渲染第shard_index片。shard_tiles按块编号轮流分配，
+    //shard_samples把每个像素的分层样本编号切成shard_count段，每片取其中一段。随机序列由(像素, 样本编号)决定，
+    //各片的样本编号互不重叠，合并后与一次渲染完全相同的样本集合，样本之间相互独立。
+    //按样本分片时不做自适应采样，每片只看到部分样本，无法判断收敛
+    enum shard_mode { shard_tiles, shard_samples };
+    int        shard_count{ 1 };
+    int        shard_index{ 0 };
+    shard_mode sharding{ shard_tiles };
+
+    //不为空时渲染结束后把这次渲染的样本统计写入该文件(.zacc)，分片渲染时交给zrt_merge合成最终图像
+    std::string accumulation_file;
+
+    //场景的标识，make_scene按场景名给出，0表示未知。与决定图像内容的相机参数一起作为累积文件的指纹，
+    //断点续渲和zrt_merge只接受指纹相同的文件
+    uint64_t scene_id{ 0 };
+
+    //是否在std::clog上显示进度条，基准测试时关闭
+    bool show_progress{ true };
+
+    //渲染后的图像，按行优先排列的线性颜色
+    vector<color> framebuffer;
+
+    //记录了特征时为每个像素的平均特征，见denoiser.h，否则为空
+    feature_buffers features;
+
     /* void render(const hittable& world) {
         //初始化相机参数
         initialize();
@@ -51,23 +136,48 @@ public:
         std::clog << "\rDone.                 \n";
     } */
 
-    void render(const hittable& world, const hittable& lights) {
+    //光源从world中自动收集
+    void render(const hittable& world) {
+        render(world, light_sampler(world));
+    }
+
+    void render(const hittable& world, const light_sampler& lights) {
         // 初始化相机参数
         initialize();
+        //没有光源时无法采样，退回只按材质采样
+        has_lights = !lights.empty();
+        const bool collect_features = denoise || !albedo_file.empty() || !normal_file.empty() || !depth_file.empty();
+        const bool checkpointing = !checkpoint_file.empty();
+        accumulation_buffer resumed;
+        if (checkpointing) load_checkpoint(resumed, collect_features);
+        //读入的样本用的是断点文件中的分层格子，追加的样本也用它
+        if (!resumed.pixels.empty()) set_strata(resumed.strata);
+
+        //以块为单位调度，按块分片时只保留属于这一片的块
+        vector<render_tile> tiles = make_tiles(image_width, image_height, tile_size, tile_ordering);
+        if (shard_count > 1 && sharding == shard_tiles) {
+            vector<render_tile> shard;
+            for (const render_tile& tile : tiles) {
+                if (tile.index % shard_count == shard_index) shard.push_back(tile);
+            }
+            tiles.swap(shard);
+        }
+        const int tile_count = int(tiles.size());
 
         // 记录渲染开始的时间点
         auto start_time = std::chrono::steady_clock::now();
 
         // 安全地更新完成的像素数
         std::atomic<int> pixels_done(0);
-        const int total_pixels = image_width * image_height;
+        int total_pixels = 0;
+        for (const render_tile& tile : tiles) total_pixels += tile.pixel_count();
         const int bar_width = 70; // 进度条的宽度    
 
         // 创建进度监视器线程
         std::thread progress_monitor([&]() {
             std::string spinner = "/-\\|";
             size_t spin_idx = 0;
-            while (pixels_done < total_pixels) {
+            while (show_progress && pixels_done < total_pixels) {
                 // 计算已经持续的时间
                 auto current_time = std::chrono::steady_clock::now();
                 auto elapsed_seconds = std::chrono::duration_cast<std::chrono::seconds>(current_time - start_time).count();
@@ -100,33 +210,111 @@ public:
                 std::this_thread::sleep_for(std::chrono::milliseconds(100)); // 更新频率更快，以便观察到旋转效果
             }
             });
-        std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-
-        vector<color> framebuffer(image_height * image_width);
+        framebuffer.assign(image_height * image_width, color(0.0, 0.0, 0.0));
+        vector<color> sample_counts(sample_count_file.empty() ? 0 : image_height * image_width);
+        vector<color> variances(variance_file.empty() && !denoise ? 0 : image_height * image_width);
+        if (collect_features) features.assign(image_height * image_width);
+        else features.clear();
+
+        //每个块先累积到自己的局部缓冲，完成后一次写回framebuffer并更新一次进度
+        std::atomic<long long> samples_taken(0);
+        long long resumed_samples = 0;
+        for (const pixel_stats& stats : resumed.pixels) resumed_samples += stats.count;
+
+        //完成的块写入progress后再置位tile_done，保存线程只读已经置位的块，其余像素取自读入的样本，不需要加锁
+        const bool accumulating = checkpointing || !accumulation_file.empty();
+        accumulation_buffer progress;
+        vector<std::atomic<bool>> tile_done(accumulating ? tile_count : 0);
+        for (auto& done : tile_done) done.store(false);
+        if (accumulating) progress.assign(image_width, image_height, collect_features);
+        std::atomic<bool> rendering(true);
+        std::thread checkpoint_writer;
+        if (checkpointing) {
+            checkpoint_writer = std::thread([&]() {
+                auto last_save = std::chrono::steady_clock::now();
+                while (rendering) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    if (std::chrono::duration<double>(std::chrono::steady_clock::now() - last_save).count() < checkpoint_interval) continue;
+                    collect_accumulation(tiles, tile_done, progress, resumed).save(checkpoint_file);
+                    last_save = std::chrono::steady_clock::now();
+                }
+            });
+        }
 
-#pragma omp parallel for schedule(dynamic, 1) collapse(2)
-        for (int j = 0; j < image_height; ++j) {
-            for (int i = 0; i < image_width; ++i) {
-                color pixel_color{ 0.0,0.0,0.0 };
-                for (int s_i = 0; s_i < sqrt_spp; ++s_i) {
-                    for (int s_j = 0; s_j < sqrt_spp; ++s_j) {
-                        ray r = get_ray(i, j, s_i, s_j);
-                        pixel_color += ray_color(r, depth_max, world, lights);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int t = 0; t < tile_count; ++t) {
+            const render_tile& tile = tiles[t];
+            vector<pixel_stats> tile_buffer(tile.pixel_count());
+            vector<surface_features> tile_features(collect_features ? tile.pixel_count() : 0);
+            if (!resumed.pixels.empty()) {
+                for (int j = tile.y0; j < tile.y1; ++j) {
+                    for (int i = tile.x0; i < tile.x1; ++i) {
+                        int local = (j - tile.y0) * tile.width() + (i - tile.x0);
+                        tile_buffer[local] = resumed.pixels[j * image_width + i];
+                        if (collect_features) tile_features[local] = resumed.features[j * image_width + i];
                     }
                 }
-                pixel_color *= pixel_samples_scale;
-                framebuffer[j * image_width + i] = pixel_color;
-                ++pixels_done;
             }
+            render_tile_pixels(tile, world, lights, tile_buffer, tile_features);
+
+            long long tile_samples = 0;
+            for (int j = tile.y0; j < tile.y1; ++j) {
+                for (int i = tile.x0; i < tile.x1; ++i) {
+                    int local = (j - tile.y0) * tile.width() + (i - tile.x0);
+                    const pixel_stats& stats = tile_buffer[local];
+                    int index = j * image_width + i;
+                    framebuffer[index] = stats.value(samples_per_pixel, adaptive);
+                    if (!sample_counts.empty()) sample_counts[index] = color(stats.count, stats.count, stats.count);
+                    if (!variances.empty()) variances[index] = stats.mean_variance();
+                    if (collect_features) features.set(index, tile_features[local], stats.count);
+                    if (accumulating) {
+                        progress.pixels[index] = stats;
+                        if (collect_features) progress.features[index] = tile_features[local];
+                    }
+                    tile_samples += stats.count;
+                }
+            }
+            if (accumulating) tile_done[t].store(true, std::memory_order_release);
+            samples_taken += tile_samples;
+            pixels_done += tile.pixel_count();
         }
 
         progress_monitor.join();
-        for (const color& pixel_color : framebuffer) {
-            writecolor(std::cout, pixel_color);
+        if (checkpointing) {
+            rendering = false;
+            checkpoint_writer.join();
+        }
+        if (accumulating) {
+            accumulation_buffer accumulated = collect_accumulation(tiles, tile_done, progress, resumed);
+            if (checkpointing) accumulated.save(checkpoint_file);
+            if (!accumulation_file.empty()) accumulated.save(accumulation_file);
+        }
+        auto denoise_start = std::chrono::steady_clock::now();
+        if (denoise) {
+            //每个像素只有一个样本时没有方差估计，只按特征引导
+            int first_samples = adaptive ? std::min(min_samples, samples_per_pixel) : sample_end - sample_begin;
+            framebuffer = denoiser.apply(framebuffer, first_samples > 1 ? variances : vector<color>(), features, image_width, image_height);
+        }
+        auto denoise_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - denoise_start);
+
+        if (!output_file.empty()) write_image(output_file, framebuffer, image_width, image_height, output_encoder);
+        if (!sample_counts.empty()) write_image(sample_count_file, sample_counts, image_width, image_height);
+        if (!variance_file.empty()) write_image(variance_file, variances, image_width, image_height);
+        write_features();
+        last_samples_taken = samples_taken - resumed_samples;
+        if (!show_progress) return;
+        if (adaptive) {
+            std::clog << "\nAdaptive sampling: " << double(samples_taken) / total_pixels << " samples per pixel on average";
         }
+        if (denoise) std::clog << "\nDenoising took " << denoise_time.count() << " ms.";
         std::clog << "\nDone.                 \n";
     }
 
+    int height() const { return image_height; }
+
+    //上一次render实际追踪的样本总数，不含从断点文件读入的样本
+    long long samples_taken() const { return last_samples_taken; }
+
 private:
     int    image_height;        //图片高度
     point3 center;              //相机坐标
@@ -134,12 +322,21 @@ private:
     vec3   pixel_delta_u;       //图片向右一个像素对应向量
     vec3   pixel_delta_v;       //图片向下一个像素对应向量
     double pixel_samples_scale; //像素采样系数
-    int sqrt_spp;               //像素采样数平方根
-    double recip_sqrt_spp;      //上个变量的倒数
+    int sqrt_spp;               //像素采样数平方根，均匀采样时每个像素采sqrt_spp²个样本
+    int strata_sqrt;            //分层格子每边的数目，通常等于sqrt_spp，续渲时取断点文件中记录的值
+    double recip_strata_sqrt;   //上个变量的倒数
+    int strata_stride;          //自适应采样遍历分层格子的步长，与格子总数互质
+    double pixel_spread;        //主光线光锥的张角，即一个像素对应的视角
+    bool adaptive{ false };     //是否做自适应采样，按样本分片时关闭
+    int sample_begin{ 0 };      //均匀采样时这次渲染负责的样本编号[sample_begin, sample_end)
+    int sample_end{ 0 };
     //相机坐标系，v是worldup或vup在视口平面的投影，-w是相机指向方向，u是视口向右方向
     vec3 u, v, w;
     //光圈在u，v方向的向量长度
     vec3 defocus_disk_u, defocus_disk_v;
+    bool has_lights{ true };    //光源列表是否非空
+    shared_ptr<material> fog_phase;  //雾的散射点使用的各向同性相函数
+    long long last_samples_taken{ 0 };
 
     void initialize() {
         //图片参数
@@ -149,7 +346,19 @@ private:
         //像素采样系数
         pixel_samples_scale = 1.0 / samples_per_pixel;
         sqrt_spp = int(sqrt(samples_per_pixel));
-        recip_sqrt_spp = 1.0 / sqrt_spp;
+        set_strata(sqrt_spp);
+        int strata = sqrt_spp * sqrt_spp;
+
+        //分片设置不合法时退回不分片
+        if (shard_count < 1 || shard_index < 0 || shard_index >= shard_count) {
+            std::cerr << "ERROR: Invalid shard " << shard_index << " of " << shard_count << ", rendering the whole image.\n";
+            shard_count = 1;
+            shard_index = 0;
+        }
+        const bool sample_sharded = shard_count > 1 && sharding == shard_samples;
+        adaptive = adaptive_sampling && !sample_sharded;
+        sample_begin = sample_sharded ? int((long long)strata * shard_index / shard_count) : 0;
+        sample_end = sample_sharded ? int((long long)strata * (shard_index + 1) / shard_count) : strata;
 
         //定义相机位置
         center = lookfrom;
@@ -160,6 +369,7 @@ private:
         double theta = degree_to_radian(vfov);
         double viewport_height = 2.0 * tan(theta / 2.0) * focus_dist;
         double viewport_width = viewport_height * (double(image_width) / image_height);
+        pixel_spread = 2.0 * tan(theta / 2.0) / image_height;
 
         //计算u,v,w
         w = -normalize(look_direction);
@@ -182,10 +392,255 @@ private:
         //计算左上像素中心点位置，根据uvw
         point3 viewport_left_up_loc = center - (focus_dist * w) - viewport_u / 2 - viewport_v / 2;
         pixel00_loc = viewport_left_up_loc + 0.5 * (pixel_delta_u + pixel_delta_v);
+
+        fog_phase = make_shared<isotropic>(fog.albedo);
+    }
+
+    void set_strata(int n) {
+        strata_sqrt = n;
+        recip_strata_sqrt = 1.0 / n;
+        //取接近格子总数0.618倍且与之互质的步长，相邻样本落在相距较远的格子里
+        int strata = n * n;
+        strata_stride = std::max(1, int(strata * 0.618));
+        while (gcd(strata_stride, strata) != 1) ++strata_stride;
     }
+
+    //均匀采样时第s个样本所在的分层格子。样本每strata_sqrt²个一轮，依次落在格子(s / strata_sqrt, s % strata_sqrt)中；
+    //续渲时提高了采样数，最后一轮凑不满时这一轮的样本不分层(s_i为-1)，每个样本的期望仍然是像素的积分
+    void uniform_stratum(int s, int& s_i, int& s_j) const {
+        int strata = strata_sqrt * strata_sqrt;
+        if ((s / strata + 1) * strata > sqrt_spp * sqrt_spp) {
+            s_i = s_j = -1;
+            return;
+        }
+        s %= strata;
+        s_i = s / strata_sqrt;
+        s_j = s % strata_sqrt;
+    }
+    //渲染一个块内的全部像素，每个像素的样本统计按块内行优先顺序写入out。
+    //features不为空时同样按块内顺序累加每个样本的特征。out中已有样本(断点续渲)的像素从下一个样本编号继续
+    void render_tile_pixels(const render_tile& tile, const hittable& world, const light_sampler& lights, vector<pixel_stats>& out,
+        vector<surface_features>& features) const {
+        //光线包要求块内的像素从同一个样本编号开始，读入了样本的块逐个像素补足，结果相同
+        bool resumed = false;
+        for (const pixel_stats& stats : out) resumed = resumed || stats.count > 0;
+        if (!resumed && (packet_size == 4 || packet_size == 8 || packet_size == 16)) {
+            render_tile_packets(tile, world, lights, out, features);
+            return;
+        }
+        for (int j = tile.y0; j < tile.y1; ++j) {
+            for (int i = tile.x0; i < tile.x1; ++i) {
+                int local = (j - tile.y0) * tile.width() + (i - tile.x0);
+                pixel_stats& stats = out[local];
+                surface_features* pixel_features = features.empty() ? nullptr : &features[local];
+                if (!adaptive) {
+                    for (int s = sample_begin + stats.count; s < sample_end; ++s) {
+                        int s_i, s_j;
+                        uniform_stratum(s, s_i, s_j);
+                        stats.add(sample_pixel(i, j, s, s_i, s_j, world, lights, pixel_features));
+                    }
+                    continue;
+                }
+
+                int s = stats.count;
+                if (s >= min_samples && stats.converged(adaptive_threshold)) continue;
+                while (s < samples_per_pixel) {
+                    int batch_end = std::min(samples_per_pixel, s < min_samples ? min_samples : s + adaptive_batch);
+                    for (; s < batch_end; ++s) {
+                        //按固定步长遍历分层格子，提前停止的像素也能均匀覆盖
+                        int stratum = int((long long)s * strata_stride % (strata_sqrt * strata_sqrt));
+                        stats.add(sample_pixel(i, j, s, stratum / strata_sqrt, stratum % strata_sqrt, world, lights, pixel_features));
+                    }
+                    if (stats.converged(adaptive_threshold)) break;
+                }
+            }
+        }
+    }
+
+    //按像素块渲染，每个像素对应光线包中的一条光线。自适应采样时所有像素按相同的样本编号推进，已收敛的像素从掩码中去掉
+    void render_tile_packets(const render_tile& tile, const hittable& world, const light_sampler& lights, vector<pixel_stats>& out,
+        vector<surface_features>& features) const {
+        const int block_w = packet_size == 4 ? 2 : 4;
+        const int block_h = packet_size / block_w;
+        ray_packet packet;
+        hit_record recs[max_packet_size];
+        int px[max_packet_size], py[max_packet_size];
+        pixel_stats* stats[max_packet_size];
+        surface_features* lane_features[max_packet_size];
+
+        for (int by = tile.y0; by < tile.y1; by += block_h) {
+            for (int bx = tile.x0; bx < tile.x1; bx += block_w) {
+                int lanes = 0;
+                for (int j = by; j < std::min(by + block_h, tile.y1); ++j) {
+                    for (int i = bx; i < std::min(bx + block_w, tile.x1); ++i) {
+                        px[lanes] = i;
+                        py[lanes] = j;
+                        int local = (j - tile.y0) * tile.width() + (i - tile.x0);
+                        stats[lanes] = &out[local];
+                        lane_features[lanes] = features.empty() ? nullptr : &features[local];
+                        ++lanes;
+                    }
+                }
+                uint32_t all = (1u << lanes) - 1;
+
+                if (!adaptive) {
+                    for (int s = sample_begin; s < sample_end; ++s) {
+                        int s_i, s_j;
+                        uniform_stratum(s, s_i, s_j);
+                        sample_packet(packet, recs, all, px, py, s, s_i, s_j, world, lights, stats, lane_features);
+                    }
+                    continue;
+                }
+
+                uint32_t active = all;
+                int s = 0;
+                while (s < samples_per_pixel && active != 0) {
+                    int batch_end = std::min(samples_per_pixel, s < min_samples ? min_samples : s + adaptive_batch);
+                    for (; s < batch_end; ++s) {
+                        int stratum = int((long long)s * strata_stride % (strata_sqrt * strata_sqrt));
+                        sample_packet(packet, recs, active, px, py, s, stratum / strata_sqrt, stratum % strata_sqrt, world, lights, stats, lane_features);
+                    }
+                    for_each_lane(active, [&](int k) {
+                        if (stats[k]->converged(adaptive_threshold)) active &= ~(1u << k);
+                    });
+                }
+            }
+        }
+    }
+
+    //为active中的每个像素生成第sample个样本的主光线，一起求交后再逐条继续追踪路径。
+    //每条光线保存自己的随机数状态，结果与逐条调用sample_pixel相同
+    void sample_packet(ray_packet& packet, hit_record recs[], uint32_t active, const int px[], const int py[], int sample, int s_i, int s_j,
+        const hittable& world, const light_sampler& lights, pixel_stats* stats[], surface_features* features[]) const {
+        for_each_lane(active, [&](int k) {
+            thread_rng().seed(py[k] * image_width + px[k], sample);
+            packet.set(k, get_ray(px[k], py[k], s_i, s_j));
+            packet.rng[k] = thread_rng();
+        });
+
+        real t_max[max_packet_size];
+        for (int k = 0; k < max_packet_size; ++k) t_max[k] = real(infinity);
+        uint32_t hits = depth_max > 0 ? world.hit_packet(packet, active, real(0.001), t_max, recs) : 0;
+
+        for_each_lane(active, [&](int k) {
+            thread_rng() = packet.rng[k];
+            bool hit = (hits >> k) & 1u;
+            stats[k]->add(depth_max > 0 ? trace_path(packet.rays[k], hit, recs[k], depth_max, world, lights, features[k]) : color(0.0, 0.0, 0.0));
+        });
+    }
+
+    //对像素(i, j)的第sample个样本追踪一条光线，样本落在分层格子(s_i, s_j)中，s_i为-1时在整个像素内均匀分布
+    color sample_pixel(int i, int j, int sample, int s_i, int s_j, const hittable& world, const light_sampler& lights,
+        surface_features* features) const {
+        //随机序列只由(像素, 样本)决定，结果与线程数和块的划分无关
+        thread_rng().seed(j * image_width + i, sample);
+        ray r = get_ray(i, j, s_i, s_j);
+        return ray_color(r, depth_max, world, lights, features);
+    }
+
+    //场景标识和决定图像内容的参数的哈希，图像大小另外比较。采样数、采样方式和光源选择只影响噪声，
+    //各种无偏估计的样本可以合并，不计入
+    uint64_t fingerprint() const {
+        const double values[] = {
+            double(depth_max), background.x(), background.y(), background.z(),
+            vfov, focus_dist, defocus_degree, lookfrom.x(), lookfrom.y(), lookfrom.z(),
+            lookat.x(), lookat.y(), lookat.z(), vup.x(), vup.y(), vup.z(),
+            fog.density, fog.albedo.x(), fog.albedo.y(), fog.albedo.z(),
+            double(fog.bounds.x.min), double(fog.bounds.x.max), double(fog.bounds.y.min),
+            double(fog.bounds.y.max), double(fog.bounds.z.min), double(fog.bounds.z.max)
+        };
+        return mix64(hash_bytes(values, sizeof(values), hash_bytes(&scene_id, sizeof(scene_id))));
+    }
+
+    //读入断点文件。文件不存在时从头开始；读取失败或者场景和相机、图像大小、是否记录特征、分片方式、是否自适应采样
+    //与这次渲染不同时报错，也从头开始
+    void load_checkpoint(accumulation_buffer& resumed, bool collect_features) const {
+        if (!std::ifstream(checkpoint_file)) return;
+        accumulation_buffer loaded;
+        if (!loaded.load(checkpoint_file)) {
+            std::cerr << "ERROR: Ignoring checkpoint '" << checkpoint_file << "', rendering from scratch.\n";
+            return;
+        }
+        if (loaded.fingerprint != fingerprint()) {
+            std::cerr << "ERROR: Checkpoint '" << checkpoint_file << "' was rendered from a different scene or camera. "
+                "Rendering from scratch.\n";
+            return;
+        }
+        if (loaded.width != image_width || loaded.height != image_height || loaded.has_features() != collect_features) {
+            std::cerr << "ERROR: Checkpoint '" << checkpoint_file << "' is " << loaded.width << 'x' << loaded.height
+                << (loaded.has_features() ? " with" : " without") << " feature buffers, but this render is " << image_width << 'x'
+                << image_height << (collect_features ? " with" : " without") << " them. Rendering from scratch.\n";
+            return;
+        }
+        //按样本分片时读入的样本数是相对于sample_begin的，采样数不同时各片的样本编号范围也不同
+        bool sample_sharded = shard_count > 1 && sharding == shard_samples;
+        if (loaded.shard_count != shard_count || loaded.shard_index != shard_index || loaded.shard_samples != sample_sharded
+            || (sample_sharded && loaded.samples_per_pixel != samples_per_pixel)) {
+            std::cerr << "ERROR: Checkpoint '" << checkpoint_file << "' was written by shard " << loaded.shard_index << " of "
+                << loaded.shard_count << " with different shard settings. Rendering from scratch.\n";
+            return;
+        }
+        //自适应采样按strata_stride跳着访问分层格子，均匀采样从stats.count起按行访问，两者续接时格子会重复或漏掉
+        if (loaded.adaptive != adaptive) {
+            std::cerr << "ERROR: Checkpoint '" << checkpoint_file << "' was rendered " << (loaded.adaptive ? "with" : "without")
+                << " adaptive sampling, but this render is " << (adaptive ? "adaptive" : "uniform") << ". Rendering from scratch.\n";
+            return;
+        }
+        resumed = std::move(loaded);
+        if (show_progress) std::clog << "Resuming from checkpoint '" << checkpoint_file << "'.\n";
+    }
+
+    //读入的样本加上已经完成的块，合成完整的累积缓冲。未完成的块(以及不属于这一片的块)保留读入时的样本
+    accumulation_buffer collect_accumulation(const vector<render_tile>& tiles, const vector<std::atomic<bool>>& tile_done,
+        const accumulation_buffer& progress, const accumulation_buffer& resumed) const {
+        accumulation_buffer snapshot;
+        if (!resumed.pixels.empty()) snapshot = resumed;
+        else snapshot.assign(image_width, image_height, progress.has_features());
+        snapshot.samples_per_pixel = samples_per_pixel;
+        snapshot.adaptive = adaptive;
+        snapshot.strata = strata_sqrt;
+        snapshot.fingerprint = fingerprint();
+        snapshot.shard_index = shard_index;
+        snapshot.shard_count = shard_count;
+        snapshot.shard_samples = shard_count > 1 && sharding == shard_samples;
+        for (size_t t = 0; t < tiles.size(); ++t) {
+            if (!tile_done[t].load(std::memory_order_acquire)) continue;
+            const render_tile& tile = tiles[t];
+            for (int j = tile.y0; j < tile.y1; ++j) {
+                for (int i = tile.x0; i < tile.x1; ++i) {
+                    int index = j * image_width + i;
+                    snapshot.pixels[index] = progress.pixels[index];
+                    if (snapshot.has_features()) snapshot.features[index] = progress.features[index];
+                }
+            }
+        }
+        return snapshot;
+    }
+
+    //输出要求的特征图，法线和深度按原始数值写出，建议用.pfm/.hdr保存
+    void write_features() const {
+        if (features.empty()) return;
+        if (!albedo_file.empty()) write_image(albedo_file, features.albedo, image_width, image_height);
+        if (!normal_file.empty()) write_image(normal_file, features.normal, image_width, image_height);
+        if (!depth_file.empty()) {
+            vector<color> depth(features.depth.size());
+            for (size_t p = 0; p < depth.size(); ++p) depth[p] = color(features.depth[p], features.depth[p], features.depth[p]);
+            write_image(depth_file, depth, image_width, image_height);
+        }
+    }
+
+    static int gcd(int a, int b) {
+        while (b != 0) {
+            int t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
     //像素点上确定采样光线
     ray get_ray(int i, int j, int s_i, int s_j) const {
-        vec3 offset = sample_square_layer(s_i, s_j);
+        vec3 offset = s_i < 0 ? sample_square() : sample_square_layer(s_i, s_j);
         point3 pixel_sample{ pixel00_loc
                             + (i + offset.x()) * pixel_delta_u
                             + (j + offset.y()) * pixel_delta_v };
@@ -202,8 +657,8 @@ private:
 
     //分层采样
     vec3 sample_square_layer(int s_i, int s_j) const {
-        double s_x = (s_i + random_double()) * recip_sqrt_spp - 0.5;
-        double s_y = (s_j + random_double()) * recip_sqrt_spp - 0.5;
+        double s_x = (s_i + random_double()) * recip_strata_sqrt - 0.5;
+        double s_y = (s_j + random_double()) * recip_strata_sqrt - 0.5;
         return vec3(s_x, s_y, 0.0);
     }
 
@@ -214,39 +669,167 @@ private:
     }
 
     //着色
-    //规定了递归深度,忽略精度误差导致的过近的交点
-    color ray_color(const ray& r, int depth, const hittable& world, const hittable& lights) const {
-        if (depth <= 0)return color(0.0, 0.0, 0.0);
+    //迭代的路径追踪：沿路径维护吞吐量throughput，每次弹射累加 吞吐量*自发光。规定了最大弹射次数,忽略精度误差导致的过近的交点。
+    //从第rr_min_depth次弹射起用俄罗斯轮盘赌提前终止低吞吐量的路径，存活的路径按存活概率放大，期望不变
+    color ray_color(const ray& r_in, int depth, const hittable& world, const light_sampler& lights, surface_features* features) const {
+        if (depth <= 0) return color(0.0, 0.0, 0.0);
         hit_record rec{};
-        //光线不与任何物体有交点，返回背景色
-        if (!world.hit(r, interval(0.001, infinity), rec)) {
-            return background;
-        }
+        bool hit = world.hit(r_in, interval(0.001, infinity), rec);
+        return trace_path(r_in, hit, rec, depth, world, lights, features);
+    }
 
-        scatter_record srec;
+    //从已经求出的第一个交点开始追踪路径，光线包求出主光线的交点后也从这里继续
+    //路径上同时维护一个光锥用于纹理过滤：主光线的张角为一个像素的视角，宽度随传播距离增长。
+    //镜面反射和折射保持张角；漫反射后光线方向在半球内随机，单条光线不再对应连续的足迹，张角至少放宽到diffuse_cone_spread
+    //次事件估计时，按材质采样的光线命中光源后，自发光按上一个交点处两种采样方式的概率密度加权；
+    //主光线和镜面弹射后的光线无法由光源采样得到，权重为1。
+    //features不为空时累加这个样本的特征：第一个非镜面交点、发光表面或背景处的反照率、法线和沿路径走过的距离，
+    //之前镜面弹射的衰减乘进反照率；路径在此之前结束时取最后一个镜面交点。背景的法线为0
+    color trace_path(const ray& r_in, bool hit, hit_record rec, int depth, const hittable& world, const light_sampler& lights,
+        surface_features* features) const {
+        const double diffuse_cone_spread = 0.05;
+        color radiance{ 0.0,0.0,0.0 };
+        color throughput{ 1.0,1.0,1.0 };
+        ray r = r_in;
+        double cone_width = 0.0, cone_spread = pixel_spread;
+        const bool sample_lights = has_lights && next_event_estimation;
+        double bsdf_pdf = 0.0;  //上一次按材质采样的概率密度，0表示上一次是主光线或镜面弹射
+        color feature_albedo{ 1.0,1.0,1.0 };
+        double feature_depth = 0.0;
+        auto record_features = [&](const color& albedo, const vec3& normal) {
+            if (!features) return;
+            features->albedo += albedo;
+            features->normal += normal;
+            features->depth += feature_depth;
+            features = nullptr;
+        };
+
+        for (int bounce = 0; bounce < depth; ++bounce) {
+            if (bounce > 0) hit = world.hit(r, interval(0.001, infinity), rec);
+            //在到达交点之前先与雾散射时，把散射点当作交点，之后与介质中的散射点一样处理
+            real fog_t;
+            if (fog.sample(r, interval(0.001, hit ? rec.t : infinity), fog_t)) {
+                hit = true;
+                rec.t = fog_t;
+                rec.p = r.at(fog_t);
+                rec.normal = vec3(1, 0, 0);
+                rec.front_face = true;
+                rec.uv_density = 0;
+                rec.mat = fog_phase.get();
+            }
+            //光线不与任何物体有交点，加上背景色
+            if (!hit) {
+                radiance += throughput * background;
+                record_features(feature_albedo, vec3(0.0, 0.0, 0.0));
+                break;
+            }
 
-        color color_from_emission = rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
-        //光线不产生反射光，说明射入光源，返回光源照亮
-        if (!rec.mat->scatter(r, rec, srec)) {
-            return color_from_emission;
-        }
+            //斜着看表面时足迹被拉长，按余弦放大，限制在10倍以内避免掠射时过度模糊
+            double direction_length = r.direction().length();
+            cone_width += cone_spread * rec.t * direction_length;
+            feature_depth += rec.t * direction_length;
+            double cos_theta = fabs(dot(r.direction(), rec.normal)) / direction_length;
+            rec.cone_width = real(cone_width / fmax(cos_theta, 0.1));
 
-        if (srec.skip_pdf) {
-            return srec.attenuation * ray_color(srec.skip_pdf_ray, depth - 1, world, lights);
-        }
+            color emitted = rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
+            if (sample_lights && bsdf_pdf > 0.0 && !is_black(emitted)) {
+                emitted *= mis_weight(bsdf_pdf, lights.hit_pdf(r, rec.t));
+            }
+            radiance += throughput * emitted;
 
-        auto light_ptr = make_shared<hittable_pdf>(lights, rec.p);
-        mixture_pdf p(light_ptr, srec.pdf_ptr);
+            scatter_record srec;
+            //光线不产生反射光，说明射入光源，加上光源照亮后结束
+            if (!rec.mat->scatter(r, rec, srec)) {
+                record_features(feature_albedo, rec.normal);
+                break;
+            }
 
-        ray scattered = ray(rec.p, p.generate(), r.time());
-        auto pdf_val = p.value(scattered.direction());
+            if (srec.skip_pdf) {
+                feature_albedo = feature_albedo * srec.attenuation;
+                throughput = throughput * srec.attenuation;
+                r = srec.skip_pdf_ray;
+                bsdf_pdf = 0.0;
+            }
+            else if (sample_lights) {
+                record_features(feature_albedo * srec.attenuation, rec.normal);
+                radiance += throughput * srec.attenuation * sample_direct(r, rec, srec, world, lights);
+
+                ray scattered = ray(rec.p, srec.pdf.generate(), r.time());
+                bsdf_pdf = srec.pdf.value(scattered.direction());
+                double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
+                if (!(bsdf_pdf > 0.0)) break;
+
+                throughput = throughput * srec.attenuation * (scattering_pdf / bsdf_pdf);
+                r = scattered;
+                cone_spread = fmax(cone_spread, diffuse_cone_spread);
+            }
+            else {
+                record_features(feature_albedo * srec.attenuation, rec.normal);
+                //光源pdf和材质pdf都在栈上，每次弹射不做堆分配，也没有引用计数的原子操作
+                hittable_pdf light_pdf(lights, rec.p);
+                mixture_pdf mixture(light_pdf, srec.pdf);
+                const pdf& p = has_lights ? static_cast<const pdf&>(mixture) : srec.pdf;
+
+                ray scattered = ray(rec.p, p.generate(), r.time());
+                auto pdf_val = p.value(scattered.direction());
+                double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
+
+                throughput = throughput * srec.attenuation * (scattering_pdf / pdf_val);
+                r = scattered;
+                cone_spread = fmax(cone_spread, diffuse_cone_spread);
+            }
 
-        double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
-        //double pdf = scattering_pdf;
+            if (russian_roulette && bounce + 1 >= rr_min_depth) {
+                double survival = fmin(1.0, fmax(throughput.x(), fmax(throughput.y(), throughput.z())));
+                if (!(random_double() < survival)) break;
+                throughput /= survival;
+            }
+        }
+        //只经过镜面弹射就结束的路径(达到最大弹射次数或被俄罗斯轮盘赌终止)取最后一个镜面交点的特征，
+        //否则这个样本计入样本数却没有特征，玻璃和镜子像素的特征会被拉向0
+        record_features(feature_albedo, hit ? rec.normal : vec3(0.0, 0.0, 0.0));
+        return radiance;
+    }
+    static bool is_black(const color& c) {
+        return c.x() == 0.0 && c.y() == 0.0 && c.z() == 0.0;
+    }
 
-        color color_from_scatter = (srec.attenuation * scattering_pdf * ray_color(scattered, depth - 1, world, lights)) / pdf_val;
-        return color_from_emission + color_from_scatter;
+    //采样方式a得到的样本的权重，b为另一种采样方式得到同一样本的概率密度
+    double mis_weight(double a, double b) const {
+        if (heuristic == mis_power) {
+            a *= a;
+            b *= b;
+        }
+        return a / (a + b);
     }
+
+    //在光源上取一个点并发出阴影光线，返回未乘反照率的直接光照 scattering_pdf * Le * 权重 / 光源pdf。
+    //scattering_pdf与反照率之积就是BSDF乘以余弦，与按材质采样时吞吐量的更新方式一致
+    color sample_direct(const ray& r, const hit_record& rec, const scatter_record& srec, const hittable& world,
+        const light_sampler& lights) const {
+        hit_record light_rec;
+        double light_pdf;
+        if (!lights.sample_light(rec.p, light_rec, light_pdf) || !(light_pdf > 0.0) || !light_rec.mat) {
+            return color(0.0, 0.0, 0.0);
+        }
+        vec3 to_light = light_rec.p - rec.p;
+        double distance = to_light.length();
+        ray shadow(rec.p, to_light / distance, r.time());
+        color light = light_rec.mat->emitted(shadow, light_rec, light_rec.u, light_rec.v, light_rec.p);
+        if (is_black(light)) return color(0.0, 0.0, 0.0);
+        double scattering_pdf = rec.mat->scattering_pdf(r, rec, shadow);
+        if (!(scattering_pdf > 0.0)) return color(0.0, 0.0, 0.0);
+
+        //阴影光线在光源表面之前停下，不会与光源自身相交。穿过介质时乘以透射率，而不是随机地完全遮挡
+        interval segment(0.001, distance - 0.001);
+        double transmittance = world.transmittance(shadow, segment);
+        if (!(transmittance > 0.0)) return color(0.0, 0.0, 0.0);
+        transmittance *= fog.transmittance(shadow, segment);
+
+        double weight = mis_weight(light_pdf, srec.pdf.value(shadow.direction()));
+        return light * (scattering_pdf * weight * transmittance / light_pdf);
+    }
+
     /*     color ray_color(const ray& r, int depth, const hittable& world) const {
             // If we've exceeded the ray bounce limit, no more light is gathered.
             if (depth <= 0)
@@ -7,6 +7,8 @@
 #include "material.h"
 #include "texture.h"
 
+//边界内密度均匀的介质。边界的进出区间每次查询只求一次(球一次解出两个根)，散射距离按指数分布采样；
+//阴影光线的透射率exp(-密度*距离)可以直接算出，不需要随机数
 class constant_medium : public hittable {
   public:
     constant_medium(shared_ptr<hittable> boundary, double density, shared_ptr<texture> tex)
@@ -20,58 +22,82 @@ class constant_medium : public hittable {
     {}
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        // Print occasional samples when debugging. To enable, set enableDebug true.
-        const bool enableDebug = false;
-        const bool debugging = enableDebug && random_double() < 0.00001;
-
-        hit_record rec1, rec2;
-
-        if (!boundary->hit(r, interval::universe, rec1))
-            return false;
-
-        if (!boundary->hit(r, interval(rec1.t+0.0001, infinity), rec2))
-            return false;
-
-        if (debugging) std::clog << "\nt_min=" << rec1.t << ", t_max=" << rec2.t << '\n';
-
-        if (rec1.t < ray_t.min) rec1.t = ray_t.min;
-        if (rec2.t > ray_t.max) rec2.t = ray_t.max;
-
-        if (rec1.t >= rec2.t)
+        real t_enter, t_exit;
+        if (!inside_span(r, ray_t, t_enter, t_exit))
             return false;
 
-        if (rec1.t < 0)
-            rec1.t = 0;
-
         auto ray_length = r.direction().length();
-        auto distance_inside_boundary = (rec2.t - rec1.t) * ray_length;
+        auto distance_inside_boundary = (t_exit - t_enter) * ray_length;
         auto hit_distance = neg_inv_density * log(random_double());
 
         if (hit_distance > distance_inside_boundary)
             return false;
 
-        rec.t = rec1.t + hit_distance / ray_length;
+        rec.t = t_enter + hit_distance / ray_length;
         rec.p = r.at(rec.t);
 
-        if (debugging) {
-            std::clog << "hit_distance = " <<  hit_distance << '\n'
-                      << "rec.t = " <<  rec.t << '\n'
-                      << "rec.p = " <<  rec.p << '\n';
-        }
-
         rec.normal = vec3(1,0,0);  // arbitrary
         rec.front_face = true;     // also arbitrary
-        rec.mat = phase_function;
+        rec.uv_density = 0;        //介质内部没有纹理坐标，不做过滤
+        rec.mat = phase_function.get();
 
         return true;
     }
 
+    //与hit相同的随机散射距离，只判断散射点是否落在ray_t内
+    bool occluded(const ray& r, interval ray_t) const override {
+        real t_enter, t_exit;
+        if (!inside_span(r, ray_t, t_enter, t_exit))
+            return false;
+        auto hit_distance = neg_inv_density * log(random_double());
+        return hit_distance <= (t_exit - t_enter) * r.direction().length();
+    }
+
+    double transmittance(const ray& r, interval ray_t) const override {
+        real t_enter, t_exit;
+        if (!inside_span(r, ray_t, t_enter, t_exit))
+            return 1.0;
+        return exp((t_exit - t_enter) * r.direction().length() / neg_inv_density);
+    }
+
     aabb bounding_box() const override { return boundary->bounding_box(); }
 
+    void accumulate_bvh_stats(bvh_stats& stats) const override {
+        boundary->accumulate_bvh_stats(stats);
+    }
+
+    template <class W>
+    void save_snapshot(W& w) const {
+        w.f64(neg_inv_density);
+        w.ref(boundary);
+        w.ref(phase_function);
+    }
+    template <class R>
+    static shared_ptr<constant_medium> load_snapshot(R& r) {
+        double density_term = r.f64();
+        auto b = r.object_ref();
+        auto phase = r.material_ref();
+        if (!b) return nullptr;
+        auto medium = make_shared<constant_medium>(b, 1.0, color(0, 0, 0));
+        medium->neg_inv_density = density_term;
+        medium->phase_function = phase;
+        return medium;
+    }
+
   private:
     shared_ptr<hittable> boundary;
     double neg_inv_density;
     shared_ptr<material> phase_function;
+
+    //光线在ray_t内位于边界内部的一段。起点在边界内时从ray_t.min(且不早于0)开始
+    bool inside_span(const ray& r, const interval& ray_t, real& t_enter, real& t_exit) const {
+        //ray_t这一段碰不到包围盒时不必求边界
+        if (!boundary->bounding_box().hit(r, ray_t) || !boundary->hit_span(r, t_enter, t_exit))
+            return false;
+        t_enter = fmax(fmax(t_enter, ray_t.min), real(0));
+        t_exit = fmin(t_exit, ray_t.max);
+        return t_enter < t_exit;
+    }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,241 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include "rtweekend.h"
+#include <algorithm>
+
+//实现了由特征图引导的降噪滤波器。相机在每个像素记录第一个非镜面交点的反照率、着色法线和深度(沿路径到该点的距离)，
+//镜面反射和折射只把衰减乘进反照率，继续到下一个交点，玻璃后面的物体也有清楚的特征。
+//滤波器是à-trous小波：5x5的B3样条核，第i次迭代的采样间隔为2^i，几次迭代就能覆盖很大的范围。
+//颜色先除以反照率，只对光照滤波，纹理细节在最后乘回来；每个邻居的权重由法线、反照率、深度的差别和
+//光照差别相对于该像素噪声(样本方差)的大小决定，噪声大的像素模糊得多，已经收敛的像素几乎不变
+
+//一个样本在第一个非镜面交点处的特征。像素的特征是全部样本的平均值
+struct surface_features {
+    color  albedo{ 0.0,0.0,0.0 };
+    vec3   normal{ 0.0,0.0,0.0 };
+    double depth{ 0.0 };
+
+    void add(const surface_features& f) {
+        albedo += f.albedo;
+        normal += f.normal;
+        depth += f.depth;
+    }
+};
+
+//按行优先排列的特征图
+class feature_buffers {
+public:
+    vector<color>  albedo;
+    vector<vec3>   normal;
+    vector<double> depth;
+
+    bool empty() const { return albedo.empty(); }
+
+    void assign(size_t pixels) {
+        albedo.assign(pixels, color(0.0, 0.0, 0.0));
+        normal.assign(pixels, vec3(0.0, 0.0, 0.0));
+        depth.assign(pixels, 0.0);
+    }
+
+    void clear() {
+        albedo.clear();
+        normal.clear();
+        depth.clear();
+    }
+
+    //count个样本的特征之和，取平均后写入第index个像素
+    void set(size_t index, const surface_features& sum, int count) {
+        double scale = count > 0 ? 1.0 / count : 0.0;
+        albedo[index] = scale * sum.albedo;
+        normal[index] = scale * sum.normal;
+        depth[index] = scale * sum.depth;
+    }
+};
+
+class atrous_denoiser {
+public:
+    int    iterations{ 3 };        //迭代次数，覆盖的半径约为2^(iterations+1)个像素
+    double sigma_color{ 2.0 };     //光照差别以标准差为单位，越大越模糊
+    double sigma_normal{ 128.0 };  //法线夹角的余弦按此幂次衰减
+    double sigma_albedo{ 0.1 };
+    double sigma_depth{ 1.0 };     //深度差别以局部深度梯度乘以距离为单位
+    //孤立的亮点(比3x3邻域内其他像素都亮)先压到邻域的最大亮度，否则它们会在滤波后变成光斑
+    bool   clamp_fireflies{ true };
+
+    //image为每个像素的均值，variance为均值的方差(每个通道)，不知道方差时可以为空，此时只按特征引导
+    vector<color> apply(const vector<color>& image, const vector<color>& variance, const feature_buffers& features,
+        int width, int height) const {
+        const int pixels = width * height;
+        if (features.empty() || int(image.size()) != pixels || iterations <= 0) return image;
+        const bool has_variance = int(variance.size()) == pixels;
+
+        //反照率接近0的通道不除，乘回时也不乘
+        vector<color> modulation(pixels);
+        vector<color> current(pixels);
+        vector<double> current_variance(pixels, 0.0);
+        vector<guide> guides(pixels);
+#pragma omp parallel for schedule(static)
+        for (int j = 0; j < height; ++j) {
+            for (int i = 0; i < width; ++i) {
+                int p = j * width + i;
+                const color& a = features.albedo[p];
+                color m(a.x() > albedo_epsilon ? a.x() : 1.0, a.y() > albedo_epsilon ? a.y() : 1.0, a.z() > albedo_epsilon ? a.z() : 1.0);
+                color inverse(1.0 / m.x(), 1.0 / m.y(), 1.0 / m.z());
+                modulation[p] = m;
+                current[p] = image[p] * inverse;
+                if (has_variance) current_variance[p] = luminance(variance[p] * inverse * inverse);
+
+                guide& g = guides[p];
+                const vec3& n = features.normal[p];
+                g.normal = n.length_squared() > 0.0 ? normalize(n) : vec3(0.0, 0.0, 0.0);
+                g.albedo = a;
+                g.depth = features.depth[p];
+                //中心差分估计屏幕空间的深度梯度，斜看的平面上相邻像素的深度本来就相差较大
+                const double* row = &features.depth[j * width];
+                double dx = 0.5 * fabs(row[std::min(i + 1, width - 1)] - row[std::max(i - 1, 0)]);
+                double dy = 0.5 * fabs(features.depth[std::min(j + 1, height - 1) * width + i] - features.depth[std::max(j - 1, 0) * width + i]);
+                g.depth_scale = sigma_depth * std::max(std::max(dx, dy), 1e-3 * g.depth) + 1e-12;
+            }
+        }
+
+        vector<color> next(pixels);
+        if (clamp_fireflies) {
+            remove_fireflies(current, next, width, height);
+            current.swap(next);
+        }
+        vector<double> next_variance(pixels);
+        vector<double> blurred_variance(pixels);
+        for (int iteration = 0; iteration < iterations; ++iteration) {
+            const int step = 1 << iteration;
+            if (has_variance) blur_variance(current_variance, blurred_variance, width, height);
+#pragma omp parallel for schedule(static)
+            for (int j = 0; j < height; ++j) {
+                for (int i = 0; i < width; ++i) {
+                    filter_pixel(i, j, step, has_variance, current, current_variance, blurred_variance, guides,
+                        width, height, next, next_variance);
+                }
+            }
+            current.swap(next);
+            current_variance.swap(next_variance);
+        }
+
+        vector<color> result(pixels);
+#pragma omp parallel for schedule(static)
+        for (int p = 0; p < pixels; ++p) {
+            result[p] = current[p] * modulation[p];
+        }
+        return result;
+    }
+
+private:
+    static constexpr double albedo_epsilon = 1e-3;
+
+    //每个像素滤波时用到的特征，法线已经归一化(没有打到物体时为0)，深度的尺度已经乘上sigma_depth
+    struct guide {
+        vec3   normal;
+        color  albedo;
+        double depth;
+        double depth_scale;
+    };
+
+    //B3样条核的系数
+    static double kernel_weight(int k) {
+        static const double h[5] = { 1.0 / 16, 1.0 / 4, 3.0 / 8, 1.0 / 4, 1.0 / 16 };
+        return h[k + 2];
+    }
+
+    static void remove_fireflies(const vector<color>& in, vector<color>& out, int width, int height) {
+#pragma omp parallel for schedule(static)
+        for (int j = 0; j < height; ++j) {
+            for (int i = 0; i < width; ++i) {
+                int p = j * width + i;
+                double neighbor_max = 0.0;
+                for (int dy = -1; dy <= 1; ++dy) {
+                    int y = j + dy;
+                    if (y < 0 || y >= height) continue;
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        int x = i + dx;
+                        if (x < 0 || x >= width || (dx == 0 && dy == 0)) continue;
+                        neighbor_max = std::max(neighbor_max, luminance(in[y * width + x]));
+                    }
+                }
+                double l = luminance(in[p]);
+                out[p] = l > neighbor_max ? in[p] * (neighbor_max / l) : in[p];
+            }
+        }
+    }
+
+    //用3x3高斯核平滑方差，单个像素的方差估计本身很不稳定
+    static void blur_variance(const vector<double>& in, vector<double>& out, int width, int height) {
+        static const double g[3] = { 0.25, 0.5, 0.25 };
+#pragma omp parallel for schedule(static)
+        for (int j = 0; j < height; ++j) {
+            for (int i = 0; i < width; ++i) {
+                double sum = 0.0, weight = 0.0;
+                for (int dy = -1; dy <= 1; ++dy) {
+                    int y = j + dy;
+                    if (y < 0 || y >= height) continue;
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        int x = i + dx;
+                        if (x < 0 || x >= width) continue;
+                        double w = g[dx + 1] * g[dy + 1];
+                        sum += w * in[y * width + x];
+                        weight += w;
+                    }
+                }
+                out[j * width + i] = sum / weight;
+            }
+        }
+    }
+
+    //一次à-trous迭代中的一个像素。各项差别都放进同一个指数里，每个邻居只求一次exp。
+    //方差按权重的平方传播，下一次迭代的光照权重随噪声减小而收紧
+    void filter_pixel(int i, int j, int step, bool has_variance, const vector<color>& in, const vector<double>& in_variance,
+        const vector<double>& blurred_variance, const vector<guide>& guides, int width, int height,
+        vector<color>& out, vector<double>& out_variance) const {
+        const int p = j * width + i;
+        const guide& g_p = guides[p];
+        const bool has_normal = g_p.normal.length_squared() > 0.0;
+        const double l_p = luminance(in[p]);
+        const double inv_color = has_variance ? 1.0 / (sigma_color * sqrt(blurred_variance[p]) + 1e-6) : 0.0;
+        const double inv_albedo = 1.0 / (sigma_albedo * sigma_albedo);
+
+        color sum{ 0.0,0.0,0.0 };
+        double weight_sum = 0.0, variance_sum = 0.0;
+        for (int dy = -2; dy <= 2; ++dy) {
+            int y = j + dy * step;
+            if (y < 0 || y >= height) continue;
+            for (int dx = -2; dx <= 2; ++dx) {
+                int x = i + dx * step;
+                if (x < 0 || x >= width) continue;
+                int q = y * width + x;
+                double w = kernel_weight(dx) * kernel_weight(dy);
+                if (q != p) {
+                    //光线没有打到物体的像素法线为0，只与同样没有打到物体的像素混合
+                    const guide& g_q = guides[q];
+                    double exponent = 0.0;
+                    if (has_normal) {
+                        double cos_normal = dot(g_p.normal, g_q.normal);
+                        if (!(cos_normal > 0.0)) continue;
+                        exponent -= sigma_normal * log(cos_normal);
+                    }
+                    else if (g_q.normal.length_squared() > 0.0) continue;
+                    double distance = step * sqrt(double(dx * dx + dy * dy));
+                    exponent += (g_p.albedo - g_q.albedo).length_squared() * inv_albedo
+                        + fabs(g_p.depth - g_q.depth) / (g_p.depth_scale * distance)
+                        + fabs(l_p - luminance(in[q])) * inv_color;
+                    w *= exp(-exponent);
+                }
+                sum += w * in[q];
+                weight_sum += w;
+                if (has_variance) variance_sum += w * w * in_variance[q];
+            }
+        }
+        //中心像素的权重不为0，weight_sum总是正的
+        out[p] = sum / weight_sum;
+        out_variance[p] = has_variance ? variance_sum / (weight_sum * weight_sum) : 0.0;
+    }
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef FILE_REPLACE_H
+#define FILE_REPLACE_H
+
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//实现了整体替换文件：内容先写到同一目录下的临时文件，刷到磁盘后再改名覆盖目标文件。
+//进程被杀掉或者断电时旧文件仍然完整；改名不改动旧文件的内容，正在映射旧文件的读者(例如渲染中的场景快照)
+//继续看到原来的数据，不会因为文件被截断而收到SIGBUS
+
+//把文件内容写到磁盘上，ofstream关闭时只交给了操作系统的缓存
+inline bool sync_file(const std::string& path) {
+#if defined(_WIN32)
+    int fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+    if (fd < 0) return false;
+    bool synced = _commit(fd) == 0;
+    _close(fd);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+#endif
+    return synced;
+}
+
+//改名记录在目录里，目录也刷到磁盘后新文件名才不会在断电后丢失。Windows上没有对应的操作
+inline void sync_directory(const std::string& path) {
+#if !defined(_WIN32)
+    size_t slash = path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(directory.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    ::fsync(fd);
+    ::close(fd);
+#endif
+}
+
+//write把全部内容写入给出的流，流出错时不替换目标文件。失败时输出原因并返回false
+inline bool replace_file(const std::string& path, const std::function<void(std::ostream&)>& write) {
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        if (!out) {
+            std::cerr << "ERROR: Could not open output file '" << temporary << "'.\n";
+            return false;
+        }
+        write(out);
+        if (!out.flush()) {
+            std::cerr << "ERROR: Could not write '" << temporary << "'.\n";
+            return false;
+        }
+    }
+    if (!sync_file(temporary)) {
+        std::cerr << "ERROR: Could not flush '" << temporary << "' to disk.\n";
+        return false;
+    }
+#if defined(_WIN32)
+    std::remove(path.c_str());
+#endif
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::cerr << "ERROR: Could not rename '" << temporary << "' to '" << path << "'.\n";
+        return false;
+    }
+    sync_directory(path);
+    return true;
+}
+
+#endif
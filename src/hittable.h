@@ -3,20 +3,38 @@
 
 #include "rtweekend.h"
 #include "aabb.h"
+#include "affine.h"
+#include "ray_packet.h"
+#include <unordered_set>
+#include <utility>
 //实现hit_record类以及hittable虚拟基类,新增了材质类
 
 class material;
 
+//场景中各棵bvh的节点数和SAH代价之和，用于比较不同的构建方法。被多个实例引用的树只计一次
+struct bvh_stats {
+    size_t nodes{ 0 };
+    double sah_cost{ 0.0 };
+    std::unordered_set<const void*> seen;
+
+    //第一次遇到tree时返回true
+    bool first_visit(const void* tree) { return seen.insert(tree).second; }
+};
+
 //需要存储交点，法线方向，交点的根t
 class hit_record {
 public:
     point3 p;
     vec3 normal;
-    shared_ptr<material> mat;
-    double t;
+    const material* mat;  //不持有材质，材质的生命周期由物体上的shared_ptr保证
+    real t;
     //纹理坐标
-    double u;
-    double v;
+    real u;
+    real v;
+    //纹理过滤用：uv_density是交点附近单位世界长度对应的纹理坐标变化，由物体填写，0表示不过滤；
+    //cone_width是光锥在交点处截面的宽度，由相机在着色前填写
+    real uv_density;
+    real cone_width;
     //额外需要一个布尔量记录正反面，一个成员函数根据光线在内部或者外部决定法向量朝内还是外。假设外部计算的outside_normal都是单位化的
     bool front_face;
 
@@ -24,123 +42,230 @@ public:
         front_face = (dot(r.direction(), outward_normal) < 0);
         normal = (front_face ? outward_normal : -outward_normal);
     }
+
+    //光锥在交点处覆盖的纹理坐标范围，纹理据此选择mip层级
+    double uv_footprint() const { return double(cone_width) * uv_density; }
 };
 
-//需要虚拟的析构函数，虚拟的求解相交的hit函数
+//需要虚拟的析构函数，虚拟的求解相交的hit函数。hit只在返回true时修改rec
 class hittable {
 public:
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
+    //遮挡查询：ray_t内是否有任何交点。找到一个交点即可返回，不需要最近的交点，也不填写法线、uv和材质。
+    //阴影光线只需要这个结果，默认实现退回hit
+    virtual bool occluded(const ray& r, interval ray_t) const {
+        hit_record rec;
+        return hit(r, ray_t, rec);
+    }
+    //阴影光线在ray_t内穿过物体后剩下的能量比例。不透明的物体有交点时为0，否则为1；介质返回透射率(或它的无偏估计)
+    virtual double transmittance(const ray& r, interval ray_t) const {
+        return occluded(r, ray_t) ? 0.0 : 1.0;
+    }
+    //光线进入和离开物体时的参数，介质用它求出边界内的区间。默认用两次hit求出，起点在物体内部时t_enter为负
+    virtual bool hit_span(const ray& r, real& t_enter, real& t_exit) const {
+        hit_record rec1, rec2;
+        if (!hit(r, interval::universe, rec1)) return false;
+        if (!hit(r, interval(rec1.t + real(0.0001), infinity), rec2)) return false;
+        t_enter = rec1.t;
+        t_exit = rec2.t;
+        return true;
+    }
     virtual ~hittable() = default;
     virtual aabb bounding_box() const = 0;
+    //物体在时间0和1的包围盒：时间t时物体位于两者按t线性插值的包围盒内。运动bvh用它求出随时间变化的节点包围盒，
+    //静止的物体两者都是bounding_box()
+    virtual void motion_bounds(aabb& start, aabb& end) const {
+        start = end = bounding_box();
+    }
     virtual double pdf_value(const point3& origin, const vec3& direction) const {
         return 0.0;
     }
     virtual vec3 random(const point3& origin) const {
         return vec3(1.0, 0.0, 0.0);
     }
+
+    //光源采样用：物体自身作为一个光源时向外辐射的功率(辐亮度的亮度乘以面积和pi)。不发光、
+    //或者无法用pdf_value和random采样的物体为0
+    virtual double emitted_power() const {
+        return 0.0;
+    }
+    //在物体表面上为origin处的着色点采样一个点，写入该点的交点记录(法线朝向origin一侧时front_face为真，可以直接求自发光)
+    //和该点在origin处立体角上的概率密度，与pdf_value一致。只有能作为光源的物体实现，默认返回false
+    virtual bool sample_light(const point3& origin, hit_record& rec, double& pdf) const {
+        return false;
+    }
+    //把内部可以作为光源采样的物体加入out。容器类型逐个调用collect_emitter，图元什么都不做
+    virtual void collect_emitters(vector<shared_ptr<hittable>>& out) const {}
+
+    static void collect_emitter(const shared_ptr<hittable>& object, vector<shared_ptr<hittable>>& out) {
+        if (object->emitted_power() > 0.0) out.push_back(object);
+        else object->collect_emitters(out);
+    }
+
+    //把内部各棵bvh的统计累加到stats上。容器类型转交给子物体，图元什么都不做
+    virtual void accumulate_bvh_stats(bvh_stats& stats) const {}
+
+    //光线包求交：对active中的每条光线k求(t_min, t_max[k])内最近的交点，命中时写入recs[k]并把t_max[k]缩小为交点的t，
+    //返回命中光线的掩码。默认实现逐条光线调用hit，调用前切换到该光线的随机数状态
+    virtual uint32_t hit_packet(ray_packet& packet, uint32_t active, real t_min, real t_max[], hit_record recs[]) const {
+        uint32_t hits = 0;
+        for_each_lane(active, [&](int k) {
+            std::swap(thread_rng(), packet.rng[k]);
+            if (hit(packet.rays[k], interval(t_min, t_max[k]), recs[k])) {
+                hits |= 1u << k;
+                t_max[k] = recs[k].t;
+            }
+            std::swap(thread_rng(), packet.rng[k]);
+        });
+        return hits;
+    }
 };
 
-//实现物体的平移，用坐标变换实现，先将光线从世界坐标变到物体坐标，再将交点变回世界坐标
-class translate : public hittable {
-private:
+//实现物体的实例：一个被共享的物体(通常是建好的bvh或网格)加上一个仿射变换。求交时先检测世界坐标下的包围盒，
+//再把光线变换到物体坐标系(方向不单位化，t保持不变)，交点和法线再变换回世界坐标系。
+//同一个物体可以被任意多个实例引用，把实例放进bvh_node就得到两层的加速结构，底层结构只构建和保存一次。
+//实例套实例时直接复合两个矩阵，不会形成多层的虚函数调用
+class instance : public hittable {
+protected:
     shared_ptr<hittable> object;
-    vec3 offset;
+    affine to_world;
+    affine to_object;
     aabb bbox;
+    real uv_scale;  //变换对长度的平均缩放的倒数，用于换算交点的uv_density
+
+    ray to_object_ray(const ray& r) const {
+        return ray(to_object.point(r.origin()), to_object.vector(r.direction()), r.time());
+    }
+
+    void to_world_record(hit_record& rec) const {
+        rec.p = to_world.point(rec.p);
+        //法线用逆转置变换，点积的符号不变，front_face仍然有效
+        rec.normal = normalize(to_object.transpose_vector(rec.normal));
+        rec.uv_density *= uv_scale;
+    }
 
 public:
-    translate(shared_ptr<hittable> o, const vec3& off) :object{ o }, offset{ off } {
-        bbox = o->bounding_box() + offset;
+    instance(shared_ptr<hittable> o, const affine& transform) :object{ o }, to_world{ transform } {
+        auto inner = std::dynamic_pointer_cast<instance>(o);
+        if (inner) {
+            object = inner->object;
+            to_world = transform * inner->to_world;
+        }
+        to_object = to_world.inverse();
+        bbox = to_world.bounds(object->bounding_box());
+        uv_scale = real(1.0 / std::cbrt(std::fabs(to_world.determinant())));
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        ray r_offset{ r.origin() - offset,r.direction(),r.time() };
-        if (!object->hit(r_offset, ray_t, rec)) {
-            return false;
-        }
-        rec.p += offset;
+        if (!bbox.hit(r, ray_t)) return false;
+        if (!object->hit(to_object_ray(r), ray_t, rec)) return false;
+        to_world_record(rec);
         return true;
     }
 
-    aabb bounding_box() const override {
-        return bbox;
+    bool occluded(const ray& r, interval ray_t) const override {
+        return bbox.hit(r, ray_t) && object->occluded(to_object_ray(r), ray_t);
     }
-};
 
-class rotate_y : public hittable {
-private:
-    shared_ptr<hittable> object;
-    double sin_theta;
-    double cos_theta;
-    aabb bbox;
+    double transmittance(const ray& r, interval ray_t) const override {
+        if (!bbox.hit(r, ray_t)) return 1.0;
+        return object->transmittance(to_object_ray(r), ray_t);
+    }
 
-public:
-    rotate_y(shared_ptr<hittable> o, double angle) :object{ o } {
-        double radians = degree_to_radian(angle);
-        sin_theta = sin(radians);
-        cos_theta = cos(radians);
-        bbox = object->bounding_box();
-        point3 min(infinity, infinity, infinity);
-        point3 max(-infinity, -infinity, -infinity);
-
-        for (int i = 0; i < 2; i++) {
-            for (int j = 0; j < 2; j++) {
-                for (int k = 0; k < 2; k++) {
-                    auto x = i * bbox.x.max + (1 - i) * bbox.x.min;
-                    auto y = j * bbox.y.max + (1 - j) * bbox.y.min;
-                    auto z = k * bbox.z.max + (1 - k) * bbox.z.min;
-
-                    auto newx = cos_theta * x + sin_theta * z;
-                    auto newz = -sin_theta * x + cos_theta * z;
-
-                    vec3 tester(newx, y, newz);
-
-                    for (int c = 0; c < 3; c++) {
-                        min[c] = fmin(min[c], tester[c]);
-                        max[c] = fmax(max[c], tester[c]);
-                    }
-                }
-            }
-        }
+    bool hit_span(const ray& r, real& t_enter, real& t_exit) const override {
+        return bbox.hit(r, interval::universe) && object->hit_span(to_object_ray(r), t_enter, t_exit);
+    }
 
-        bbox = aabb(min, max);
+    //仿射变换把盒的各个角点线性地搬到新位置，变换后的两个包围盒之间的插值仍然覆盖物体
+    void motion_bounds(aabb& start, aabb& end) const override {
+        object->motion_bounds(start, end);
+        start = to_world.bounds(start);
+        end = to_world.bounds(end);
     }
 
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        // Change the ray from world space to object space
-        auto origin = r.origin();
-        auto direction = r.direction();
+    //把整个光线包变换到物体坐标系后交给内部物体，内部物体仍然可以按光线包求交
+    uint32_t hit_packet(ray_packet& packet, uint32_t active, real t_min, real t_max[], hit_record recs[]) const override {
+        uint32_t inside = 0;
+        for_each_lane(active, [&](int k) {
+            if (bbox.hit(packet.rays[k], interval(t_min, t_max[k]))) inside |= 1u << k;
+        });
+        if (inside == 0) return 0;
 
-        origin[0] = cos_theta * r.origin()[0] - sin_theta * r.origin()[2];
-        origin[2] = sin_theta * r.origin()[0] + cos_theta * r.origin()[2];
+        ray_packet local = packet;
+        for_each_lane(inside, [&](int k) { local.set(k, to_object_ray(packet.rays[k])); });
+        uint32_t hits = object->hit_packet(local, inside, t_min, t_max, recs);
+        for_each_lane(inside, [&](int k) { packet.rng[k] = local.rng[k]; });
+        for_each_lane(hits, [&](int k) { to_world_record(recs[k]); });
+        return hits;
+    }
 
-        direction[0] = cos_theta * r.direction()[0] - sin_theta * r.direction()[2];
-        direction[2] = sin_theta * r.direction()[0] + cos_theta * r.direction()[2];
+    aabb bounding_box() const override {
+        return bbox;
+    }
 
-        ray rotated_r(origin, direction, r.time());
+    //只保存到世界的变换，逆矩阵和包围盒由构造函数重新求出
+    template <class W>
+    void save_snapshot(W& w) const {
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j) w.f64(to_world.m[i][j]);
+        w.ref(object);
+    }
+    template <class R>
+    static shared_ptr<instance> load_snapshot(R& r) {
+        affine transform;
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j) transform.m[i][j] = r.f64();
+        auto o = r.object_ref();
+        if (!o) return nullptr;
+        return make_shared<instance>(o, transform);
+    }
 
-        // Determine whether an intersection exists in object space (and if so, where)
-        if (!object->hit(rotated_r, ray_t, rec))
-            return false;
+    //面积按变换对长度的平均缩放换算，非均匀缩放时只是估计
+    double emitted_power() const override {
+        return object->emitted_power() / (double(uv_scale) * uv_scale);
+    }
 
-        // Change the intersection point from object space to world space
-        auto p = rec.p;
-        p[0] = cos_theta * rec.p[0] + sin_theta * rec.p[2];
-        p[2] = -sin_theta * rec.p[0] + cos_theta * rec.p[2];
+    //内部的光源各自套上同样的变换，成为世界坐标系中的光源
+    void collect_emitters(vector<shared_ptr<hittable>>& out) const override {
+        vector<shared_ptr<hittable>> inner;
+        object->collect_emitters(inner);
+        for (const shared_ptr<hittable>& light : inner) {
+            out.push_back(make_shared<instance>(light, to_world));
+        }
+    }
 
-        // Change the normal from object space to world space
-        auto normal = rec.normal;
-        normal[0] = cos_theta * rec.normal[0] + sin_theta * rec.normal[2];
-        normal[2] = -sin_theta * rec.normal[0] + cos_theta * rec.normal[2];
+    void accumulate_bvh_stats(bvh_stats& stats) const override {
+        object->accumulate_bvh_stats(stats);
+    }
 
-        rec.p = p;
-        rec.normal = normal;
+    //相似变换(旋转、平移、均匀缩放)保持角度，立体角上的概率密度在两个坐标系中相同；非均匀缩放时只是近似
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        return object->pdf_value(to_object.point(origin), to_object.vector(direction));
+    }
 
-        return true;
+    vec3 random(const point3& origin) const override {
+        return to_world.vector(object->random(to_object.point(origin)));
     }
 
-    aabb bounding_box() const override {
-        return bbox;
+    bool sample_light(const point3& origin, hit_record& rec, double& pdf) const override {
+        if (!object->sample_light(to_object.point(origin), rec, pdf)) return false;
+        to_world_record(rec);
+        return true;
     }
+
+    const affine& transform() const { return to_world; }
+};
+
+//物体的平移
+class translate : public instance {
+public:
+    translate(shared_ptr<hittable> o, const vec3& offset) :instance(o, affine::translation(offset)) {}
+};
+
+//物体绕y轴的旋转，angle为角度
+class rotate_y : public instance {
+public:
+    rotate_y(shared_ptr<hittable> o, double angle) :instance(o, affine::rotation(vec3(0, 1, 0), angle)) {}
 };
 
 #endif
\ No newline at end of file
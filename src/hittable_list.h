@@ -23,20 +23,55 @@ public:
     }
     
     //还需要一个hit成员函数,遍历所有物体，记录最近处交点的hit_record
+    //物体只在命中时修改记录，因此可以直接写入rec，不需要临时记录和拷贝
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override{
-        hit_record rec_temp;
-        double close_so_far{ ray_t.max };
+        real close_so_far{ ray_t.max };
         bool hit_anything = false;
         for (const shared_ptr<hittable>& object : objects) {
-            if (object->hit(r, interval(ray_t.min,close_so_far), rec_temp)) {
+            if (object->hit(r, interval(ray_t.min,close_so_far), rec)) {
                 hit_anything = true;
-                close_so_far = rec_temp.t;
-                rec = rec_temp;
+                close_so_far = rec.t;
             }
         }        
         return hit_anything;
     }
 
+    bool occluded(const ray& r, interval ray_t) const override {
+        for (const shared_ptr<hittable>& object : objects) {
+            if (object->occluded(r, ray_t)) return true;
+        }
+        return false;
+    }
+
+    void motion_bounds(aabb& start, aabb& end) const override {
+        start = end = aabb::empty;
+        for (const shared_ptr<hittable>& object : objects) {
+            aabb object_start, object_end;
+            object->motion_bounds(object_start, object_end);
+            start = aabb(start, object_start);
+            end = aabb(end, object_end);
+        }
+    }
+
+    //各物体的透射率相乘，遇到不透明的物体即可返回
+    double transmittance(const ray& r, interval ray_t) const override {
+        double result = 1.0;
+        for (const shared_ptr<hittable>& object : objects) {
+            result *= object->transmittance(r, ray_t);
+            if (result <= 0.0) return 0.0;
+        }
+        return result;
+    }
+
+    //每个物体命中后都会缩小对应光线的t_max，与单光线版本一样保留最近的交点
+    uint32_t hit_packet(ray_packet& packet, uint32_t active, real t_min, real t_max[], hit_record recs[]) const override {
+        uint32_t hits = 0;
+        for (const shared_ptr<hittable>& object : objects) {
+            hits |= object->hit_packet(packet, active, t_min, t_max, recs);
+        }
+        return hits;
+    }
+
     aabb bounding_box() const override {
         return bbox;
     }
@@ -55,6 +90,16 @@ public:
         auto int_size = int(objects.size());
         return objects[random_int(0, int_size-1)]->random(origin);
     }
+
+    void collect_emitters(vector<shared_ptr<hittable>>& out) const override {
+        for (const auto& object : objects)
+            collect_emitter(object, out);
+    }
+
+    void accumulate_bvh_stats(bvh_stats& stats) const override {
+        for (const auto& object : objects)
+            object->accumulate_bvh_stats(stats);
+    }
 };
 
 #endif
\ No newline at end of file
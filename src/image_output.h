@@ -0,0 +1,297 @@
+#ifndef IMAGE_OUTPUT_H
+#define IMAGE_OUTPUT_H
+
+#include "rtweekend.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#ifdef ZRT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+//实现了图像输出子系统。编码器把线性颜色的framebuffer编码为字节流，按输出文件的扩展名选择：
+//.ppm二进制P6，.pfm浮点PFM，.png 8位PNG，.hdr为Radiance RGBE线性HDR；16位PNG需显式指定png_encoder(16)。
+//gamma校正和量化用查表完成并按行并行，编码结果先写入内存缓冲，最后一次性写出
+
+//把线性分量量化为levels级gamma校正后的整数。量化结果与原writecolor一致：
+//int(k * clamp(sqrt(x), 0, 0.999))，k = levels - 1 + 0.999。表中保存每一级的线性阈值，二分查找即可
+class quantize_table {
+private:
+    vector<float> thresholds;  //thresholds[b]是量化为b+1所需的最小线性值
+
+public:
+    explicit quantize_table(int levels) {
+        double k = levels - 1 + 0.999;
+        thresholds.resize(levels - 1);
+        for (int b = 1; b < levels; ++b) {
+            double g = b / k;
+            thresholds[b - 1] = float(g * g);
+        }
+    }
+
+    int operator() (double linear) const {
+        //NaN和负值都输出0
+        if (!(linear > 0.0)) return 0;
+        return int(std::upper_bound(thresholds.begin(), thresholds.end(), float(linear)) - thresholds.begin());
+    }
+};
+
+inline const quantize_table& quantize8() {
+    static const quantize_table table(256);
+    return table;
+}
+
+inline const quantize_table& quantize16() {
+    static const quantize_table table(65536);
+    return table;
+}
+
+//编码器接口：把width*height个按行优先排列的线性颜色编码后追加到out
+class image_encoder {
+public:
+    virtual void encode(const vector<color>& pixels, int width, int height, std::string& out) const = 0;
+    virtual ~image_encoder() = default;
+};
+
+//二进制PPM(P6)，8位gamma校正
+class ppm_encoder : public image_encoder {
+public:
+    void encode(const vector<color>& pixels, int width, int height, std::string& out) const override {
+        std::string header = "P6\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n255\n";
+        size_t base = out.size();
+        out.append(header);
+        out.resize(base + header.size() + size_t(width) * height * 3);
+        unsigned char* data = reinterpret_cast<unsigned char*>(&out[base + header.size()]);
+        const quantize_table& q = quantize8();
+
+#pragma omp parallel for schedule(static)
+        for (int j = 0; j < height; ++j) {
+            for (int i = 0; i < width; ++i) {
+                const color& c = pixels[j * width + i];
+                unsigned char* p = data + (size_t(j) * width + i) * 3;
+                p[0] = (unsigned char)q(c.x());
+                p[1] = (unsigned char)q(c.y());
+                p[2] = (unsigned char)q(c.z());
+            }
+        }
+    }
+};
+
+//PFM浮点图像，线性值不做gamma校正。比例因子为负表示小端，行从下往上存放
+class pfm_encoder : public image_encoder {
+public:
+    void encode(const vector<color>& pixels, int width, int height, std::string& out) const override {
+        std::string header = "PF\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n-1.0\n";
+        size_t base = out.size();
+        out.append(header);
+        out.resize(base + header.size() + size_t(width) * height * 3 * sizeof(float));
+        char* data = &out[base + header.size()];
+
+#pragma omp parallel for schedule(static)
+        for (int j = 0; j < height; ++j) {
+            char* row = data + size_t(height - 1 - j) * width * 3 * sizeof(float);
+            for (int i = 0; i < width; ++i) {
+                const color& c = pixels[j * width + i];
+                float rgb[3] = { float(c.x()), float(c.y()), float(c.z()) };
+                for (int k = 0; k < 3; ++k) put_le32(row + (i * 3 + k) * 4, rgb[k]);
+            }
+        }
+    }
+
+private:
+    static void put_le32(char* p, float f) {
+        uint32_t u;
+        std::memcpy(&u, &f, 4);
+        p[0] = char(u & 0xff);
+        p[1] = char((u >> 8) & 0xff);
+        p[2] = char((u >> 16) & 0xff);
+        p[3] = char((u >> 24) & 0xff);
+    }
+};
+
+//Radiance RGBE(.hdr)线性HDR图像，不做行程压缩
+class hdr_encoder : public image_encoder {
+public:
+    void encode(const vector<color>& pixels, int width, int height, std::string& out) const override {
+        std::string header = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " + std::to_string(height) + " +X " + std::to_string(width) + "\n";
+        size_t base = out.size();
+        out.append(header);
+        out.resize(base + header.size() + size_t(width) * height * 4);
+        unsigned char* data = reinterpret_cast<unsigned char*>(&out[base + header.size()]);
+
+#pragma omp parallel for schedule(static)
+        for (int j = 0; j < height; ++j) {
+            for (int i = 0; i < width; ++i) {
+                const color& c = pixels[j * width + i];
+                unsigned char* p = data + (size_t(j) * width + i) * 4;
+                double r = c.x() > 0 ? c.x() : 0.0;
+                double g = c.y() > 0 ? c.y() : 0.0;
+                double b = c.z() > 0 ? c.z() : 0.0;
+                double m = std::max(r, std::max(g, b));
+                if (!(m > 1e-32) || m != m) {
+                    p[0] = p[1] = p[2] = p[3] = 0;
+                    continue;
+                }
+                int e;
+                double scale = std::frexp(m, &e) * 256.0 / m;
+                p[0] = (unsigned char)(r * scale);
+                p[1] = (unsigned char)(g * scale);
+                p[2] = (unsigned char)(b * scale);
+                p[3] = (unsigned char)(e + 128);
+            }
+        }
+    }
+};
+
+//PNG，8位或16位gamma校正RGB。有zlib时压缩，否则写不压缩的deflate存储块
+class png_encoder : public image_encoder {
+private:
+    int bit_depth;
+
+public:
+    explicit png_encoder(int bits = 8) :bit_depth{ bits == 16 ? 16 : 8 } {}
+
+    void encode(const vector<color>& pixels, int width, int height, std::string& out) const override {
+        //每行前面有一个滤波类型字节(0，不滤波)
+        size_t bytes_per_pixel = bit_depth / 8 * 3;
+        size_t row_bytes = 1 + width * bytes_per_pixel;
+        std::string raw(row_bytes * height, '\0');
+        const quantize_table& q = bit_depth == 16 ? quantize16() : quantize8();
+
+#pragma omp parallel for schedule(static)
+        for (int j = 0; j < height; ++j) {
+            unsigned char* row = reinterpret_cast<unsigned char*>(&raw[j * row_bytes]);
+            row[0] = 0;
+            unsigned char* p = row + 1;
+            for (int i = 0; i < width; ++i) {
+                const color& c = pixels[j * width + i];
+                for (int k = 0; k < 3; ++k) {
+                    int v = q(c[k]);
+                    if (bit_depth == 16) {
+                        *p++ = (unsigned char)(v >> 8);
+                        *p++ = (unsigned char)(v & 0xff);
+                    }
+                    else {
+                        *p++ = (unsigned char)v;
+                    }
+                }
+            }
+        }
+
+        static const char signature[8] = { '\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n' };
+        out.append(signature, 8);
+
+        std::string ihdr;
+        put_be32(ihdr, uint32_t(width));
+        put_be32(ihdr, uint32_t(height));
+        ihdr.push_back(char(bit_depth));
+        ihdr.push_back(2);  //真彩色RGB
+        ihdr.push_back(0);  //压缩方法
+        ihdr.push_back(0);  //滤波方法
+        ihdr.push_back(0);  //不隔行
+        put_chunk(out, "IHDR", ihdr);
+        put_chunk(out, "IDAT", deflate(raw));
+        put_chunk(out, "IEND", std::string());
+    }
+
+private:
+    static void put_be32(std::string& out, uint32_t v) {
+        out.push_back(char((v >> 24) & 0xff));
+        out.push_back(char((v >> 16) & 0xff));
+        out.push_back(char((v >> 8) & 0xff));
+        out.push_back(char(v & 0xff));
+    }
+
+    static uint32_t crc32(const std::string& data) {
+        static const vector<uint32_t> table = [] {
+            vector<uint32_t> t(256);
+            for (uint32_t n = 0; n < 256; ++n) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                t[n] = c;
+            }
+            return t;
+        }();
+        uint32_t crc = 0xffffffffu;
+        for (unsigned char b : data) crc = table[(crc ^ b) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    static void put_chunk(std::string& out, const char* type, const std::string& data) {
+        put_be32(out, uint32_t(data.size()));
+        std::string body(type, 4);
+        body += data;
+        out += body;
+        put_be32(out, crc32(body));
+    }
+
+    static std::string deflate(const std::string& raw) {
+#ifdef ZRT_HAVE_ZLIB
+        uLongf size = compressBound(uLong(raw.size()));
+        std::string compressed(size, '\0');
+        if (compress2(reinterpret_cast<Bytef*>(&compressed[0]), &size, reinterpret_cast<const Bytef*>(raw.data()), uLong(raw.size()), 6) == Z_OK) {
+            compressed.resize(size);
+            return compressed;
+        }
+#endif
+        //zlib头 + 每块最多65535字节的存储块 + adler32校验
+        std::string z;
+        z.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+        z.push_back(char(0x78));
+        z.push_back(char(0x01));
+        size_t pos = 0;
+        do {
+            size_t len = std::min<size_t>(65535, raw.size() - pos);
+            bool last = pos + len == raw.size();
+            z.push_back(char(last ? 1 : 0));
+            z.push_back(char(len & 0xff));
+            z.push_back(char((len >> 8) & 0xff));
+            z.push_back(char(~len & 0xff));
+            z.push_back(char((~len >> 8) & 0xff));
+            z.append(raw, pos, len);
+            pos += len;
+        } while (pos < raw.size());
+
+        uint32_t a = 1, b = 0;
+        for (unsigned char c : raw) {
+            a = (a + c) % 65521;
+            b = (b + a) % 65521;
+        }
+        put_be32(z, (b << 16) | a);
+        return z;
+    }
+};
+
+//按扩展名选择编码器，无法识别的扩展名(包括标准输出"-")使用二进制PPM
+inline shared_ptr<image_encoder> encoder_for_path(const std::string& path) {
+    if (ends_with(path, ".pfm")) return make_shared<pfm_encoder>();
+    if (ends_with(path, ".hdr")) return make_shared<hdr_encoder>();
+    if (ends_with(path, ".png")) return make_shared<png_encoder>(8);
+    return make_shared<ppm_encoder>();
+}
+
+//编码并写出图像，encoder为空时按扩展名选择。path为"-"时写到标准输出
+inline bool write_image(const std::string& path, const vector<color>& pixels, int width, int height,
+    shared_ptr<image_encoder> encoder = nullptr) {
+    if (!encoder) encoder = encoder_for_path(path);
+    std::string bytes;
+    encoder->encode(pixels, width, height, bytes);
+
+    if (path == "-") {
+        std::cout.write(bytes.data(), bytes.size());
+        std::cout.flush();
+        return bool(std::cout);
+    }
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "ERROR: Could not open output file '" << path << "'.\n";
+        return false;
+    }
+    out.write(bytes.data(), bytes.size());
+    return bool(out);
+}
+
+#endif
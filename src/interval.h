@@ -7,34 +7,34 @@
 class interval
 {
 public:
-    double min;
-    double max;
+    real min;
+    real max;
 
-    interval() :min{ infinity }, max{ -infinity } {};
-    interval(double a, double b) :min{ a }, max{ b } {};
+    interval() :min{ real(infinity) }, max{ real(-infinity) } {};
+    interval(real a, real b) :min{ a }, max{ b } {};
     interval(const interval& a, const interval& b) {
         min = a.min <= b.min ? a.min : b.min;
         max = a.max >= b.max ? a.max : b.max;
     }
 
-    double size() const { return max - min; }
+    real size() const { return max - min; }
 
-    bool contains(double x) const {
+    bool contains(real x) const {
         return x >= min && x <= max;
     }
 
-    bool surrounds(double x) const {
+    bool surrounds(real x) const {
         return x > min && x < max;
     }
 
-    double clamp(double x) const {
+    real clamp(real x) const {
         if (x < min)return min;
         if (x > max)return max;
         return x;
     }
 
-    interval expand(double delta) const {
-        double padding = delta / 2.0;
+    interval expand(real delta) const {
+        real padding = delta / 2.0;
         return interval(min - padding, max + padding);
     }
 
@@ -44,11 +44,11 @@ public:
 const interval interval::universe = interval(-infinity, infinity);
 const interval interval::empty = interval(infinity, -infinity);
 
-interval operator+ (const interval& p, double d) {
+interval operator+ (const interval& p, real d) {
     return interval(p.min + d, p.max + d);
 }
 
-interval operator+ (double d, const interval& p) {
+interval operator+ (real d, const interval& p) {
     return p + d;
 }
 
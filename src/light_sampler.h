@@ -0,0 +1,248 @@
+#ifndef LIGHT_SAMPLER_H
+#define LIGHT_SAMPLER_H
+
+#include "rtweekend.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "bvh.h"
+#include <algorithm>
+
+//实现了光源采样器，作为hittable_pdf的采样目标。光源从场景中自动收集：材质发光的静止球和四边形，包括实例内部的。
+//选择光源有两种方式：按功率建立的别名表，O(1)选出一个光源，与着色点无关；或者从光源bvh的根向下，
+//每个内部节点按两个孩子的功率除以到着色点距离的平方选择，近处的亮光源被选中的概率更高。
+//pdf_value只需要考虑沿该方向的光线穿过的光源，同一棵bvh找出这些光源，代价不再随光源总数线性增长。
+//相机的次事件估计用sample_light直接在光源上取点，用hit_pdf给按材质采样命中光源的路径求多重重要性采样的权重
+
+class light_sampler : public hittable {
+public:
+    enum selection { select_power, select_spatial };
+
+    light_sampler() = default;
+
+    //world中的全部发光物体再加上extra中的物体。extra可以包含不发光的重要性采样目标(例如玻璃球)，
+    //它们按发光物体的平均功率参与选择，全都不发光时每个物体的权重相同
+    explicit light_sampler(const hittable& world, const hittable_list& extra = hittable_list(),
+        selection select = select_spatial) :mode{ select } {
+        vector<shared_ptr<hittable>> found;
+        world.collect_emitters(found);
+        found.insert(found.end(), extra.objects.begin(), extra.objects.end());
+        build(found);
+    }
+
+    size_t size() const { return lights.size(); }
+    bool empty() const { return lights.empty(); }
+    selection selection_mode() const { return mode; }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return tree.traverse(r, ray_t, [&](int index, interval& t) {
+            if (!lights[index]->hit(r, t, rec)) return false;
+            t.max = rec.t;
+            return true;
+        });
+    }
+
+    aabb bounding_box() const override {
+        return tree.bounding_box();
+    }
+
+    //在origin处选中第index个光源的概率
+    double selection_probability(const point3& origin, int index) const {
+        if (mode == select_power) return power[index] / total_power;
+        double probability = 1.0;
+        for (int n = leaf[index]; n != 0; n = parent[n]) {
+            int up = parent[n];
+            double left = left_probability(up, origin);
+            probability *= (n == up + 1) ? left : 1.0 - left;
+        }
+        return probability;
+    }
+
+    //方向上穿过的每个光源按选中概率加权。光线不缩短，bvh会访问所有包围盒与之相交的叶子
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        if (lights.empty()) return 0.0;
+        double sum = 0.0;
+        tree.traverse(ray(origin, direction), interval(0.001, infinity), [&](int index, interval&) {
+            double p = lights[index]->pdf_value(origin, direction);
+            if (p > 0.0) sum += selection_probability(origin, index) * p;
+            return false;
+        });
+        return sum;
+    }
+
+    vec3 random(const point3& origin) const override {
+        if (lights.empty()) return vec3(1.0, 0.0, 0.0);
+        double probability;
+        return lights[sample_index(origin, random_double(), probability)]->random(origin);
+    }
+
+    //先选光源再在光源上取点，pdf包含选中该光源的概率
+    bool sample_light(const point3& origin, hit_record& rec, double& pdf) const override {
+        if (lights.empty()) return false;
+        double probability;
+        int index = sample_index(origin, random_double(), probability);
+        if (!lights[index]->sample_light(origin, rec, pdf)) return false;
+        pdf *= probability;
+        return true;
+    }
+
+    //沿光线r第一个碰到的光源在t_max以内时(与场景求出的交点是同一个表面)，返回sample_light在r的起点采样到该点的概率密度，
+    //否则为0。多重重要性采样用它给按材质采样命中光源的路径加权
+    double hit_pdf(const ray& r, real t_max) const {
+        if (lights.empty()) return 0.0;
+        int nearest = -1;
+        hit_record rec;
+        tree.traverse(r, interval(0.001, t_max * (1 + 1e-4) + 1e-4), [&](int index, interval& t) {
+            if (!lights[index]->hit(r, t, rec)) return false;
+            t.max = rec.t;
+            nearest = index;
+            return true;
+        });
+        if (nearest < 0) return 0.0;
+        return selection_probability(r.origin(), nearest) * lights[nearest]->pdf_value(r.origin(), r.direction());
+    }
+
+private:
+    selection mode{ select_spatial };
+    vector<shared_ptr<hittable>> lights;  //按bvh的叶子顺序存放，第i个光源在offset为i的叶子中
+    vector<double> power;                 //选择用的权重
+    double total_power{ 0.0 };
+    //别名表：u落入第k格后，以alias_probability[k]的概率选k，否则选alias[k]
+    vector<double> alias_probability;
+    vector<int> alias;
+    //光源bvh，每个叶子恰好一个光源。节点上记录子树的总功率、包围盒中心和半对角线长的平方
+    bvh_tree tree;
+    vector<double> node_power;
+    vector<point3> node_center;
+    vector<double> node_radius2;
+    vector<int> parent;
+    vector<int> leaf;
+
+    void build(const vector<shared_ptr<hittable>>& found) {
+        size_t n = found.size();
+        if (n == 0) return;
+        vector<aabb> boxes(n);
+        vector<double> raw(n);
+        double emitting = 0.0;
+        int emitting_count = 0;
+        for (size_t i = 0; i < n; ++i) {
+            boxes[i] = found[i]->bounding_box();
+            raw[i] = found[i]->emitted_power();
+            if (raw[i] > 0.0) {
+                emitting += raw[i];
+                ++emitting_count;
+            }
+        }
+        double fallback = emitting_count > 0 ? emitting / emitting_count : 1.0;
+
+        //中位数划分到每个叶子一个光源，选择和求概率时不必再在叶子内部挑选
+        bvh_build_options options;
+        options.method = bvh_build_options::split_median;
+        options.max_leaf_size = 1;
+        options.width = 2;
+        tree = bvh_tree(options);
+        vector<size_t> order = tree.build(boxes);
+        for (size_t index : order) {
+            lights.push_back(found[index]);
+            power.push_back(raw[index] > 0.0 ? raw[index] : fallback);
+        }
+        build_alias();
+        build_nodes();
+    }
+
+    //Vose的方法：权重不足平均值的格子由超过平均值的光源补满
+    void build_alias() {
+        int n = int(power.size());
+        total_power = 0.0;
+        for (double p : power) total_power += p;
+        alias_probability.assign(n, 1.0);
+        alias.resize(n);
+        vector<double> scaled(n);
+        vector<int> small, large;
+        for (int i = 0; i < n; ++i) {
+            alias[i] = i;
+            scaled[i] = power[i] * n / total_power;
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+        }
+        while (!small.empty() && !large.empty()) {
+            int s = small.back(), l = large.back();
+            small.pop_back();
+            alias_probability[s] = scaled[s];
+            alias[s] = l;
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+    }
+
+    void build_nodes() {
+        const vector<bvh_linear_node>& nodes = tree.linear_nodes();
+        int count = int(nodes.size());
+        node_power.assign(count, 0.0);
+        node_center.resize(count);
+        node_radius2.resize(count);
+        parent.assign(count, 0);
+        leaf.assign(lights.size(), 0);
+        //孩子的下标总是大于父节点，倒序扫描时孩子的功率已经求出
+        for (int n = count - 1; n >= 0; --n) {
+            const bvh_linear_node& node = nodes[n];
+            vec3 lo(node.bmin[0], node.bmin[1], node.bmin[2]);
+            vec3 hi(node.bmax[0], node.bmax[1], node.bmax[2]);
+            node_center[n] = 0.5 * (lo + hi);
+            node_radius2[n] = 0.25 * (hi - lo).length_squared();
+            if (node.primitive_count > 0) {
+                node_power[n] = power[node.offset];
+                leaf[node.offset] = n;
+            }
+            else {
+                node_power[n] = node_power[n + 1] + node_power[node.offset];
+                parent[n + 1] = n;
+                parent[node.offset] = n;
+            }
+        }
+    }
+
+    //着色点在包围盒附近时按包围盒的大小截断距离，避免权重发散
+    double importance(int n, const point3& origin) const {
+        double distance2 = (node_center[n] - origin).length_squared();
+        return node_power[n] / std::max(std::max(distance2, node_radius2[n]), 1e-12);
+    }
+
+    //在origin处从内部节点n走向左孩子的概率
+    double left_probability(int n, const point3& origin) const {
+        double a = importance(n + 1, origin);
+        double b = importance(tree.linear_nodes()[n].offset, origin);
+        return a + b > 0.0 ? a / (a + b) : 0.5;
+    }
+
+    //u在[0,1)内，probability为选中的概率。沿bvh向下时每一层都把u重新缩放到[0,1)，一个随机数即可走到叶子
+    int sample_index(const point3& origin, double u, double& probability) const {
+        if (mode == select_power) {
+            double x = u * alias.size();
+            int k = std::min(int(x), int(alias.size()) - 1);
+            int index = x - k < alias_probability[k] ? k : alias[k];
+            probability = power[index] / total_power;
+            return index;
+        }
+        const vector<bvh_linear_node>& nodes = tree.linear_nodes();
+        int n = 0;
+        probability = 1.0;
+        while (nodes[n].primitive_count == 0) {
+            double left = left_probability(n, origin);
+            if (u < left) {
+                u = u / left;
+                probability *= left;
+                n = n + 1;
+            }
+            else {
+                u = (u - left) / (1.0 - left);
+                probability *= 1.0 - left;
+                n = nodes[n].offset;
+            }
+        }
+        return nodes[n].offset;
+    }
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+#if defined(_WIN32)
+#include <fstream>
+#include <vector>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//实现了只读的内存映射文件。大的网格文件直接映射到地址空间，由操作系统按页读入，不需要先整体拷贝到堆上。
+//没有mmap的平台退回为一次性读入内存的缓冲区，接口相同
+
+class mapped_file {
+private:
+    const char* bytes{ nullptr };
+    size_t length{ 0 };
+    bool opened{ false };
+#if defined(_WIN32)
+    std::vector<char> buffer;
+#endif
+
+public:
+    //访问方式的提示：顺序读一遍的文件(例如.obj文本)让系统加大预读；映射后随机访问的文件(场景快照、
+    //二进制网格的bvh和顶点)用默认的方式
+    enum access_pattern { access_normal, access_sequential };
+
+    mapped_file() = default;
+    explicit mapped_file(const std::string& path, access_pattern access = access_normal) { open(path, access); }
+    ~mapped_file() { close(); }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    //打开失败时返回false，is_open()也为false
+    bool open(const std::string& path, access_pattern access = access_normal) {
+        close();
+#if defined(_WIN32)
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) return false;
+        buffer.resize(size_t(in.tellg()));
+        in.seekg(0);
+        if (!buffer.empty() && !in.read(buffer.data(), std::streamsize(buffer.size()))) return false;
+        bytes = buffer.data();
+        length = buffer.size();
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = size_t(st.st_size);
+        if (length > 0) {
+            void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                length = 0;
+                return false;
+            }
+            if (access == access_sequential) madvise(p, length, MADV_SEQUENTIAL);
+            bytes = static_cast<const char*>(p);
+        }
+        //映射建立后可以关闭文件描述符
+        ::close(fd);
+#endif
+        opened = true;
+        return true;
+    }
+
+    void close() {
+#if defined(_WIN32)
+        buffer.clear();
+#else
+        if (bytes) munmap(const_cast<char*>(bytes), length);
+#endif
+        bytes = nullptr;
+        length = 0;
+        opened = false;
+    }
+
+    bool is_open() const { return opened; }
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+#endif
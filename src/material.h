@@ -9,7 +9,7 @@ class hit_record;
 class scatter_record {
 public:
     color attenuation;
-    shared_ptr<pdf> pdf_ptr;
+    scatter_pdf pdf;  //按值存放，skip_pdf为真时不使用
     bool skip_pdf;
     ray skip_pdf_ray;
 };
@@ -28,6 +28,10 @@ public:
     virtual bool scatter(const ray& r_in,const hit_record& rec,scatter_record& srec) const {
         return false;
     }
+    //表面发出的平均辐亮度，光源采样据此估计功率，不发光的材质为黑色
+    virtual color mean_emission() const {
+        return color(0.0, 0.0, 0.0);
+    }
     virtual ~material() = default;
 };
  
@@ -40,8 +44,8 @@ public:
     lambertian(const color& al) :tex{ make_shared<solid_color>(al) } {}
     lambertian(shared_ptr<texture> t) :tex{ t } {}
     bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
-        srec.attenuation = tex->value(rec.u, rec.v, rec.p);
-        srec.pdf_ptr = make_shared<cosine_pdf>(rec.normal);
+        srec.attenuation = tex->filtered_value(rec.u, rec.v, rec.p, rec.uv_footprint());
+        srec.pdf.set_cosine(rec.normal);
         srec.skip_pdf = false;
         return true;
     }
@@ -49,6 +53,11 @@ public:
         double cos_theta = dot(normalize(scattered.direction()), rec.normal);
         return cos_theta < 0.0 ? 0.0 : cos_theta / pi;
     }
+
+    template <class W>
+    void save_snapshot(W& w) const { w.ref(tex); }
+    template <class R>
+    static shared_ptr<lambertian> load_snapshot(R& r) { return make_shared<lambertian>(r.texture_ref()); }
 };
 
 //实现了金属类，字段fuzz实现了反射的粗糙感
@@ -62,11 +71,21 @@ public:
     bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
         vec3 reflected = normalize(reflect(r_in.direction(), rec.normal)) + fuzz * random_unit_vector();
         srec.attenuation = albedo;
-        srec.pdf_ptr = nullptr;
         srec.skip_pdf = true;
         srec.skip_pdf_ray = ray(rec.p, reflected, r_in.time());
         return true;
     }
+
+    template <class W>
+    void save_snapshot(W& w) const {
+        w.vec(albedo);
+        w.f64(fuzz);
+    }
+    template <class R>
+    static shared_ptr<metal> load_snapshot(R& r) {
+        color al = r.vec();
+        return make_shared<metal>(al, r.f64());
+    }
 };
 
 //实现了电介质类，字段包括折射率
@@ -83,7 +102,6 @@ public:
     dielectric(double re) :refraction_index{ re } {}
     bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
         srec.attenuation = color(1.0, 1.0, 1.0);
-        srec.pdf_ptr = nullptr;
         srec.skip_pdf = true;
         //折射率是真空光速与该材质光速的比，是大于1的常数。如果光从外部(默认空气)射入，折射率比应为1/index
         double ri = rec.front_face ? (1.0 / refraction_index) : refraction_index;
@@ -102,6 +120,11 @@ public:
         }        
         return true;
     }
+
+    template <class W>
+    void save_snapshot(W& w) const { w.f64(refraction_index); }
+    template <class R>
+    static shared_ptr<dielectric> load_snapshot(R& r) { return make_shared<dielectric>(r.f64()); }
 };
 
 class diffuse_light : public material {
@@ -116,8 +139,18 @@ public:
         if (!rec.front_face) {
             return color(0.0, 0.0, 0.0);
         }
-        return tex->value(u, v, p);
+        return tex->filtered_value(u, v, p, rec.uv_footprint());
+    }
+
+    //覆盖整个纹理坐标范围的查询，图像纹理取到最粗的一层，即全图的平均值
+    color mean_emission() const override {
+        return tex->filtered_value(0.5, 0.5, point3(0.0, 0.0, 0.0), 1.0);
     }
+
+    template <class W>
+    void save_snapshot(W& w) const { w.ref(tex); }
+    template <class R>
+    static shared_ptr<diffuse_light> load_snapshot(R& r) { return make_shared<diffuse_light>(r.texture_ref()); }
 };
 
 class isotropic : public material {
@@ -127,8 +160,8 @@ class isotropic : public material {
 
     bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec)
     const override {
-        srec.attenuation = tex->value(rec.u, rec.v, rec.p);
-        srec.pdf_ptr = make_shared<sphere_pdf>();
+        srec.attenuation = tex->filtered_value(rec.u, rec.v, rec.p, rec.uv_footprint());
+        srec.pdf.set_sphere();
         srec.skip_pdf = false;
         return true;
     }
@@ -137,6 +170,11 @@ class isotropic : public material {
         return 1.0 / (4 * pi);
     }    
 
+    template <class W>
+    void save_snapshot(W& w) const { w.ref(tex); }
+    template <class R>
+    static shared_ptr<isotropic> load_snapshot(R& r) { return make_shared<isotropic>(r.texture_ref()); }
+
   private:
     shared_ptr<texture> tex;
 };
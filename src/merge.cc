@@ -0,0 +1,91 @@
+#include "rtweekend.h"
+#include "accumulation.h"
+#include "image_output.h"
+#include <algorithm>
+
+//zrt_merge：把分片渲染(zrt的分片参数，见main.cc)输出的累积文件按像素合并，写出最终图像。
+//各片的样本统计用Chan等人的并行算法合并，按块分片时每个像素只来自一片，结果与一次渲染整帧完全相同；
+//按样本分片时样本和的累加顺序不同，只有舍入误差。合并前检查各片的场景和相机、图像大小、采样设置和分片方式一致，且每片恰好出现一次。
+//用法：zrt_merge [--denoise] [--accumulation 合并后的累积文件] 输出文件 分片文件...
+
+int main(int argc, char* argv[]) {
+    bool denoise = false;
+    std::string merged_file;
+    vector<std::string> paths;
+
+    bool usage_error = false;
+    for (int a = 1; a < argc; ++a) {
+        std::string arg = argv[a];
+        bool has_value = a + 1 < argc;
+        if (arg == "--denoise") denoise = true;
+        else if (arg == "--accumulation" && has_value) merged_file = argv[++a];
+        else if (arg.compare(0, 2, "--") == 0) usage_error = true;
+        else paths.push_back(arg);
+    }
+    if (usage_error || paths.size() < 2) {
+        std::cerr << "Usage: zrt_merge [--denoise] [--accumulation MERGED.zacc] OUTPUT SHARD.zacc...\n";
+        return 1;
+    }
+    const std::string output_file = paths[0];
+
+    vector<accumulation_buffer> shards(paths.size() - 1);
+    for (size_t k = 0; k < shards.size(); ++k) {
+        if (!shards[k].load(paths[k + 1])) return 1;
+        std::string reason;
+        if (k > 0 && !shards[0].compatible(shards[k], reason)) {
+            std::cerr << "ERROR: '" << paths[k + 1] << "' cannot be merged with '" << paths[1] << "': " << reason << ".\n";
+            return 1;
+        }
+    }
+
+    //按分片编号排序，合并的顺序与命令行上文件的顺序无关
+    vector<size_t> order(shards.size());
+    for (size_t k = 0; k < order.size(); ++k) order[k] = k;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return shards[a].shard_index < shards[b].shard_index; });
+    for (size_t k = 1; k < order.size(); ++k) {
+        if (shards[order[k]].shard_index == shards[order[k - 1]].shard_index) {
+            std::cerr << "ERROR: '" << paths[order[k - 1] + 1] << "' and '" << paths[order[k] + 1] << "' are both shard "
+                << shards[order[k]].shard_index << ".\n";
+            return 1;
+        }
+    }
+    if (int(shards.size()) != shards[0].shard_count) {
+        std::cerr << "ERROR: Got " << shards.size() << " of " << shards[0].shard_count << " shards, the image would be incomplete.\n";
+        return 1;
+    }
+
+    accumulation_buffer merged = std::move(shards[order[0]]);
+    for (size_t k = 1; k < order.size(); ++k) merged.merge(shards[order[k]]);
+    merged.shard_index = 0;
+    merged.shard_count = 1;
+    merged.shard_samples = false;
+    if (!merged_file.empty() && !merged.save(merged_file)) return 1;
+
+    const int width = merged.width, height = merged.height;
+    const size_t pixels = merged.pixels.size();
+    vector<color> image(pixels);
+    for (size_t p = 0; p < pixels; ++p) image[p] = merged.pixel_value(p);
+
+    if (denoise) {
+        if (!merged.has_features()) {
+            std::cerr << "ERROR: The shards were rendered without feature buffers, writing the image without denoising.\n";
+        }
+        else {
+            feature_buffers features;
+            features.assign(pixels);
+            vector<color> variances(pixels);
+            int min_count = 0;
+            for (size_t p = 0; p < pixels; ++p) {
+                const pixel_stats& stats = merged.pixels[p];
+                features.set(p, merged.features[p], stats.count);
+                variances[p] = stats.mean_variance();
+                if (stats.count > 0 && (min_count == 0 || stats.count < min_count)) min_count = stats.count;
+            }
+            //每个像素只有一个样本时没有方差估计，只按特征引导
+            atrous_denoiser denoiser;
+            image = denoiser.apply(image, min_count > 1 ? variances : vector<color>(), features, width, height);
+        }
+    }
+
+    return write_image(output_file, image, width, height) ? 0 : 1;
+}
@@ -0,0 +1,237 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "rtweekend.h"
+#include "triangle_mesh.h"
+#include "mapped_file.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+//实现了网格文件的读取。Wavefront OBJ文件映射到内存后直接逐行解析，不经过iostream；
+//支持v、vt、vn和任意边数的f(按扇形三角化，下标可以为负)，其余指令(o、g、s、usemtl等)被忽略。
+//同一位置配不同纹理坐标或法线的顶点会拆成多个网格顶点。.zmesh二进制文件见triangle_mesh::load_binary
+
+class obj_reader {
+private:
+    static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static void skip_space(const char*& p, const char* end) {
+        while (p < end && is_space(*p)) ++p;
+    }
+
+    static void skip_line(const char*& p, const char* end) {
+        while (p < end && *p != '\n') ++p;
+        if (p < end) ++p;
+    }
+
+    //映射的文件不以'\0'结尾，不能使用strtod，数字解析都以end为界
+    static bool parse_int(const char*& p, const char* end, long& value) {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+        if (p >= end || *p < '0' || *p > '9') return false;
+        long v = 0;
+        while (p < end && *p >= '0' && *p <= '9') v = v * 10 + (*p++ - '0');
+        value = negative ? -v : v;
+        return true;
+    }
+
+    static bool parse_float(const char*& p, const char* end, float& value) {
+        skip_space(p, end);
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+        double mantissa = 0.0;
+        int exponent = 0;
+        bool digits = false;
+        while (p < end && *p >= '0' && *p <= '9') {
+            mantissa = mantissa * 10.0 + (*p++ - '0');
+            digits = true;
+        }
+        if (p < end && *p == '.') {
+            ++p;
+            while (p < end && *p >= '0' && *p <= '9') {
+                mantissa = mantissa * 10.0 + (*p++ - '0');
+                --exponent;
+                digits = true;
+            }
+        }
+        if (!digits) return false;
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            ++p;
+            long e;
+            if (!parse_int(p, end, e)) return false;
+            exponent += int(e);
+        }
+        double v = mantissa * std::pow(10.0, exponent);
+        value = float(negative ? -v : v);
+        return true;
+    }
+
+    //OBJ的下标从1开始，负数表示相对当前已读入的元素从后往前数；越界时返回-1
+    static long resolve_index(long index, size_t count) {
+        long resolved = index < 0 ? long(count) + index : index - 1;
+        return (resolved >= 0 && size_t(resolved) < count) ? resolved : -1;
+    }
+
+    struct vertex_key {
+        long v, vt, vn;
+        bool operator==(const vertex_key& o) const { return v == o.v && vt == o.vt && vn == o.vn; }
+    };
+
+    struct vertex_key_hash {
+        size_t operator()(const vertex_key& k) const {
+            uint64_t h = uint64_t(k.v) * 0x9E3779B97F4A7C15ull;
+            h ^= uint64_t(k.vt + 1) * 0xC2B2AE3D27D4EB4Full + (h >> 29);
+            h ^= uint64_t(k.vn + 1) * 0x165667B19E3779F9ull + (h >> 32);
+            return size_t(h);
+        }
+    };
+
+public:
+    //把OBJ文件读入data，失败时返回false
+    static bool read(const std::string& path, mesh_data& data) {
+        mapped_file file;
+        if (!file.open(path, mapped_file::access_sequential)) {
+            std::cerr << "ERROR: Could not open mesh file '" << path << "'.\n";
+            return false;
+        }
+
+        vector<float> positions, texcoords, normals;
+        //只带位置下标的顶点直接按位置下标查找，带vt或vn的顶点才需要哈希表
+        vector<uint32_t> plain_vertex;
+        std::unordered_map<vertex_key, uint32_t, vertex_key_hash> mixed_vertex;
+        bool any_uv = false, any_normal = false;
+        size_t bad_faces = 0;
+        vector<vertex_key> face;
+
+        data = mesh_data();
+        auto add_vertex = [&](const vertex_key& key) -> uint32_t {
+            if (key.vt < 0 && key.vn < 0) {
+                if (plain_vertex.size() <= size_t(key.v)) plain_vertex.resize(positions.size() / 3, UINT32_MAX);
+                if (plain_vertex[key.v] != UINT32_MAX) return plain_vertex[key.v];
+            }
+            else {
+                auto it = mixed_vertex.find(key);
+                if (it != mixed_vertex.end()) return it->second;
+            }
+            uint32_t index = uint32_t(data.x.size());
+            data.x.push_back(positions[3 * key.v]);
+            data.y.push_back(positions[3 * key.v + 1]);
+            data.z.push_back(positions[3 * key.v + 2]);
+            //缺少的属性先填0，全文件都没有该属性时最后整体删除
+            data.u.push_back(key.vt >= 0 ? texcoords[2 * key.vt] : 0.0f);
+            data.v.push_back(key.vt >= 0 ? texcoords[2 * key.vt + 1] : 0.0f);
+            data.nx.push_back(key.vn >= 0 ? normals[3 * key.vn] : 0.0f);
+            data.ny.push_back(key.vn >= 0 ? normals[3 * key.vn + 1] : 0.0f);
+            data.nz.push_back(key.vn >= 0 ? normals[3 * key.vn + 2] : 0.0f);
+            any_uv |= key.vt >= 0;
+            any_normal |= key.vn >= 0;
+            if (key.vt < 0 && key.vn < 0) plain_vertex[key.v] = index;
+            else mixed_vertex.emplace(key, index);
+            return index;
+        };
+
+        const char* p = file.data();
+        const char* end = p + file.size();
+        while (p < end) {
+            skip_space(p, end);
+            if (p + 1 < end && p[0] == 'v' && is_space(p[1])) {
+                p += 1;
+                float c[3];
+                if (parse_float(p, end, c[0]) && parse_float(p, end, c[1]) && parse_float(p, end, c[2])) {
+                    positions.insert(positions.end(), c, c + 3);
+                }
+                else {
+                    std::cerr << "ERROR: Malformed vertex in mesh file '" << path << "'.\n";
+                    return false;
+                }
+            }
+            else if (p + 2 < end && p[0] == 'v' && p[1] == 't' && is_space(p[2])) {
+                p += 2;
+                float c[2] = { 0.0f, 0.0f };
+                parse_float(p, end, c[0]);
+                parse_float(p, end, c[1]);
+                texcoords.insert(texcoords.end(), c, c + 2);
+            }
+            else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' && is_space(p[2])) {
+                p += 2;
+                float c[3] = { 0.0f, 0.0f, 0.0f };
+                parse_float(p, end, c[0]);
+                parse_float(p, end, c[1]);
+                parse_float(p, end, c[2]);
+                normals.insert(normals.end(), c, c + 3);
+            }
+            else if (p + 1 < end && p[0] == 'f' && is_space(p[1])) {
+                p += 1;
+                face.clear();
+                bool ok = true;
+                while (true) {
+                    skip_space(p, end);
+                    if (p >= end || *p == '\n' || *p == '#') break;
+                    long v, vt = 0, vn = 0;
+                    if (!parse_int(p, end, v)) {
+                        ok = false;
+                        break;
+                    }
+                    vertex_key key{ resolve_index(v, positions.size() / 3), -1, -1 };
+                    if (p < end && *p == '/') {
+                        ++p;
+                        if (parse_int(p, end, vt)) key.vt = resolve_index(vt, texcoords.size() / 2);
+                        if (p < end && *p == '/') {
+                            ++p;
+                            if (parse_int(p, end, vn)) key.vn = resolve_index(vn, normals.size() / 3);
+                        }
+                    }
+                    if (key.v < 0 || (vt != 0 && key.vt < 0) || (vn != 0 && key.vn < 0)) {
+                        ok = false;
+                        break;
+                    }
+                    face.push_back(key);
+                }
+                //整个面都合法后才生成顶点，被跳过的面不会留下多余的顶点
+                if (ok && face.size() >= 3) {
+                    uint32_t first = add_vertex(face[0]);
+                    uint32_t prev = add_vertex(face[1]);
+                    for (size_t k = 2; k < face.size(); ++k) {
+                        uint32_t next = add_vertex(face[k]);
+                        data.add_triangle(first, prev, next);
+                        prev = next;
+                    }
+                }
+                else {
+                    ++bad_faces;
+                }
+            }
+            skip_line(p, end);
+        }
+
+        if (!any_uv) {
+            data.u.clear();
+            data.v.clear();
+        }
+        if (!any_normal) {
+            data.nx.clear();
+            data.ny.clear();
+            data.nz.clear();
+        }
+        if (bad_faces > 0) {
+            std::cerr << "WARNING: Skipped " << bad_faces << " malformed faces in mesh file '" << path << "'.\n";
+        }
+        return true;
+    }
+};
+
+//按扩展名读取.obj或.zmesh网格，失败时返回空指针
+inline shared_ptr<triangle_mesh> load_mesh(const std::string& path, shared_ptr<material> mat,
+    const bvh_build_options& opt = bvh_build_options()) {
+    if (ends_with(path, ".zmesh")) return triangle_mesh::load_binary(path, mat, opt);
+    if (!ends_with(path, ".obj")) {
+        std::cerr << "ERROR: Unknown mesh format '" << path << "'.\n";
+        return nullptr;
+    }
+    mesh_data data;
+    if (!obj_reader::read(path, data)) return nullptr;
+    return make_shared<triangle_mesh>(std::move(data), mat, opt);
+}
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include "rtweekend.h"
+#include "rtw_stb_image.h"
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+//实现了图像纹理的mipmap和进程内共享的纹理缓存。
+//每一层按4x4纹素分块存放，纹素为打包的RGBA8(R在最低字节)，一块正好64字节即一条缓存行，
+//双线性过滤取的四个纹素大多落在同一块内。层级由光锥在交点处覆盖的纹理坐标范围决定，两层之间线性插值(三线性过滤)，
+//远处的物体只访问很小的几层。全部层级合计约为原图纹素数的4/3，解码用的浮点和8位副本在生成mipmap后即释放
+
+class mipmap {
+public:
+    static const int tile_size = 4;
+
+    struct level {
+        int width;
+        int height;
+        int tiles_x;    //每行的块数
+        size_t offset;  //该层第一个纹素在数组中的下标
+    };
+
+    mipmap() = default;
+
+    //由解码好的图像生成全部层级，图像为空时得到空的mipmap
+    explicit mipmap(const rtw_image& image) {
+        size_t total;
+        levels = layout(image.width(), image.height(), total);
+        if (levels.empty()) return;
+        auto owned = make_shared<vector<uint32_t>>(total, 0u);
+        uint32_t* out = owned->data();
+
+        const level& base = levels[0];
+        for (int y = 0; y < base.height; ++y) {
+            for (int x = 0; x < base.width; ++x) {
+                const unsigned char* c = image.pixel_data(x, y);
+                out[index(base, x, y)] = pack(c[0], c[1], c[2], 255);
+            }
+        }
+        //每层由上一层2x2的盒式滤波得到，奇数边长时最后一行(列)与前一行(列)一起参与平均
+        for (size_t l = 1; l < levels.size(); ++l) {
+            const level& src = levels[l - 1];
+            const level& dst = levels[l];
+            for (int y = 0; y < dst.height; ++y) {
+                int y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+                for (int x = 0; x < dst.width; ++x) {
+                    int x0 = std::min(2 * x, src.width - 1), x1 = std::min(2 * x + 1, src.width - 1);
+                    uint32_t t[4] = { out[index(src, x0, y0)], out[index(src, x1, y0)],
+                                      out[index(src, x0, y1)], out[index(src, x1, y1)] };
+                    unsigned c[4];
+                    for (int ch = 0; ch < 4; ++ch) {
+                        unsigned sum = 0;
+                        for (uint32_t texel : t) sum += (texel >> (8 * ch)) & 0xFF;
+                        c[ch] = (sum + 2) / 4;
+                    }
+                    out[index(dst, x, y)] = pack(c[0], c[1], c[2], c[3]);
+                }
+            }
+        }
+        texels = out;
+        storage = owned;
+    }
+
+    //使用已经按layout排好的纹素，例如映射的快照文件，storage保证texels的生命周期
+    mipmap(int width, int height, const uint32_t* data, shared_ptr<const void> owner) :texels{ data }, storage{ owner } {
+        size_t total;
+        levels = layout(width, height, total);
+    }
+
+    //宽高为width和height的图像全部层级的纹素数(含分块的补齐)，layout失败时返回0
+    static size_t texel_count(int width, int height) {
+        size_t total;
+        layout(width, height, total);
+        return total;
+    }
+
+    int width() const { return levels.empty() ? 0 : levels[0].width; }
+    int height() const { return levels.empty() ? 0 : levels[0].height; }
+    int level_count() const { return int(levels.size()); }
+    const uint32_t* data() const { return texels; }
+    size_t size() const { return levels.empty() ? 0 : levels.back().offset + tile_texels(levels.back()); }
+
+    //u、v在[0,1]内，v=0为图像底边；footprint为需要覆盖的纹理坐标范围，0时在最精细的一层做双线性过滤
+    color sample(double u, double v, double footprint) const {
+        int last = int(levels.size()) - 1;
+        if (!(footprint > 0)) return bilinear(levels[0], u, v);
+        //层级为覆盖纹素数的log2，用frexp取指数再对尾数做线性近似，误差不超过0.09层，比log2快得多
+        int exponent;
+        double mantissa = std::frexp(footprint * std::max(levels[0].width, levels[0].height), &exponent);
+        double lod = exponent - 2 + 2 * mantissa;
+        if (!(lod > 0)) return bilinear(levels[0], u, v);
+        if (lod >= last) return bilinear(levels[last], u, v);
+        int l = int(lod);
+        double f = lod - l;
+        return (1.0 - f) * bilinear(levels[l], u, v) + f * bilinear(levels[l + 1], u, v);
+    }
+
+private:
+    vector<level> levels;
+    const uint32_t* texels{ nullptr };
+    shared_ptr<const void> storage;
+
+    static uint32_t pack(unsigned r, unsigned g, unsigned b, unsigned a) {
+        return uint32_t(r) | (uint32_t(g) << 8) | (uint32_t(b) << 16) | (uint32_t(a) << 24);
+    }
+
+    static size_t tile_texels(const level& l) {
+        return size_t(l.tiles_x) * ((l.height + tile_size - 1) / tile_size) * tile_size * tile_size;
+    }
+
+    static size_t index(const level& l, int x, int y) {
+        unsigned ux = unsigned(x), uy = unsigned(y);
+        size_t tile = size_t(uy / tile_size) * unsigned(l.tiles_x) + ux / tile_size;
+        return l.offset + tile * (tile_size * tile_size) + (uy % tile_size) * tile_size + (ux % tile_size);
+    }
+
+    //从原图开始每层宽高减半(向下取整，至少为1)，直到1x1
+    static vector<level> layout(int width, int height, size_t& total) {
+        vector<level> result;
+        total = 0;
+        if (width <= 0 || height <= 0 || width > (1 << 16) || height > (1 << 16)) return result;
+        while (true) {
+            level l{ width, height, (width + tile_size - 1) / tile_size, total };
+            result.push_back(l);
+            total += tile_texels(l);
+            if (width == 1 && height == 1) break;
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        return result;
+    }
+
+    //边缘按截断处理，与原先的最近邻查找一致
+    //权重和通道都用float计算，结果的精度远高于8位纹素
+    color bilinear(const level& l, double u, double v) const {
+        float x = float(interval(0.0, 1.0).clamp(u)) * l.width - 0.5f;
+        float y = float(1.0 - interval(0.0, 1.0).clamp(v)) * l.height - 0.5f;
+        //x、y不小于-0.5，加1后截断即为向下取整
+        int ix = int(x + 1.0f) - 1, iy = int(y + 1.0f) - 1;
+        float wx = x - ix, wy = y - iy;
+        int x0 = std::max(ix, 0), y0 = std::max(iy, 0);
+        int x1 = std::min(ix + 1, l.width - 1), y1 = std::min(iy + 1, l.height - 1);
+        uint32_t t[4] = { texels[index(l, x0, y0)], texels[index(l, x1, y0)],
+                          texels[index(l, x0, y1)], texels[index(l, x1, y1)] };
+        const float scale = 1.0f / 255.0f;
+        float w[4] = { (1 - wx) * (1 - wy) * scale, wx * (1 - wy) * scale, (1 - wx) * wy * scale, wx * wy * scale };
+        float c[3] = { 0.0f, 0.0f, 0.0f };
+        for (int k = 0; k < 4; ++k) {
+            c[0] += w[k] * float(t[k] & 0xFF);
+            c[1] += w[k] * float((t[k] >> 8) & 0xFF);
+            c[2] += w[k] * float((t[k] >> 16) & 0xFF);
+        }
+        return color(c[0], c[1], c[2]);
+    }
+};
+
+//进程内的图像纹理缓存，以文件名为键。同一个文件被多个纹理使用时只解码一次、只保存一份mipmap；
+//缓存只持有弱引用，没有纹理再使用时mipmap随之释放。加载失败的结果不进入缓存。
+//解码和生成mipmap在锁外进行，不同文件可以同时加载；正在加载的文件登记一个shared_future，其他线程等它完成
+class texture_cache {
+public:
+    static shared_ptr<const mipmap> get(const std::string& filename) {
+        static std::mutex lock;
+        static std::unordered_map<std::string, entry> entries;
+
+        std::promise<shared_ptr<const mipmap>> loaded;
+        std::shared_future<shared_ptr<const mipmap>> pending;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            entry& e = entries[filename];
+            if (auto cached = e.image.lock()) return cached;
+            if (e.loading.valid()) pending = e.loading;
+            else e.loading = loaded.get_future().share();
+        }
+        if (pending.valid()) return pending.get();
+
+        shared_ptr<const mipmap> image;
+        {
+            rtw_image decoded(filename.c_str());
+            image = make_shared<mipmap>(decoded);
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            entry& e = entries[filename];
+            if (image->level_count() > 0) e.image = image;
+            e.loading = std::shared_future<shared_ptr<const mipmap>>();
+        }
+        loaded.set_value(image);
+        return image;
+    }
+
+private:
+    struct entry {
+        std::weak_ptr<const mipmap> image;
+        std::shared_future<shared_ptr<const mipmap>> loading;  //正在解码时有效
+    };
+};
+
+#endif
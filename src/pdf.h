@@ -42,6 +42,40 @@ public:
     }
 };
 
+//材质散射用的pdf，以值的形式存放在scatter_record里，不需要堆分配。用类型标签区分余弦分布和均匀球面分布
+class scatter_pdf : public pdf {
+public:
+    enum pdf_kind { none, cosine, sphere };
+
+    void set_cosine(const vec3& normal) {
+        kind = cosine;
+        uvw.build_from_w(normal);
+    }
+
+    void set_sphere() {
+        kind = sphere;
+    }
+
+    double value(const vec3& direction) const override {
+        if (kind == cosine) {
+            double cosine_theta = dot(normalize(direction), uvw.w());
+            return fmax(0, cosine_theta / pi);
+        }
+        if (kind == sphere) return 1.0 / (4 * pi);
+        return 0.0;
+    }
+
+    vec3 generate() const override {
+        if (kind == cosine) return uvw.local(random_cosine_direction());
+        if (kind == sphere) return random_unit_vector();
+        return vec3(1.0, 0.0, 0.0);
+    }
+
+private:
+    pdf_kind kind{ none };
+    onb uvw;
+};
+
 class hittable_pdf : public pdf {
 private:
     const hittable& objects;
@@ -59,11 +93,12 @@ public:
     }
 };
 
+//两个pdf各占一半的混合，只引用不持有，两个pdf都可以放在栈上
 class mixture_pdf : public pdf {
   public:
-    mixture_pdf(shared_ptr<pdf> p0, shared_ptr<pdf> p1) {
-        p[0] = p0;
-        p[1] = p1;
+    mixture_pdf(const pdf& p0, const pdf& p1) {
+        p[0] = &p0;
+        p[1] = &p1;
     }
 
     double value(const vec3& direction) const override {
@@ -78,7 +113,7 @@ class mixture_pdf : public pdf {
     }
 
   private:
-    shared_ptr<pdf> p[2];
+    const pdf* p[2];
 };
 
 #endif
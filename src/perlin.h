@@ -2,107 +2,158 @@
 #define PERLIN_H
 
 #include "rtweekend.h"
+#include "rng.h"
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
 //实现了perlin类，可以形成perlin噪声
-class perlin
-{
-private:
+//梯度和置换表由种子决定，按种子在进程内共享，同一种子的所有perlin对象只生成和保存一份表。
+//梯度按分量分开存放(SoA)，求噪声时8个角点的查表、点积和三线性插值写成定长循环，turb再把各倍频放在SIMD通道上同时计算
 
+class perlin_tables {
+public:
     static const int point_count = 256;
-    vec3* randvec;
-    int* x_perm;
-    int* y_perm;
-    int* z_perm;
 
-    static int* get_generated_perm() {
-        int* perm = new int[point_count];
+    alignas(64) float gx[point_count];
+    alignas(64) float gy[point_count];
+    alignas(64) float gz[point_count];
+    alignas(64) int x_perm[point_count];
+    alignas(64) int y_perm[point_count];
+    alignas(64) int z_perm[point_count];
+
+    //表只由种子决定，与生成时的线程和随机数状态无关
+    explicit perlin_tables(uint64_t seed) {
+        sampler_rng rng(seed, 0);
         for (int i = 0; i < point_count; ++i) {
-            perm[i] = i;
+            vec3 g;
+            do {
+                g = vec3(2 * rng.next_double() - 1, 2 * rng.next_double() - 1, 2 * rng.next_double() - 1);
+            } while (g.length_squared() < 1e-8);
+            g = normalize(g);
+            gx[i] = float(g.x());
+            gy[i] = float(g.y());
+            gz[i] = float(g.z());
         }
-        permute(perm, point_count);
-        return perm;
+        generate_perm(rng, x_perm);
+        generate_perm(rng, y_perm);
+        generate_perm(rng, z_perm);
     }
 
-    static void permute(int* perm, int n) {
-        for (int i = n - 1; i > 0; --i) {
-            int j = random_int(0, i);
-            int term = perm[j];
-            perm[j] = perm[i];
-            perm[i] = term;
-        }
+    static shared_ptr<const perlin_tables> get(uint64_t seed) {
+        static std::mutex lock;
+        static std::unordered_map<uint64_t, shared_ptr<const perlin_tables>> tables;
+        std::lock_guard<std::mutex> guard(lock);
+        auto& entry = tables[seed];
+        if (!entry) entry = make_shared<perlin_tables>(seed);
+        return entry;
     }
 
-    static double perlin_interp(const vec3 c[2][2][2], double u, double v, double w) {
-        auto uu = u*u*(3-2*u);
-        auto vv = v*v*(3-2*v);
-        auto ww = w*w*(3-2*w);
-        auto accum = 0.0;
-
-        for (int i=0; i < 2; i++)
-            for (int j=0; j < 2; j++)
-                for (int k=0; k < 2; k++) {
-                    vec3 weight_v(u-i, v-j, w-k);
-                    accum += (i*uu + (1-i)*(1-uu))
-                           * (j*vv + (1-j)*(1-vv))
-                           * (k*ww + (1-k)*(1-ww))
-                           * dot(c[i][j][k], weight_v);
-                }
+private:
+    static void generate_perm(sampler_rng& rng, int* perm) {
+        for (int i = 0; i < point_count; ++i) {
+            perm[i] = i;
+        }
+        for (int i = point_count - 1; i > 0; --i) {
+            int j = int(rng.next_double() * (i + 1));
+            std::swap(perm[i], perm[j]);
+        }
+    }
+};
 
+class perlin
+{
+private:
+    uint64_t table_seed;
+    shared_ptr<const perlin_tables> tables;
+
+    //一次最多同时计算的倍频数，超过时分批
+    static const int octave_batch = 8;
+
+    //第k条通道求点(px[k],py[k],pz[k])处的噪声，乘以weight[k]后求和。
+    //格点和小数部分先用double求出，高倍频的坐标很大时小数部分仍然准确；之后的查表和插值用float，8个通道正好占满一个256位向量。
+    //平滑权重u*u*(3-2u)与原先逐角点累加的插值相同，这里改写成沿z、y、x依次线性插值
+    double noise_sum(const double px[], const double py[], const double pz[], const double weight[]) const {
+        const perlin_tables& t = *tables;
+        int ci[octave_batch], cj[octave_batch], cl[octave_batch];
+        float fu[octave_batch], fv[octave_batch], fw[octave_batch], fwt[octave_batch];
+#pragma omp simd
+        for (int k = 0; k < octave_batch; ++k) {
+            double fx = floor(px[k]), fy = floor(py[k]), fz = floor(pz[k]);
+            fu[k] = float(px[k] - fx);
+            fv[k] = float(py[k] - fy);
+            fw[k] = float(pz[k] - fz);
+            ci[k] = int(fx) & 255;
+            cj[k] = int(fy) & 255;
+            cl[k] = int(fz) & 255;
+            fwt[k] = float(weight[k]);
+        }
+        float accum = 0.0f;
+#pragma omp simd reduction(+:accum)
+        for (int k = 0; k < octave_batch; ++k) {
+            float u = fu[k], v = fv[k], w = fw[k];
+            int i = ci[k], j = cj[k], l = cl[k];
+            int x0 = t.x_perm[i], x1 = t.x_perm[(i + 1) & 255];
+            int y0 = t.y_perm[j], y1 = t.y_perm[(j + 1) & 255];
+            int z0 = t.z_perm[l], z1 = t.z_perm[(l + 1) & 255];
+
+            int h000 = x0 ^ y0 ^ z0, h001 = x0 ^ y0 ^ z1, h010 = x0 ^ y1 ^ z0, h011 = x0 ^ y1 ^ z1;
+            int h100 = x1 ^ y0 ^ z0, h101 = x1 ^ y0 ^ z1, h110 = x1 ^ y1 ^ z0, h111 = x1 ^ y1 ^ z1;
+            float u1 = u - 1, v1 = v - 1, w1 = w - 1;
+            float d000 = t.gx[h000] * u + t.gy[h000] * v + t.gz[h000] * w;
+            float d001 = t.gx[h001] * u + t.gy[h001] * v + t.gz[h001] * w1;
+            float d010 = t.gx[h010] * u + t.gy[h010] * v1 + t.gz[h010] * w;
+            float d011 = t.gx[h011] * u + t.gy[h011] * v1 + t.gz[h011] * w1;
+            float d100 = t.gx[h100] * u1 + t.gy[h100] * v + t.gz[h100] * w;
+            float d101 = t.gx[h101] * u1 + t.gy[h101] * v + t.gz[h101] * w1;
+            float d110 = t.gx[h110] * u1 + t.gy[h110] * v1 + t.gz[h110] * w;
+            float d111 = t.gx[h111] * u1 + t.gy[h111] * v1 + t.gz[h111] * w1;
+
+            float uu = u * u * (3 - 2 * u);
+            float vv = v * v * (3 - 2 * v);
+            float ww = w * w * (3 - 2 * w);
+            float d00 = d000 + ww * (d001 - d000), d01 = d010 + ww * (d011 - d010);
+            float d10 = d100 + ww * (d101 - d100), d11 = d110 + ww * (d111 - d110);
+            float d0 = d00 + vv * (d01 - d00), d1 = d10 + vv * (d11 - d10);
+            accum += fwt[k] * (d0 + uu * (d1 - d0));
+        }
         return accum;
     }
 
 public:
-    perlin() {
-        randvec = new vec3[point_count];
-        for (int i = 0; i < point_count; ++i) {
-            randvec[i] = normalize(vec3::random(-1.0, 1.0));
-        }
-        x_perm = get_generated_perm();
-        y_perm = get_generated_perm();
-        z_perm = get_generated_perm();
-    }
+    static const uint64_t default_seed = 0x5EED5EED;
+    static const int point_count = perlin_tables::point_count;
 
-    ~perlin() {
-        delete[] randvec;
-        delete[] x_perm;
-        delete[] y_perm;
-        delete[] z_perm;
-    }
+    perlin(uint64_t seed = default_seed) :table_seed{ seed }, tables{ perlin_tables::get(seed) } {}
+
+    uint64_t seed() const { return table_seed; }
 
     double noise(const point3& p) const {
-        auto u = p.x() - floor(p.x());
-        auto v = p.y() - floor(p.y());
-        auto w = p.z() - floor(p.z());
-
-        auto i = int(floor(p.x()));
-        auto j = int(floor(p.y()));
-        auto k = int(floor(p.z()));
-        vec3 c[2][2][2];
-
-        for (int di = 0; di < 2; di++)
-            for (int dj = 0; dj < 2; dj++)
-                for (int dk = 0; dk < 2; dk++)
-                    c[di][dj][dk] = randvec[
-                        x_perm[(i + di) & 255] ^
-                            y_perm[(j + dj) & 255] ^
-                            z_perm[(k + dk) & 255]
-                    ];
-
-        return perlin_interp(c, u, v, w);
+        double px[octave_batch] = { p.x() }, py[octave_batch] = { p.y() }, pz[octave_batch] = { p.z() };
+        double weight[octave_batch] = { 1.0 };
+        return noise_sum(px, py, pz, weight);
     }
-    
+
+    //depth个倍频的噪声按1/2递减的权重求和，各倍频互不依赖，每批octave_batch个同时计算
     double turb(const point3& p, int depth) const {
-        auto accum = 0.0;
-        auto temp_p = p;
-        auto weight = 1.0;
-
-        for (int i = 0; i < depth; i++) {
-            accum += weight * noise(temp_p);
-            weight *= 0.5;
-            temp_p *= 2;
+        double accum = 0.0;
+        double x = p.x(), y = p.y(), z = p.z();
+        double weight = 1.0;
+        for (int first = 0; first < depth; first += octave_batch) {
+            double px[octave_batch], py[octave_batch], pz[octave_batch], w[octave_batch];
+            for (int k = 0; k < octave_batch; ++k) {
+                px[k] = x;
+                py[k] = y;
+                pz[k] = z;
+                w[k] = first + k < depth ? weight : 0.0;
+                x *= 2;
+                y *= 2;
+                z *= 2;
+                weight *= 0.5;
+            }
+            accum += noise_sum(px, py, pz, w);
         }
-
         return fabs(accum);
     }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,81 @@
+#ifndef PIXEL_STATS_H
+#define PIXEL_STATS_H
+
+#include "rtweekend.h"
+//实现了像素样本的在线统计。用Welford算法同时维护均值和平方差之和，不需要保存样本；
+//另外单独记录亮度的均值和平方差，用于自适应采样判断收敛。两份统计可以合并(Chan等人的并行算法)，
+//分片渲染的结果按像素合并后与一次渲染全部样本的统计相同
+
+class pixel_stats {
+public:
+    int    count{ 0 };
+    color  sum{ 0.0,0.0,0.0 };   //样本和，均匀采样时直接按原来的方式缩放
+    color  mean{ 0.0,0.0,0.0 };
+    color  m2{ 0.0,0.0,0.0 };
+    double luminance_mean{ 0.0 };
+    double luminance_m2{ 0.0 };
+
+    void add(const color& x) {
+        ++count;
+        sum += x;
+        vec3 delta = x - mean;
+        mean += delta / count;
+        m2 += delta * (x - mean);
+
+        double l = luminance(x);
+        double delta_l = l - luminance_mean;
+        luminance_mean += delta_l / count;
+        luminance_m2 += delta_l * (l - luminance_mean);
+    }
+
+    //并入另一组样本的统计。一方没有样本时直接取另一方，结果与原来完全相同
+    void merge(const pixel_stats& other) {
+        if (other.count == 0) return;
+        if (count == 0) {
+            *this = other;
+            return;
+        }
+        double n = double(count) + other.count;
+        double weight = other.count / n;
+        double cross = double(count) * other.count / n;
+        vec3 delta = other.mean - mean;
+        mean += weight * delta;
+        m2 += other.m2 + cross * (delta * delta);
+        double delta_l = other.luminance_mean - luminance_mean;
+        luminance_mean += weight * delta_l;
+        luminance_m2 += other.luminance_m2 + cross * delta_l * delta_l;
+        sum += other.sum;
+        count += other.count;
+    }
+
+    //像素的颜色。样本数恰好是samples_per_pixel对应的完整分层格子时按1/samples_per_pixel缩放(与原来的方式相同)，
+    //自适应采样或者样本数不同(续渲、分片)时按实际样本数求均值
+    color value(int samples_per_pixel, bool adaptive) const {
+        int sqrt_spp = int(sqrt(samples_per_pixel));
+        if (adaptive || count != sqrt_spp * sqrt_spp) return count > 0 ? sum / count : color(0.0, 0.0, 0.0);
+        return (1.0 / samples_per_pixel) * sum;
+    }
+
+    //样本方差
+    color variance() const {
+        return count > 1 ? m2 / (count - 1) : color(0.0, 0.0, 0.0);
+    }
+
+    //均值估计的方差，即样本方差除以样本数
+    color mean_variance() const {
+        return count > 1 ? variance() / count : color(0.0, 0.0, 0.0);
+    }
+
+    //亮度均值的标准误差不超过 threshold * (亮度均值 + floor) 时认为已经收敛。floor避免暗像素永远不收敛
+    bool converged(double threshold, double floor = 1e-3) const {
+        if (count < 2) return false;
+        double standard_error = sqrt(luminance_m2 / (count - 1) / count);
+        return standard_error <= threshold * (luminance_mean + floor);
+    }
+
+    static double luminance(const color& c) {
+        return ::luminance(c);
+    }
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include "rtweekend.h"
 #include "hittable.h"
 #include "hittable_list.h"
+#include "material.h"
 //实现了四边形类，包含结构体，材质以及包围盒计算。平行四边形被定义为起点Q以及出发的相邻两边u，v
 class quad : public hittable {
 private:
@@ -13,9 +14,10 @@ private:
     shared_ptr<material> mat;
     aabb bbox;
     vec3 normal;//四边形所在平面的单位法向量
-    double D;//所在平面的隐式公式Ax+By+Cz=D中的D
+    real D;//所在平面的隐式公式Ax+By+Cz=D中的D
     vec3 w;//求交计算，需要首先计算光线与所在平面的交，然后求出交点在向量uv坐标下的坐标值，判断是否落在[0,1]^2来决定是否与四边形相交，w用来方便计算坐标值
-    double area;
+    real area;
+    real uv_density;//单位长度对应的(alpha,beta)变化，按面积取平均
 
 public:
     quad(point3 q, vec3 u, vec3 v, shared_ptr<material> mat) :Q{ q }, u{ u }, v{ v }, mat{ mat } {
@@ -25,6 +27,7 @@ public:
         D = dot(normal, Q);
         w = n / dot(n, n);
         area = n.length();
+        uv_density = 1 / sqrt(area);
     }
 
     virtual void set_bounding_box() {
@@ -37,29 +40,93 @@ public:
         return bbox;
     }
 
+    template <class W>
+    void save_snapshot(W& w) const {
+        w.vec(Q);
+        w.vec(u);
+        w.vec(v);
+        w.ref(mat);
+    }
+    template <class R>
+    static shared_ptr<quad> load_snapshot(R& r) {
+        point3 q = r.vec();
+        vec3 side_u = r.vec();
+        vec3 side_v = r.vec();
+        return make_shared<quad>(q, side_u, side_v, r.material_ref());
+    }
+
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        double n_d = dot(normal, r.direction());
+        real n_d = dot(normal, r.direction());
         if (fabs(n_d) < 1e-8)return false;
-        double t = (D - dot(normal, r.origin())) / n_d;
+        real t = (D - dot(normal, r.origin())) / n_d;
         if (!ray_t.contains(t)) return false;
 
         point3 intersection = r.at(t);
         vec3 p = intersection - Q;
         //假设所在平面上的交点，在uv坐标系下坐标为(alpha,beta)
-        double alpha = dot(w, cross(p, v));
-        double beta = dot(w, cross(u, p));
+        real alpha = dot(w, cross(p, v));
+        real beta = dot(w, cross(u, p));
 
         if (!is_interior(alpha, beta, rec))return false;
 
         rec.set_face_normal(r, normal);
-        rec.mat = mat;
+        rec.mat = mat.get();
+        rec.uv_density = uv_density;
         rec.t = t;
         rec.p = intersection;
 
         return true;
     }
 
-    virtual bool is_interior(double a, double b, hit_record& rec) const {
+    //is_interior会写入uv，这里写到临时记录中
+    bool occluded(const ray& r, interval ray_t) const override {
+        real n_d = dot(normal, r.direction());
+        if (fabs(n_d) < 1e-8) return false;
+        real t = (D - dot(normal, r.origin())) / n_d;
+        if (!ray_t.contains(t)) return false;
+        vec3 p = r.at(t) - Q;
+        hit_record rec;
+        return is_interior(dot(w, cross(p, v)), dot(w, cross(u, p)), rec);
+    }
+
+    //对光线包中的全部光线同时求平面交点和(alpha, beta)坐标，再逐条判断是否落在四边形内部
+    uint32_t hit_packet(ray_packet& packet, uint32_t active, real t_min, real t_max[], hit_record recs[]) const override {
+        real ts[max_packet_size], alphas[max_packet_size], betas[max_packet_size];
+        int found[max_packet_size];
+        const real nx = normal.x(), ny = normal.y(), nz = normal.z();
+        const real qx = Q.x(), qy = Q.y(), qz = Q.z();
+
+#pragma omp simd
+        for (int k = 0; k < max_packet_size; ++k) {
+            real n_d = nx * packet.dx[k] + ny * packet.dy[k] + nz * packet.dz[k];
+            real t = (D - (nx * packet.ox[k] + ny * packet.oy[k] + nz * packet.oz[k])) / n_d;
+            real px = (packet.ox[k] + t * packet.dx[k]) - qx;
+            real py = (packet.oy[k] + t * packet.dy[k]) - qy;
+            real pz = (packet.oz[k] + t * packet.dz[k]) - qz;
+            //alpha = dot(w, cross(p, v))，beta = dot(w, cross(u, p))
+            alphas[k] = w.x() * (py * v.z() - pz * v.y()) + w.y() * (pz * v.x() - px * v.z()) + w.z() * (px * v.y() - py * v.x());
+            betas[k] = w.x() * (u.y() * pz - u.z() * py) + w.y() * (u.z() * px - u.x() * pz) + w.z() * (u.x() * py - u.y() * px);
+            ts[k] = t;
+            found[k] = !(fabs(n_d) < 1e-8) & (t >= t_min) & (t <= t_max[k]);
+        }
+
+        uint32_t hits = 0;
+        for_each_lane(active, [&](int k) {
+            if (!found[k] || !is_interior(alphas[k], betas[k], recs[k])) return;
+            const ray& r = packet.rays[k];
+            hit_record& rec = recs[k];
+            rec.set_face_normal(r, normal);
+            rec.mat = mat.get();
+            rec.uv_density = uv_density;
+            rec.t = ts[k];
+            rec.p = r.at(ts[k]);
+            t_max[k] = ts[k];
+            hits |= 1u << k;
+        });
+        return hits;
+    }
+
+    virtual bool is_interior(real a, real b, hit_record& rec) const {
         interval unit_interval(0.0, 1.0);
         if ((!unit_interval.contains(a)) || (!unit_interval.contains(b))) {
             return false;
@@ -84,6 +151,32 @@ public:
         auto p = Q + (random_double() * u) + (random_double() * v);
         return p - origin;
     }
+
+    //在四边形上均匀取点，面积上的密度1/area换算到立体角上
+    bool sample_light(const point3& origin, hit_record& rec, double& pdf) const override {
+        real a = real(random_double()), b = real(random_double());
+        point3 p = Q + a * u + b * v;
+        vec3 to_light = p - origin;
+        double distance_squared = to_light.length_squared();
+        double cosine = fabs(dot(to_light, normal)) / sqrt(distance_squared);
+        if (!(cosine > 1e-8)) return false;
+        pdf = distance_squared / (cosine * area);
+        rec.p = p;
+        rec.t = 1;
+        rec.set_face_normal(ray(origin, to_light), normal);
+        rec.mat = mat.get();
+        rec.u = a;
+        rec.v = b;
+        rec.uv_density = uv_density;
+        rec.cone_width = 0;
+        return true;
+    }
+
+    //只有正面发光
+    double emitted_power() const override {
+        if (!mat) return 0.0;
+        return pi * area * luminance(mat->mean_emission());
+    }
 };
 
 inline shared_ptr<hittable_list> box(const point3& a, const point3& b, shared_ptr<material> mat) {
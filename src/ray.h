@@ -3,20 +3,25 @@
 
 #include "vec3.h"
 //实现了光线类结构，包含一个point3字段和vec3字段，成员函数包括读取函数，构建函数和确认点位置函数。新增了时间字段
+//构造时预先计算方向的倒数，包围盒求交时不再需要逐轴做除法
 class ray {
 private:
     point3 orig;
     vec3 dir;
-    double tm;
+    vec3 inv_dir;
+    real tm;
 public:
     ray() = default;
-    ray(const point3& origin, const vec3& direction) :orig{ origin }, dir{ direction }, tm{ 0 } {}
-    ray(const point3& origin, const vec3& direction, double time) :orig{ origin }, dir{ direction }, tm{ time } {}
+    ray(const point3& origin, const vec3& direction) :orig{ origin }, dir{ direction },
+        inv_dir{ 1 / direction.x(), 1 / direction.y(), 1 / direction.z() }, tm{ 0 } {}
+    ray(const point3& origin, const vec3& direction, real time) :orig{ origin }, dir{ direction },
+        inv_dir{ 1 / direction.x(), 1 / direction.y(), 1 / direction.z() }, tm{ time } {}
     const point3& origin() const { return orig; }
     const vec3& direction() const { return dir; }
-    double time()const { return tm; }
-    point3 at(double t) const { return (orig + t * dir); }
+    const vec3& inv_direction() const { return inv_dir; }
+    real time()const { return tm; }
+    point3 at(real t) const { return (orig + t * dir); }
 };
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,56 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "rtweekend.h"
+#include <cstdint>
+
+//实现了光线包。相机为相邻像素同时生成的一组主光线一起遍历bvh，共用一个遍历栈，用位掩码记录有效的光线。
+//光线除了原样保存外，起点、方向、方向倒数和时间还按SoA存放，球和四边形的求交可以对全部光线做向量化计算。
+//每条光线附带自己的随机数发生器状态，逐条光线退回单光线求交时切换到该状态，保证随机序列与单光线路径一致
+
+const int max_packet_size = 16;
+
+class ray_packet {
+public:
+    int size{ 0 };   //有效光线的个数，位于[size, max_packet_size)的光线是不参与计算的占位光线
+    ray rays[max_packet_size];
+    sampler_rng rng[max_packet_size];
+
+    //SoA布局，长度固定为max_packet_size，便于编译器向量化
+    real ox[max_packet_size], oy[max_packet_size], oz[max_packet_size];
+    real dx[max_packet_size], dy[max_packet_size], dz[max_packet_size];
+    real inv_dx[max_packet_size], inv_dy[max_packet_size], inv_dz[max_packet_size];
+    real time[max_packet_size];
+
+    ray_packet() {
+        for (int k = 0; k < max_packet_size; ++k) set(k, ray(point3(0, 0, 0), vec3(1, 1, 1)));
+        size = 0;
+    }
+
+    void set(int lane, const ray& r) {
+        rays[lane] = r;
+        ox[lane] = r.origin().x();
+        oy[lane] = r.origin().y();
+        oz[lane] = r.origin().z();
+        dx[lane] = r.direction().x();
+        dy[lane] = r.direction().y();
+        dz[lane] = r.direction().z();
+        inv_dx[lane] = r.inv_direction().x();
+        inv_dy[lane] = r.inv_direction().y();
+        inv_dz[lane] = r.inv_direction().z();
+        time[lane] = r.time();
+        if (lane >= size) size = lane + 1;
+    }
+
+    uint32_t full_mask() const { return size >= 32 ? ~0u : (1u << size) - 1; }
+};
+
+//依次访问掩码中的每个有效光线
+template <class F>
+inline void for_each_lane(uint32_t mask, F f) {
+    for (int lane = 0; mask != 0; ++lane, mask >>= 1) {
+        if (mask & 1u) f(lane);
+    }
+}
+
+#endif
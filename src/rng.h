@@ -0,0 +1,57 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstddef>
+#include <cstdint>
+//实现了基于计数器的随机数发生器。每个随机数由(键, 计数器)经过哈希直接得到，不依赖前一个状态。
+//键由(像素编号, 样本编号)生成，计数器即维度编号，因此同一像素同一样本抽取的随机数序列与线程数和调度顺序无关
+
+//splitmix64的终结混合函数，作为计数器哈希
+inline uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+//FNV-1a按字节哈希，h为之前的哈希值，可以连续哈希多段数据。用于场景和渲染设置的指纹，不用于采样
+inline uint64_t hash_bytes(const void* data, size_t n, uint64_t h = 0xcbf29ce484222325ULL) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < n; ++i) h = (h ^ p[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+class sampler_rng
+{
+private:
+    uint64_t key{ 0x853c49e6748fea9bULL };
+    uint64_t counter{ 0 };
+
+public:
+    sampler_rng() = default;
+    sampler_rng(uint64_t pixel, uint64_t sample, uint64_t dimension = 0) { seed(pixel, sample, dimension); }
+
+    //按(像素, 样本, 起始维度)重新定位随机序列
+    void seed(uint64_t pixel, uint64_t sample, uint64_t dimension = 0) {
+        key = mix64(mix64(pixel + 0x9e3779b97f4a7c15ULL) ^ (sample * 0xd1b54a32d192ed03ULL));
+        counter = dimension;
+    }
+
+    uint64_t dimension() const { return counter; }
+
+    uint64_t next_u64() {
+        return mix64(key + (counter++) * 0x9e3779b97f4a7c15ULL);
+    }
+
+    //取高53位，得到[0,1)上均匀分布的double
+    double next_double() {
+        return (next_u64() >> 11) * (1.0 / 9007199254740992.0);
+    }
+};
+
+//每个线程一个发生器，渲染时在每个像素样本开始前重新seed
+inline sampler_rng& thread_rng() {
+    static thread_local sampler_rng generator;
+    return generator;
+}
+
+#endif
@@ -8,19 +8,28 @@
 #include <cstdlib>
 #include <iostream>
 #include <vector>
-#include <random>
 #include <omp.h>
 #include <sstream>
+#include <string>
 #include <chrono>
 #include <atomic>
 #include <thread>
 
+#include "rng.h"
+
 using std::fabs;
 using std::sqrt;
 using std::make_shared;
 using std::shared_ptr;
 using std::vector;
 
+//几何计算的标量类型。定义ZRT_USE_FLOAT时用float渲染，光线、包围盒和交点记录的大小减半
+#ifdef ZRT_USE_FLOAT
+using real = float;
+#else
+using real = double;
+#endif
+
 const double infinity{ std::numeric_limits<double>::infinity() };
 const double pi{ 3.1415926535897932385 };
 
@@ -32,10 +41,9 @@ inline double degree_to_radian(double degree) {
     return rand() / (RAND_MAX + 1.0);
 } */
 
+//所有随机数都来自当前线程的计数器随机数发生器，见rng.h
 inline double random_double() {
-    static std::uniform_real_distribution<double> dis(0.0, 1.0);
-    static std::mt19937 generator;
-    return dis(generator);
+    return thread_rng().next_double();
 }
 
 inline double random_double(double min, double max) {
@@ -46,6 +54,11 @@ inline int random_int(int min, int max) {
     return int(random_double(min, max + 1.0));
 }
 
+//按扩展名识别文件格式
+inline bool ends_with(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
 #include "ray.h"
 #include "vec3.h"
 #include "interval.h"
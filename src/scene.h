@@ -0,0 +1,23 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "rtweekend.h"
+#include "hittable_list.h"
+#include "camera.h"
+#include "light_sampler.h"
+
+//一个可以渲染的场景：物体、额外的光源采样目标以及设置好参数的相机。发光物体在渲染时从world中自动收集。
+//内置场景见scenes.h，场景也可以保存为快照后直接读入，见scene_snapshot.h
+
+class scene {
+public:
+    hittable_list world;
+    hittable_list lights;   //额外的光源采样目标，通常为空。次事件估计只从发光的目标得到直接光照
+    camera cam;
+    light_sampler::selection light_selection{ light_sampler::select_spatial };
+
+    //没有发光物体也没有额外目标时只按材质采样
+    void render() { cam.render(world, light_sampler(world, lights, light_selection)); }
+};
+
+#endif
@@ -0,0 +1,510 @@
+#ifndef SCENE_SNAPSHOT_H
+#define SCENE_SNAPSHOT_H
+
+#include "rtweekend.h"
+#include "scene.h"
+#include "sphere.h"
+#include "quad.h"
+#include "bvh.h"
+#include "triangle_mesh.h"
+#include "constant_medium.h"
+#include "volume.h"
+#include "material.h"
+#include "texture.h"
+#include "mapped_file.h"
+#include "file_replace.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+
+//实现了场景快照(.zscn)：把构建好的场景，包括相机参数、纹理、材质、物体和已经建好的bvh，写成一个与地址无关的二进制文件。
+//文件由一串记录组成，每条记录是类型标签、负载长度和负载，引用其他对象时写它在纹理/材质/物体表中的下标，
+//被引用的对象总是先于引用者写出，读入时按顺序逐条重建即可。多处共享的对象(材质、实例引用的bvh)只保存一次。
+//每种可保存的类型自己提供save_snapshot(w)和静态的load_snapshot(r)，按同样的顺序写出和读回负载，
+//这里只负责分配标签、维护下标表和记录的框架；类型的头文件不需要包含本文件。
+//读入时整个文件只做一次内存映射：bvh节点直接交给bvh_tree，不再排序建树；网格的顶点和下标以及图像纹理的mipmap
+//直接指向映射中的数据，不拷贝也不重新解码。文件按本机字节序保存，只用于在同一台机器上反复渲染同一个场景
+
+struct snapshot_header {
+    char magic[4];          //"ZSCN"
+    uint32_t version;
+    uint64_t file_size;     //用于检查文件是否完整
+    uint32_t record_count;
+    uint32_t world;         //世界和光源列表在物体表中的下标
+    uint32_t lights;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(snapshot_header) == 32, "snapshot_header must stay 32 bytes");
+
+const uint32_t snapshot_version = 8;
+
+class scene_snapshot {
+public:
+    //保存场景，场景中有快照不支持的物体类型时返回false
+    static bool save(const std::string& path, const scene& s) {
+        writer w;
+        snapshot_header header;
+        std::memset(&header, 0, sizeof(header));
+        w.append(&header, sizeof(header));
+
+        save_camera(w, s.cam);
+        uint32_t world = add_list(w, s.world, nullptr);
+        uint32_t lights = add_list(w, s.lights, nullptr);
+        if (!w.ok) return false;
+
+        std::memcpy(header.magic, "ZSCN", 4);
+        header.version = snapshot_version;
+        header.file_size = w.bytes.size();
+        header.record_count = w.records;
+        header.world = world;
+        header.lights = lights;
+        std::memcpy(&w.bytes[0], &header, sizeof(header));
+
+        //读入的快照在渲染期间一直被映射，不能原地截断重写，即使正在渲染的就是这个文件
+        return replace_file(path, [&w](std::ostream& out) { out.write(w.bytes.data(), w.bytes.size()); });
+    }
+
+    //读入快照，失败时返回false且不修改s
+    static bool load(const std::string& path, scene& s) {
+        auto file = make_shared<mapped_file>();
+        if (!file->open(path)) {
+            std::cerr << "ERROR: Could not open scene snapshot '" << path << "'.\n";
+            return false;
+        }
+        snapshot_header header;
+        if (file->size() < sizeof(header)) {
+            std::cerr << "ERROR: Scene snapshot '" << path << "' is truncated.\n";
+            return false;
+        }
+        std::memcpy(&header, file->data(), sizeof(header));
+        if (std::memcmp(header.magic, "ZSCN", 4) != 0 || header.version != snapshot_version) {
+            std::cerr << "ERROR: '" << path << "' is not a version " << snapshot_version << " scene snapshot.\n";
+            return false;
+        }
+        if (header.file_size != file->size()) {
+            std::cerr << "ERROR: Scene snapshot '" << path << "' is truncated.\n";
+            return false;
+        }
+
+        reader r;
+        r.base = file->data();
+        r.storage = file;
+        r.name = path;
+        scene loaded;
+        const char* cursor = file->data() + sizeof(header);
+        const char* file_end = file->data() + file->size();
+        for (uint32_t i = 0; i < header.record_count; ++i) {
+            record_header record;
+            if (size_t(file_end - cursor) < sizeof(record)) break;
+            std::memcpy(&record, cursor, sizeof(record));
+            cursor += sizeof(record);
+            if (record.size > uint64_t(file_end - cursor)) break;
+            r.p = cursor;
+            r.end = cursor + record.size;
+            load_record(r, record.tag, loaded.cam);
+            if (r.failed) break;
+            cursor = r.end;
+        }
+
+        auto world = r.list(header.world);
+        auto lights = r.list(header.lights);
+        if (r.failed || !world || !lights) {
+            std::cerr << "ERROR: Scene snapshot '" << path << "' is corrupt.\n";
+            return false;
+        }
+        loaded.world = *world;
+        loaded.lights = *lights;
+        //输出设置不属于场景，保留调用者的值
+        loaded.cam.output_file = s.cam.output_file;
+        loaded.cam.output_encoder = s.cam.output_encoder;
+        loaded.cam.show_progress = s.cam.show_progress;
+        loaded.cam.sample_count_file = s.cam.sample_count_file;
+        loaded.cam.variance_file = s.cam.variance_file;
+        loaded.cam.albedo_file = s.cam.albedo_file;
+        loaded.cam.normal_file = s.cam.normal_file;
+        loaded.cam.depth_file = s.cam.depth_file;
+        loaded.cam.checkpoint_file = s.cam.checkpoint_file;
+        loaded.cam.checkpoint_interval = s.cam.checkpoint_interval;
+        loaded.cam.shard_count = s.cam.shard_count;
+        loaded.cam.shard_index = s.cam.shard_index;
+        loaded.cam.sharding = s.cam.sharding;
+        loaded.cam.accumulation_file = s.cam.accumulation_file;
+        s = loaded;
+        return true;
+    }
+
+private:
+    //标签的百位决定记录属于哪张表
+    enum record_tag : uint32_t {
+        tag_camera = 1,
+        tag_solid_color = 100, tag_checker, tag_image, tag_noise,
+        tag_lambertian = 200, tag_metal, tag_dielectric, tag_diffuse_light, tag_isotropic,
+        tag_sphere = 300, tag_quad, tag_list, tag_bvh, tag_mesh, tag_instance, tag_medium, tag_grid_medium
+    };
+    enum table_kind { texture_table = 0, material_table = 1, object_table = 2, no_table = 3 };
+    static const uint32_t null_ref = 0xFFFFFFFFu;
+
+    static table_kind kind_of(uint32_t tag) {
+        if (tag >= 100 && tag < 400) return table_kind(tag / 100 - 1);
+        return no_table;
+    }
+
+    struct record_header {
+        uint32_t tag;
+        uint32_t reserved;
+        uint64_t size;      //负载的字节数，8的倍数
+    };
+
+    class writer {
+    public:
+        std::string bytes;
+        std::unordered_map<const void*, uint32_t> ids[3];
+        uint32_t counts[3] = { 0, 0, 0 };
+        uint32_t records{ 0 };
+        bool ok{ true };
+
+        //写到最内层未结束的记录，没有时直接写到文件
+        void append(const void* p, size_t n) { target().append(static_cast<const char*>(p), n); }
+        void align() {
+            std::string& out = target();
+            out.resize((out.size() + 7) & ~size_t(7), '\0');
+        }
+
+        void u32(uint32_t v) { append(&v, sizeof(v)); }
+        void u64(uint64_t v) { append(&v, sizeof(v)); }
+        void f64(double v) { append(&v, sizeof(v)); }
+        void vec(const vec3& v) { f64(v.x()); f64(v.y()); f64(v.z()); }
+        void box(const aabb& b) {
+            for (int axis = 0; axis < 3; ++axis) {
+                f64(b.axis_interval(axis).min);
+                f64(b.axis_interval(axis).max);
+            }
+        }
+        //按8字节对齐的数据块，读入时可以直接就地使用。文件头和记录头都是8的倍数，负载内对齐即文件内对齐
+        void data(const void* p, size_t n) {
+            u64(n);
+            align();
+            if (n > 0) append(p, n);
+        }
+
+        //写出被引用对象的下标，对象还没有写出时先写出它的记录
+        void ref(const shared_ptr<texture>& t) { u32(add(*this, t)); }
+        void ref(const shared_ptr<material>& m) { u32(add(*this, m)); }
+        void ref(const shared_ptr<hittable>& h) { u32(add(*this, h)); }
+
+        //已经写出过的对象直接返回下标
+        bool find(table_kind kind, const void* object, uint32_t& id) const {
+            auto it = ids[kind].find(object);
+            if (it == ids[kind].end()) return false;
+            id = it->second;
+            return true;
+        }
+
+        //记录可以嵌套：负载中途引用的对象在begin和end之间写出，先于外层记录落入文件
+        void begin(uint32_t tag) {
+            open.push_back(std::make_pair(tag, std::string()));
+        }
+
+        //结束当前记录，返回它在所属表中的下标
+        uint32_t end(const void* object) {
+            align();
+            std::pair<uint32_t, std::string> record = std::move(open.back());
+            open.pop_back();
+            record_header h{ record.first, 0, record.second.size() };
+            bytes.append(reinterpret_cast<const char*>(&h), sizeof(h));
+            bytes.append(record.second);
+            ++records;
+            table_kind kind = kind_of(h.tag);
+            if (kind == no_table) return null_ref;
+            uint32_t id = counts[kind]++;
+            if (object) ids[kind][object] = id;
+            return id;
+        }
+
+        uint32_t unsupported(const char* what, const std::type_info& type) {
+            std::cerr << "ERROR: Scene snapshots do not support " << what << " type '" << type.name() << "'.\n";
+            ok = false;
+            return null_ref;
+        }
+
+    private:
+        vector<std::pair<uint32_t, std::string>> open;
+
+        std::string& target() { return open.empty() ? bytes : open.back().second; }
+    };
+
+    class reader {
+    public:
+        const char* base{ nullptr };
+        const char* p{ nullptr };
+        const char* end{ nullptr };
+        shared_ptr<const void> storage;
+        std::string name;
+        bool failed{ false };
+        vector<shared_ptr<texture>> textures;
+        vector<shared_ptr<material>> materials;
+        vector<shared_ptr<hittable>> objects;
+
+        //越界时置failed并返回0，调用者在整条记录读完后检查一次
+        void take(void* out, size_t n) {
+            if (failed || size_t(end - p) < n) {
+                failed = true;
+                std::memset(out, 0, n);
+                return;
+            }
+            std::memcpy(out, p, n);
+            p += n;
+        }
+
+        uint32_t u32() { uint32_t v; take(&v, sizeof(v)); return v; }
+        uint64_t u64() { uint64_t v; take(&v, sizeof(v)); return v; }
+        double f64() { double v; take(&v, sizeof(v)); return v; }
+        vec3 vec() {
+            double x = f64(), y = f64(), z = f64();
+            return vec3(x, y, z);
+        }
+        aabb box() {
+            aabb b;
+            b.x.min = real(f64()); b.x.max = real(f64());
+            b.y.min = real(f64()); b.y.max = real(f64());
+            b.z.min = real(f64()); b.z.max = real(f64());
+            return b;
+        }
+        size_t remaining() const { return failed ? 0 : size_t(end - p); }
+        const char* data(size_t& n) {
+            n = size_t(u64());
+            p = base + ((p - base + 7) & ~ptrdiff_t(7));
+            if (failed || p > end || size_t(end - p) < n) {
+                failed = true;
+                n = 0;
+                return nullptr;
+            }
+            const char* d = p;
+            p += n;
+            return d;
+        }
+
+        template <class T>
+        shared_ptr<T> ref(const vector<shared_ptr<T>>& table) {
+            uint32_t id = u32();
+            if (id == null_ref) return nullptr;
+            if (id >= table.size()) {
+                failed = true;
+                return nullptr;
+            }
+            return table[id];
+        }
+        shared_ptr<texture> texture_ref() { return ref(textures); }
+        shared_ptr<material> material_ref() { return ref(materials); }
+        shared_ptr<hittable> object_ref() { return ref(objects); }
+
+        shared_ptr<hittable_list> list(uint32_t id) const {
+            if (id >= objects.size()) return nullptr;
+            return std::dynamic_pointer_cast<hittable_list>(objects[id]);
+        }
+    };
+
+    static void save_camera(writer& w, const camera& cam) {
+        w.begin(tag_camera);
+        w.f64(cam.aspect_ratio);
+        w.u32(uint32_t(cam.image_width));
+        w.u32(uint32_t(cam.samples_per_pixel));
+        w.u32(uint32_t(cam.depth_max));
+        w.vec(cam.background);
+        w.f64(cam.vfov);
+        w.f64(cam.focus_dist);
+        w.f64(cam.defocus_degree);
+        w.vec(cam.lookfrom);
+        w.vec(cam.lookat);
+        w.vec(cam.vup);
+        w.u32(uint32_t(cam.tile_size));
+        w.u32(uint32_t(cam.tile_ordering));
+        w.u32(cam.adaptive_sampling);
+        w.u32(uint32_t(cam.min_samples));
+        w.u32(uint32_t(cam.adaptive_batch));
+        w.f64(cam.adaptive_threshold);
+        w.u32(cam.russian_roulette);
+        w.u32(uint32_t(cam.rr_min_depth));
+        w.u32(uint32_t(cam.packet_size));
+        w.u32(cam.next_event_estimation);
+        w.u32(uint32_t(cam.heuristic));
+        w.f64(cam.fog.density);
+        w.vec(cam.fog.albedo);
+        w.box(cam.fog.bounds);
+        w.u32(cam.denoise);
+        w.u32(uint32_t(cam.denoiser.iterations));
+        w.f64(cam.denoiser.sigma_color);
+        w.f64(cam.denoiser.sigma_normal);
+        w.f64(cam.denoiser.sigma_albedo);
+        w.f64(cam.denoiser.sigma_depth);
+        w.u32(cam.denoiser.clamp_fireflies);
+        w.u64(cam.scene_id);
+        w.end(nullptr);
+    }
+
+    static void load_camera(reader& r, camera& cam) {
+        cam.aspect_ratio = r.f64();
+        cam.image_width = int(r.u32());
+        cam.samples_per_pixel = int(r.u32());
+        cam.depth_max = int(r.u32());
+        cam.background = r.vec();
+        cam.vfov = r.f64();
+        cam.focus_dist = r.f64();
+        cam.defocus_degree = r.f64();
+        cam.lookfrom = r.vec();
+        cam.lookat = r.vec();
+        cam.vup = r.vec();
+        cam.tile_size = int(r.u32());
+        cam.tile_ordering = tile_order(r.u32());
+        cam.adaptive_sampling = r.u32() != 0;
+        cam.min_samples = int(r.u32());
+        cam.adaptive_batch = int(r.u32());
+        cam.adaptive_threshold = r.f64();
+        cam.russian_roulette = r.u32() != 0;
+        cam.rr_min_depth = int(r.u32());
+        cam.packet_size = int(r.u32());
+        cam.next_event_estimation = r.u32() != 0;
+        cam.heuristic = camera::mis_heuristic(r.u32());
+        cam.fog.density = r.f64();
+        cam.fog.albedo = r.vec();
+        cam.fog.bounds = r.box();
+        cam.denoise = r.u32() != 0;
+        cam.denoiser.iterations = int(r.u32());
+        cam.denoiser.sigma_color = r.f64();
+        cam.denoiser.sigma_normal = r.f64();
+        cam.denoiser.sigma_albedo = r.f64();
+        cam.denoiser.sigma_depth = r.f64();
+        cam.denoiser.clamp_fireflies = r.u32() != 0;
+        cam.scene_id = r.u64();
+    }
+
+    //对象是T时写出T的记录
+    template <class T, class Base>
+    static bool save_as(writer& w, const Base* object, uint32_t tag) {
+        auto typed = dynamic_cast<const T*>(object);
+        if (!typed) return false;
+        w.begin(tag);
+        typed->save_snapshot(w);
+        return true;
+    }
+
+    static uint32_t add(writer& w, const shared_ptr<texture>& t) {
+        uint32_t id = null_ref;
+        if (!t || w.find(texture_table, t.get(), id)) return id;
+        const texture* p = t.get();
+        if (!(save_as<solid_color>(w, p, tag_solid_color) || save_as<checker_texture>(w, p, tag_checker)
+            || save_as<image_texture>(w, p, tag_image) || save_as<noise_texture>(w, p, tag_noise))) {
+            return w.unsupported("texture", typeid(*t));
+        }
+        return w.end(p);
+    }
+
+    static uint32_t add(writer& w, const shared_ptr<material>& m) {
+        uint32_t id = null_ref;
+        if (!m || w.find(material_table, m.get(), id)) return id;
+        const material* p = m.get();
+        if (!(save_as<lambertian>(w, p, tag_lambertian) || save_as<metal>(w, p, tag_metal)
+            || save_as<dielectric>(w, p, tag_dielectric) || save_as<diffuse_light>(w, p, tag_diffuse_light)
+            || save_as<isotropic>(w, p, tag_isotropic))) {
+            return w.unsupported("material", typeid(*m));
+        }
+        return w.end(p);
+    }
+
+    static uint32_t add_list(writer& w, const hittable_list& list, const void* identity) {
+        w.begin(tag_list);
+        w.u32(uint32_t(list.objects.size()));
+        for (const auto& object : list.objects) w.ref(object);
+        return w.end(identity);
+    }
+
+    static uint32_t add(writer& w, const shared_ptr<hittable>& h) {
+        uint32_t id = null_ref;
+        if (!h || w.find(object_table, h.get(), id)) return id;
+        const hittable* p = h.get();
+        if (auto list = dynamic_cast<const hittable_list*>(p)) return add_list(w, *list, p);
+        if (!(save_as<sphere>(w, p, tag_sphere) || save_as<quad>(w, p, tag_quad) || save_as<bvh_node>(w, p, tag_bvh)
+            || save_as<triangle_mesh>(w, p, tag_mesh) || save_as<instance>(w, p, tag_instance)
+            || save_as<constant_medium>(w, p, tag_medium) || save_as<grid_medium>(w, p, tag_grid_medium))) {
+            return w.unsupported("object", typeid(*h));
+        }
+        return w.end(p);
+    }
+
+    static void load_record(reader& r, uint32_t tag, camera& cam) {
+        switch (kind_of(tag)) {
+        case texture_table: {
+            auto t = load_texture(r, tag);
+            if (!t) r.failed = true;
+            r.textures.push_back(t);
+            break;
+        }
+        case material_table: {
+            auto m = load_material(r, tag);
+            if (!m) r.failed = true;
+            r.materials.push_back(m);
+            break;
+        }
+        case object_table: {
+            auto h = load_object(r, tag);
+            if (!h) r.failed = true;
+            r.objects.push_back(h);
+            break;
+        }
+        default:
+            if (tag == tag_camera) load_camera(r, cam);
+            else r.failed = true;
+        }
+    }
+
+    static shared_ptr<texture> load_texture(reader& r, uint32_t tag) {
+        switch (tag) {
+        case tag_solid_color: return solid_color::load_snapshot(r);
+        case tag_checker: return checker_texture::load_snapshot(r);
+        case tag_image: return image_texture::load_snapshot(r);
+        case tag_noise: return noise_texture::load_snapshot(r);
+        }
+        return nullptr;
+    }
+
+    static shared_ptr<material> load_material(reader& r, uint32_t tag) {
+        switch (tag) {
+        case tag_lambertian: return lambertian::load_snapshot(r);
+        case tag_metal: return metal::load_snapshot(r);
+        case tag_dielectric: return dielectric::load_snapshot(r);
+        case tag_diffuse_light: return diffuse_light::load_snapshot(r);
+        case tag_isotropic: return isotropic::load_snapshot(r);
+        }
+        return nullptr;
+    }
+
+    static shared_ptr<hittable> load_object(reader& r, uint32_t tag) {
+        switch (tag) {
+        case tag_sphere: return sphere::load_snapshot(r);
+        case tag_quad: return quad::load_snapshot(r);
+        case tag_list: {
+            auto list = make_shared<hittable_list>();
+            uint32_t count = r.u32();
+            for (uint32_t i = 0; i < count && !r.failed; ++i) {
+                auto object = r.object_ref();
+                if (!object) return nullptr;
+                list->add(object);
+            }
+            return list;
+        }
+        case tag_bvh: return bvh_node::load_snapshot(r);
+        case tag_mesh: return triangle_mesh::load_snapshot(r);
+        case tag_instance: return instance::load_snapshot(r);
+        case tag_medium: return constant_medium::load_snapshot(r);
+        case tag_grid_medium: return grid_medium::load_snapshot(r);
+        }
+        return nullptr;
+    }
+};
+
+#endif
@@ -0,0 +1,625 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "rtweekend.h"
+#include "sphere.h"
+#include "constant_medium.h"
+#include "volume.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "camera.h"
+#include "material.h"
+#include "bvh.h"
+#include "texture.h"
+#include "quad.h"
+#include "triangle_mesh.h"
+#include "mesh_loader.h"
+#include "scene.h"
+#include "scene_snapshot.h"
+#include <unordered_map>
+#include <string>
+
+//实现了内置的示例场景。每个场景给出物体、用于重要性采样的光源列表以及设置好参数的相机，
+//zrt按名字选择场景渲染，zrt_bench用同样的场景做整帧基准测试
+
+inline scene bouncing_spheres() {
+    scene s;
+    hittable_list& world = s.world;
+    auto checker = make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
+    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(checker)));
+
+    for (int a = -11; a < 11; a++) {
+        for (int b = -11; b < 11; b++) {
+            auto choose_mat = random_double();
+            point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+
+            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+                shared_ptr<material> sphere_material;
+
+                if (choose_mat < 0.8) {
+                    // diffuse
+                    auto albedo = color::random() * color::random();
+                    sphere_material = make_shared<lambertian>(albedo);
+                    auto center2 = center + vec3(0, random_double(0, .5), 0);
+                    world.add(make_shared<sphere>(center, center2, 0.2, sphere_material));
+                }
+                else if (choose_mat < 0.95) {
+                    // metal
+                    auto albedo = color::random(0.5, 1);
+                    auto fuzz = random_double(0, 0.5);
+                    sphere_material = make_shared<metal>(albedo, fuzz);
+                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                }
+                else {
+                    // glass
+                    sphere_material = make_shared<dielectric>(1.5);
+                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                }
+            }
+        }
+    }
+
+    auto material1 = make_shared<dielectric>(1.5);
+    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+
+    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
+    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+
+    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
+    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+
+    world = hittable_list(make_shared<bvh_node>(world));
+
+    camera& cam = s.cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 400;
+    cam.samples_per_pixel = 100;
+    cam.depth_max = 50;
+    cam.background = color(0.70, 0.80, 1.00);
+
+    cam.vfov = 20;
+    cam.lookfrom = point3(13, 2, 3);
+    cam.lookat = point3(0, 0, 0);
+    cam.vup = vec3(0, 1, 0);
+
+    cam.focus_dist = 10.0;
+    cam.defocus_degree = 0.6;
+    return s;
+}
+
+inline scene checkered_spheres() {
+    scene s;
+    auto checker = make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
+
+    s.world.add(make_shared<sphere>(point3(0, -10, 0), 10, make_shared<lambertian>(checker)));
+    s.world.add(make_shared<sphere>(point3(0, 10, 0), 10, make_shared<lambertian>(checker)));
+
+    camera& cam = s.cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 400;
+    cam.samples_per_pixel = 100;
+    cam.depth_max = 50;
+    cam.background = color(0.70, 0.80, 1.00);
+
+    cam.vfov = 20;
+    cam.lookfrom = point3(13, 2, 3);
+    cam.lookat = point3(0, 0, 0);
+    cam.vup = vec3(0, 1, 0);
+
+    cam.defocus_degree = 0;
+    return s;
+}
+
+inline scene earth() {
+    scene s;
+    auto earth_texture = make_shared<image_texture>("earthmap.jpg");
+    auto earth_surface = make_shared<lambertian>(earth_texture);
+    s.world.add(make_shared<sphere>(point3(0, 0, 0), 2, earth_surface));
+
+    camera& cam = s.cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 400;
+    cam.samples_per_pixel = 100;
+    cam.depth_max = 50;
+    cam.background = color(0.70, 0.80, 1.00);
+
+    cam.vfov = 20;
+    cam.lookfrom = point3(0, -12, 0);
+    cam.lookat = point3(0, 0, 0);
+    cam.vup = vec3(0, 0, -1);
+
+    cam.defocus_degree = 0;
+    return s;
+}
+
+inline scene perlin_spheres() {
+    scene s;
+    auto pertext = make_shared<noise_texture>(4);
+    s.world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(pertext)));
+    s.world.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<lambertian>(pertext)));
+
+    camera& cam = s.cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 400;
+    cam.samples_per_pixel = 100;
+    cam.depth_max = 50;
+    cam.background = color(0.70, 0.80, 1.00);
+
+    cam.vfov = 20;
+    cam.lookfrom = point3(13, 2, 3);
+    cam.lookat = point3(0, 0, 0);
+    cam.vup = vec3(0, 1, 0);
+
+    cam.defocus_degree = 0;
+    return s;
+}
+
+inline scene quads() {
+    scene s;
+    hittable_list& world = s.world;
+
+    // Materials
+    auto left_red = make_shared<lambertian>(color(1.0, 0.2, 0.2));
+    auto back_green = make_shared<lambertian>(color(0.2, 1.0, 0.2));
+    auto right_blue = make_shared<lambertian>(color(0.2, 0.2, 1.0));
+    auto upper_orange = make_shared<lambertian>(color(1.0, 0.5, 0.0));
+    auto lower_teal = make_shared<lambertian>(color(0.2, 0.8, 0.8));
+
+    // Quads
+    world.add(make_shared<quad>(point3(-3, -2, 5), vec3(0, 0, -4), vec3(0, 4, 0), left_red));
+    world.add(make_shared<quad>(point3(-2, -2, 0), vec3(4, 0, 0), vec3(0, 4, 0), back_green));
+    world.add(make_shared<quad>(point3(3, -2, 1), vec3(0, 0, 4), vec3(0, 4, 0), right_blue));
+    world.add(make_shared<quad>(point3(-2, 3, 1), vec3(4, 0, 0), vec3(0, 0, 4), upper_orange));
+    world.add(make_shared<quad>(point3(-2, -3, 5), vec3(4, 0, 0), vec3(0, 0, -4), lower_teal));
+
+    camera& cam = s.cam;
+    cam.aspect_ratio = 1.0;
+    cam.image_width = 400;
+    cam.samples_per_pixel = 100;
+    cam.depth_max = 50;
+    cam.background = color(0.70, 0.80, 1.00);
+
+    cam.vfov = 80;
+    cam.lookfrom = point3(0, 0, 9);
+    cam.lookat = point3(0, 0, 0);
+    cam.vup = vec3(0, 1, 0);
+
+    cam.defocus_degree = 0;
+    return s;
+}
+
+inline scene simple_light() {
+    scene s;
+    hittable_list& world = s.world;
+
+    auto pertext = make_shared<noise_texture>(4);
+    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(pertext)));
+    world.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<lambertian>(pertext)));
+
+    auto difflight = make_shared<diffuse_light>(color(4, 4, 4));
+    world.add(make_shared<sphere>(point3(0, 7, 0), 2, difflight));
+    world.add(make_shared<quad>(point3(3, 1, -2), vec3(2, 0, 0), vec3(0, 2, 0), difflight));
+
+    camera& cam = s.cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 400;
+    cam.samples_per_pixel = 100;
+    cam.depth_max = 50;
+    cam.background = color(0, 0, 0);
+
+    cam.vfov = 20;
+    cam.lookfrom = point3(26, 3, 6);
+    cam.lookat = point3(0, 2, 0);
+    cam.vup = vec3(0, 1, 0);
+
+    cam.defocus_degree = 0;
+    return s;
+}
+
+//cornell box的墙壁、顶灯和相机，cornell_box、cornell_mesh和网格文件场景在此基础上放入物体
+inline scene cornell_room() {
+    scene s;
+    hittable_list& world = s.world;
+
+    auto red = make_shared<lambertian>(color(.65, .05, .05));
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    auto green = make_shared<lambertian>(color(.12, .45, .15));
+    auto light = make_shared<diffuse_light>(color(15, 15, 15));
+
+    world.add(make_shared<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
+    world.add(make_shared<quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
+    world.add(make_shared<quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+    world.add(make_shared<quad>(point3(555, 555, 555), vec3(-555, 0, 0), vec3(0, 0, -555), white));
+    world.add(make_shared<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
+
+    world.add(make_shared<quad>(point3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), light));
+
+    camera& cam = s.cam;
+    cam.aspect_ratio = 1.0;
+    cam.image_width = 600;
+    cam.samples_per_pixel = 1000;
+    cam.depth_max = 50;
+    cam.background = color(0, 0, 0);
+
+    cam.vfov = 40;
+    cam.lookfrom = point3(278, 278, -800);
+    cam.lookat = point3(278, 278, 0);
+    cam.vup = vec3(0, 1, 0);
+
+    cam.defocus_degree = 0;
+    return s;
+}
+
+inline scene cornell_box() {
+    scene s = cornell_room();
+    hittable_list& world = s.world;
+
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    shared_ptr<hittable> box1 = box(point3(0,0,0), point3(165,330,165), white);
+    box1 = make_shared<rotate_y>(box1, 15);
+    box1 = make_shared<translate>(box1, vec3(265, 0, 295));
+    world.add(box1);
+
+    auto glass = make_shared<dielectric>(1.5);
+    world.add(make_shared<sphere>(point3(190, 90, 190), 90, glass));
+
+    return s;
+}
+
+//与cornell_box相同，只用64个样本，输出前按特征图降噪
+inline scene cornell_denoised() {
+    scene s = cornell_box();
+    s.cam.samples_per_pixel = 64;
+    s.cam.denoise = true;
+    return s;
+}
+
+//细分正二十面体得到的球面网格，顶点法线沿半径方向。level为细分次数，三角形数为20*4^level
+inline mesh_data icosphere(const point3& center, double radius, int level) {
+    const double t = (1.0 + sqrt(5.0)) / 2.0;
+    vector<vec3> dirs = {
+        vec3(-1, t, 0), vec3(1, t, 0), vec3(-1, -t, 0), vec3(1, -t, 0),
+        vec3(0, -1, t), vec3(0, 1, t), vec3(0, -1, -t), vec3(0, 1, -t),
+        vec3(t, 0, -1), vec3(t, 0, 1), vec3(-t, 0, -1), vec3(-t, 0, 1)
+    };
+    for (vec3& d : dirs) d = normalize(d);
+    vector<uint32_t> faces = {
+        0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11, 1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+        3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9, 4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1
+    };
+
+    for (int l = 0; l < level; ++l) {
+        //每条边的中点只生成一次，相邻三角形共用
+        std::unordered_map<uint64_t, uint32_t> midpoints;
+        auto midpoint = [&](uint32_t a, uint32_t b) {
+            uint64_t key = a < b ? (uint64_t(a) << 32 | b) : (uint64_t(b) << 32 | a);
+            auto it = midpoints.find(key);
+            if (it != midpoints.end()) return it->second;
+            dirs.push_back(normalize(dirs[a] + dirs[b]));
+            uint32_t index = uint32_t(dirs.size() - 1);
+            midpoints.emplace(key, index);
+            return index;
+        };
+        vector<uint32_t> next;
+        next.reserve(faces.size() * 4);
+        for (size_t f = 0; f < faces.size(); f += 3) {
+            uint32_t a = faces[f], b = faces[f + 1], c = faces[f + 2];
+            uint32_t ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            uint32_t sub[] = { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca };
+            next.insert(next.end(), sub, sub + 12);
+        }
+        faces.swap(next);
+    }
+
+    mesh_data data;
+    for (const vec3& d : dirs) {
+        data.add_vertex(center + radius * d);
+        data.nx.push_back(float(d.x()));
+        data.ny.push_back(float(d.y()));
+        data.nz.push_back(float(d.z()));
+    }
+    data.indices = faces;
+    return data;
+}
+
+//cornell_box中的玻璃球换成约8万个三角形的网格球
+inline scene cornell_mesh() {
+    scene s = cornell_room();
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    shared_ptr<hittable> box1 = box(point3(0, 0, 0), point3(165, 330, 165), white);
+    box1 = make_shared<rotate_y>(box1, 15);
+    box1 = make_shared<translate>(box1, vec3(265, 0, 295));
+    s.world.add(box1);
+
+    auto glass = make_shared<dielectric>(1.5);
+    s.world.add(make_shared<triangle_mesh>(icosphere(point3(190, 90, 190), 90, 6), glass));
+
+    return s;
+}
+
+//cornell box中放入一个网格文件(.obj或.zmesh)。网格用实例缩放并平移到房间中央的地面上，读取失败时返回false
+inline bool mesh_scene(const std::string& path, scene& s) {
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    auto mesh = load_mesh(path, white);
+    if (!mesh) return false;
+
+    s = cornell_room();
+    aabb box = mesh->bounding_box();
+    double extent = fmax(box.x.size(), fmax(box.y.size(), box.z.size()));
+    point3 base(0.5 * (box.x.min + box.x.max), box.y.min, 0.5 * (box.z.min + box.z.max));
+    affine fit = affine::translation(vec3(278, 0, 278)) * affine::scaling(vec3(1, 1, 1) * (350.0 / extent))
+        * affine::translation(-base);
+    s.world.add(make_shared<instance>(mesh, fit));
+    return true;
+}
+
+//两层加速结构：一个1000个球的bvh和一个网格球各只构建一次，由上千个带随机旋转和缩放的实例引用，
+//实例再组织成顶层的bvh
+inline scene instances() {
+    scene s;
+    hittable_list& world = s.world;
+    auto checker = make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
+    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(checker)));
+
+    hittable_list cluster;
+    for (int j = 0; j < 1000; j++) {
+        auto albedo = color::random() * color::random();
+        cluster.add(make_shared<sphere>(point3::random(-1, 1), 0.06, make_shared<lambertian>(albedo)));
+    }
+    auto cluster_bvh = make_shared<bvh_node>(cluster);
+    auto ball = make_shared<triangle_mesh>(icosphere(point3(0, 0, 0), 1, 4), make_shared<metal>(color(0.8, 0.8, 0.9), 0.05));
+
+    hittable_list placed;
+    const int n = 20;
+    for (int i = -n; i < n; i++) {
+        for (int j = -n; j < n; j++) {
+            double scale = random_double(0.5, 1.0);
+            affine transform = affine::translation(vec3(3.0 * i + random_double(), 1.8 * scale, 3.0 * j + random_double()))
+                * affine::rotation(random_unit_vector(), random_double(0, 360))
+                * affine::scaling(vec3(scale, scale, scale));
+            shared_ptr<hittable> shared = ((i + j) & 1) ? shared_ptr<hittable>(ball) : shared_ptr<hittable>(cluster_bvh);
+            placed.add(make_shared<instance>(shared, transform));
+        }
+    }
+    world.add(make_shared<bvh_node>(placed));
+
+    camera& cam = s.cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 400;
+    cam.samples_per_pixel = 100;
+    cam.depth_max = 50;
+    cam.background = color(0.70, 0.80, 1.00);
+
+    cam.vfov = 30;
+    cam.lookfrom = point3(0, 18, 75);
+    cam.lookat = point3(0, 0, 0);
+    cam.vup = vec3(0, 1, 0);
+
+    cam.defocus_degree = 0;
+    return s;
+}
+
+inline scene cornell_smoke() {
+    scene s;
+    hittable_list& world = s.world;
+
+    auto red = make_shared<lambertian>(color(.65, .05, .05));
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    auto green = make_shared<lambertian>(color(.12, .45, .15));
+    auto light = make_shared<diffuse_light>(color(7, 7, 7));
+
+    world.add(make_shared<quad>(point3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), green));
+    world.add(make_shared<quad>(point3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
+    world.add(make_shared<quad>(point3(113, 554, 127), vec3(330, 0, 0), vec3(0, 0, 305), light));
+    world.add(make_shared<quad>(point3(0, 555, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+    world.add(make_shared<quad>(point3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), white));
+    world.add(make_shared<quad>(point3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), white));
+
+    shared_ptr<hittable> box1 = box(point3(0, 0, 0), point3(165, 330, 165), white);
+    box1 = make_shared<rotate_y>(box1, 15);
+    box1 = make_shared<translate>(box1, vec3(265, 0, 295));
+
+    shared_ptr<hittable> box2 = box(point3(0, 0, 0), point3(165, 165, 165), white);
+    box2 = make_shared<rotate_y>(box2, -18);
+    box2 = make_shared<translate>(box2, vec3(130, 0, 65));
+
+    world.add(make_shared<constant_medium>(box1, 0.01, color(0, 0, 0)));
+    world.add(make_shared<constant_medium>(box2, 0.01, color(1, 1, 1)));
+
+    camera& cam = s.cam;
+    cam.aspect_ratio = 1.0;
+    cam.image_width = 600;
+    cam.samples_per_pixel = 100;
+    cam.depth_max = 50;
+    cam.background = color(0, 0, 0);
+
+    cam.vfov = 40;
+    cam.lookfrom = point3(278, 278, -800);
+    cam.lookat = point3(278, 278, 0);
+    cam.vup = vec3(0, 1, 0);
+
+    cam.defocus_degree = 0;
+    return s;
+}
+
+//康奈尔盒中一团密度不均匀的云：椭球内的湍流噪声烘焙到网格中，边缘逐渐变稀
+inline scene cornell_cloud() {
+    scene s = cornell_room();
+
+    aabb bounds(point3(90, 60, 140), point3(470, 400, 420));
+    point3 center(280, 230, 280);
+    vec3 radius(190, 170, 140);
+    perlin noise;
+    auto density = [&](const point3& p) {
+        vec3 d = p - center;
+        vec3 q(d.x() / radius.x(), d.y() / radius.y(), d.z() / radius.z());
+        double r2 = q.length_squared();
+        return 0.05 * fmax(0.0, 2.0 * noise.turb(p * 0.012, 5) - r2);
+    };
+    s.world.add(make_shared<grid_medium>(bounds, 96, density, color(0.9, 0.9, 0.9)));
+
+    s.cam.samples_per_pixel = 100;
+    return s;
+}
+
+//数百个小光源：顶上16x16块朝下的发光方块，颜色和强度各不相同，地面上再散落64个发光小球。
+//光源都放在bvh里，由渲染时的光源采样器自动收集
+inline scene many_lights() {
+    scene s;
+    hittable_list& world = s.world;
+
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    world.add(make_shared<quad>(point3(-30, 0, 30), vec3(60, 0, 0), vec3(0, 0, -60), white));
+    world.add(make_shared<sphere>(point3(-4, 2, 0), 2, make_shared<lambertian>(color(.65, .05, .05))));
+    world.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<dielectric>(1.5)));
+    world.add(make_shared<sphere>(point3(4, 2, 0), 2, make_shared<metal>(color(0.8, 0.8, 0.9), 0.1)));
+
+    hittable_list lamps;
+    const int n = 16;
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            auto light = make_shared<diffuse_light>(color::random(0.2, 1) * random_double(5, 40));
+            point3 corner(-12 + 1.5 * i, 8, -12 + 1.5 * j);
+            lamps.add(make_shared<quad>(corner, vec3(-0.5, 0, 0), vec3(0, 0, -0.5), light));
+        }
+    }
+    for (int k = 0; k < 64; k++) {
+        auto light = make_shared<diffuse_light>(color::random(0.2, 1) * random_double(2, 10));
+        point3 center(random_double(-14, 14), 0.15, random_double(4, 14));
+        lamps.add(make_shared<sphere>(center, 0.15, light));
+    }
+    world.add(make_shared<bvh_node>(lamps));
+
+    camera& cam = s.cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 400;
+    cam.samples_per_pixel = 100;
+    cam.depth_max = 50;
+    cam.background = color(0, 0, 0);
+
+    cam.vfov = 40;
+    cam.lookfrom = point3(0, 5, 24);
+    cam.lookat = point3(0, 2, 0);
+    cam.vup = vec3(0, 1, 0);
+
+    cam.defocus_degree = 0;
+    return s;
+}
+
+inline scene final_scene(int image_width, int samples_per_pixel, int max_depth) {
+    scene s;
+    hittable_list& world = s.world;
+
+    hittable_list boxes1;
+    auto ground = make_shared<lambertian>(color(0.48, 0.83, 0.53));
+
+    int boxes_per_side = 20;
+    for (int i = 0; i < boxes_per_side; i++) {
+        for (int j = 0; j < boxes_per_side; j++) {
+            auto w = 100.0;
+            auto x0 = -1000.0 + i * w;
+            auto z0 = -1000.0 + j * w;
+            auto y0 = 0.0;
+            auto x1 = x0 + w;
+            auto y1 = random_double(1, 101);
+            auto z1 = z0 + w;
+
+            boxes1.add(box(point3(x0, y0, z0), point3(x1, y1, z1), ground));
+        }
+    }
+    auto ground_bvh = make_shared<bvh_node>(boxes1);
+    world.add(ground_bvh);
+
+    auto light = make_shared<diffuse_light>(color(7, 7, 7));
+    world.add(make_shared<quad>(point3(123, 554, 147), vec3(300, 0, 0), vec3(0, 0, 265), light));
+
+    auto center1 = point3(400, 400, 200);
+    auto center2 = center1 + vec3(30, 0, 0);
+    auto sphere_material = make_shared<lambertian>(color(0.7, 0.3, 0.1));
+    world.add(make_shared<sphere>(center1, center2, 50, sphere_material));
+
+    world.add(make_shared<sphere>(point3(260, 150, 45), 50, make_shared<dielectric>(1.5)));
+    world.add(make_shared<sphere>(
+        point3(0, 150, 145), 50, make_shared<metal>(color(0.8, 0.8, 0.9), 1.0)
+    ));
+
+    auto boundary = make_shared<sphere>(point3(360, 150, 145), 70, make_shared<dielectric>(1.5));
+    world.add(boundary);
+    world.add(make_shared<constant_medium>(boundary, 0.2, color(0.2, 0.4, 0.9)));
+
+    auto emat = make_shared<lambertian>(make_shared<image_texture>("earthmap.jpg"));
+    auto earth = make_shared<sphere>(point3(400, 200, 400), 100, emat);
+    world.add(earth);
+    auto pertext = make_shared<noise_texture>(0.2);
+    world.add(make_shared<sphere>(point3(220, 280, 300), 80, make_shared<lambertian>(pertext)));
+
+    hittable_list boxes2;
+    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    int ns = 1000;
+    for (int j = 0; j < ns; j++) {
+        boxes2.add(make_shared<sphere>(point3::random(0, 165), 10, white));
+    }
+
+    world.add(make_shared<translate>(
+        make_shared<rotate_y>(
+            make_shared<bvh_node>(boxes2), 15),
+        vec3(-100, 270, 395)
+    )
+    );
+
+    camera& cam = s.cam;
+    cam.aspect_ratio = 1.0;
+    cam.image_width = image_width;
+    cam.samples_per_pixel = samples_per_pixel;
+    cam.depth_max = max_depth;
+    cam.background = color(0, 0, 0);
+
+    cam.vfov = 40;
+    cam.lookfrom = point3(478, 278, -600);
+    cam.lookat = point3(278, 278, 0);
+    cam.vup = vec3(0, 1, 0);
+
+    //整个场景笼罩在薄雾中，原来用半径5000的球包着一个均匀介质表示
+    cam.fog.density = 0.0001;
+    cam.fog.albedo = color(1, 1, 1);
+    cam.fog.bounds = aabb(point3(-5000, -5000, -5000), point3(5000, 5000, 5000));
+
+    cam.defocus_degree = 0;
+    return s;
+}
+
+inline const vector<std::string>& scene_names() {
+    static const vector<std::string> names = {
+        "bouncing_spheres", "checkered_spheres", "earth", "perlin_spheres", "quads",
+        "simple_light", "cornell_box", "cornell_denoised", "cornell_mesh", "cornell_smoke", "cornell_cloud", "instances", "many_lights", "final_scene"
+    };
+    return names;
+}
+
+//按名字构建场景，名字也可以是.obj或.zmesh网格文件的路径。找不到场景或网格读取失败时返回false
+inline bool make_scene(const std::string& name, scene& s) {
+    if (name == "bouncing_spheres")  s = bouncing_spheres();
+    else if (name == "checkered_spheres") s = checkered_spheres();
+    else if (name == "earth")             s = earth();
+    else if (name == "perlin_spheres")    s = perlin_spheres();
+    else if (name == "quads")             s = quads();
+    else if (name == "simple_light")      s = simple_light();
+    else if (name == "cornell_box")       s = cornell_box();
+    else if (name == "cornell_denoised")  s = cornell_denoised();
+    else if (name == "cornell_mesh")      s = cornell_mesh();
+    else if (name == "cornell_smoke")     s = cornell_smoke();
+    else if (name == "cornell_cloud")     s = cornell_cloud();
+    else if (name == "instances")         s = instances();
+    else if (name == "many_lights")       s = many_lights();
+    else if (name == "final_scene")       s = final_scene(800, 100, 40);
+    else if (ends_with(name, ".obj") || ends_with(name, ".zmesh")) {
+        if (!mesh_scene(name, s)) return false;
+    }
+    //快照保存了原场景的标识
+    else if (ends_with(name, ".zscn"))  return scene_snapshot::load(name, s);
+    else return false;
+    s.cam.scene_id = mix64(hash_bytes(name.data(), name.size()));
+    return true;
+}
+
+#endif
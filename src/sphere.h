@@ -3,28 +3,29 @@
 
 #include "rtweekend.h"
 #include "hittable.h"
+#include "material.h"
 //实现了sphere类继承自hittalbe，需要完善构造函数和求交函数。
 class sphere : public hittable
 {
 private:
     point3 center1;
     vec3 center_vec{ 0.0,0.0,0.0 };
-    double radius;
+    real radius;
     shared_ptr<material> mat;
     bool is_moving;
     aabb bbox;
 
-    point3 sphere_center(double time) const {
+    point3 sphere_center(real time) const {
         return center1 + time * center_vec;
     }
     //通过单位球上三维左边p，转化为uv坐标
-/*     static void get_sphere_uv(const point3& p, double& u, double& v) {
+/*     static void get_sphere_uv(const point3& p, real& u, real& v) {
         double phi = atan2(p.y(), p.x()) + pi;
         double theta = acos(p.z());
         u = phi / (2.0 * pi);
         v = theta / pi;
     } */
-    static void get_sphere_uv(const point3& p, double& u, double& v) {
+    static void get_sphere_uv(const point3& p, real& u, real& v) {
         // p: a given point on the sphere of radius one, centered at the origin.
         // u: returned value [0,1] of angle around the Y axis from X=-1.
         // v: returned value [0,1] of angle from Y=-1 to Y=+1.
@@ -39,6 +40,18 @@ private:
         v = theta / pi;
     }
 
+    //由命中的根填写交点记录，单光线和光线包求交共用
+    void set_record(const ray& r, const point3& center, real root, hit_record& rec) const {
+        rec.t = root;
+        rec.p = r.at(root);
+        vec3 outward_normal = (rec.p - center) / radius;
+        rec.set_face_normal(r, outward_normal);
+        get_sphere_uv(outward_normal, rec.u, rec.v);
+        //赤道上u方向绕一圈为2*pi*radius，两极附近偏小，纹理会略欠过滤
+        rec.uv_density = real(1.0 / (2.0 * pi)) / radius;
+        rec.mat = mat.get();
+    }
+
     static vec3 random_to_sphere(double radius, double distance_squared) {
         auto r1 = random_double();
         auto r2 = random_double();
@@ -53,32 +66,32 @@ private:
 
 public:
     //静止球
-    sphere(const point3& p, double r, shared_ptr<material> m) :center1{ p }, radius{ fmax(r,0) }, mat{ m }, is_moving{ false } {
+    sphere(const point3& p, double r, shared_ptr<material> m) :center1{ p }, radius{ real(fmax(r, 0)) }, mat{ m }, is_moving{ false } {
         vec3 rvec = vec3(radius, radius, radius);
         bbox = aabb(center1 - rvec, center1 + rvec);
     }
     //运动球
-    sphere(const point3& p1, const point3& p2, double r, shared_ptr<material> m) :center1{ p1 }, radius{ fmax(r,0) }, mat{ m }, is_moving{ true } {
+    sphere(const point3& p1, const point3& p2, double r, shared_ptr<material> m) :center1{ p1 }, radius{ real(fmax(r, 0)) }, mat{ m }, is_moving{ true } {
         center_vec = p2 - p1;
         vec3 rvec = vec3(radius, radius, radius);
         aabb box1 = aabb(p1 - rvec, p1 + rvec);
         aabb box2 = aabb(p2 - rvec, p2 + rvec);
-        aabb bbox = aabb(box1, box2);
+        bbox = aabb(box1, box2);
     };
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
         point3 center = is_moving ? sphere_center(r.time()) : center1;
         vec3 oc = center - r.origin();
-        double a = r.direction().length_squared();
-        double h = dot(r.direction(), oc);
-        double c = oc.length_squared() - radius * radius;
-        double discriminant = h * h - a * c;
+        real a = r.direction().length_squared();
+        real h = dot(r.direction(), oc);
+        real c = oc.length_squared() - radius * radius;
+        real discriminant = h * h - a * c;
         if (discriminant < 0) {
             return false;
         }
 
-        double sqrtd = sqrt(discriminant);
-        double root = (h - sqrtd) / a;
+        real sqrtd = sqrt(discriminant);
+        real root = (h - sqrtd) / a;
         if (!ray_t.surrounds(root)) {
             root = (h + sqrtd) / a;
             if (!ray_t.surrounds(root)) {
@@ -86,20 +99,126 @@ public:
             }
         }
 
-        rec.t = root;
-        rec.p = r.at(root);
-        vec3 outward_normal = (rec.p - center) / radius;
-        rec.set_face_normal(r, outward_normal);
-        get_sphere_uv(outward_normal, rec.u, rec.v);
-        rec.mat = mat;
+        set_record(r, center, root, rec);
+        return true;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        point3 center = is_moving ? sphere_center(r.time()) : center1;
+        vec3 oc = center - r.origin();
+        real a = r.direction().length_squared();
+        real h = dot(r.direction(), oc);
+        real c = oc.length_squared() - radius * radius;
+        real discriminant = h * h - a * c;
+        if (discriminant < 0) return false;
+        real sqrtd = sqrt(discriminant);
+        return ray_t.surrounds((h - sqrtd) / a) || ray_t.surrounds((h + sqrtd) / a);
+    }
+
+    //运动球在时间0和1的包围盒，中间时刻的球心在两者之间线性移动
+    void motion_bounds(aabb& start, aabb& end) const override {
+        if (!is_moving) {
+            start = end = bbox;
+            return;
+        }
+        vec3 rvec = vec3(radius, radius, radius);
+        point3 center2 = center1 + center_vec;
+        start = aabb(center1 - rvec, center1 + rvec);
+        end = aabb(center2 - rvec, center2 + rvec);
+    }
 
+    //一次求出两个根
+    bool hit_span(const ray& r, real& t_enter, real& t_exit) const override {
+        point3 center = is_moving ? sphere_center(r.time()) : center1;
+        vec3 oc = center - r.origin();
+        real a = r.direction().length_squared();
+        real h = dot(r.direction(), oc);
+        real c = oc.length_squared() - radius * radius;
+        real discriminant = h * h - a * c;
+        if (!(discriminant > 0)) return false;
+        real sqrtd = sqrt(discriminant);
+        t_enter = (h - sqrtd) / a;
+        t_exit = (h + sqrtd) / a;
         return true;
     }
 
+    //先对光线包中的全部光线同时求根(占位光线也参与计算，循环长度固定便于向量化)，再逐条填写命中光线的交点记录
+    uint32_t hit_packet(ray_packet& packet, uint32_t active, real t_min, real t_max[], hit_record recs[]) const override {
+        real h[max_packet_size], a[max_packet_size], discriminant[max_packet_size];
+        real roots[max_packet_size];
+        int found[max_packet_size];
+        const real cx = center1.x(), cy = center1.y(), cz = center1.z();
+        const real mx = center_vec.x(), my = center_vec.y(), mz = center_vec.z();
+        const real r2 = radius * radius;
+        const real moving = is_moving ? real(1) : real(0);
+
+        //先只求判别式，大部分光线包整体错过球，不需要开方和除法
+        int any = 0;
+#pragma omp simd reduction(|:any)
+        for (int k = 0; k < max_packet_size; ++k) {
+            real tm = moving * packet.time[k];
+            real ocx = (cx + tm * mx) - packet.ox[k];
+            real ocy = (cy + tm * my) - packet.oy[k];
+            real ocz = (cz + tm * mz) - packet.oz[k];
+            a[k] = packet.dx[k] * packet.dx[k] + packet.dy[k] * packet.dy[k] + packet.dz[k] * packet.dz[k];
+            h[k] = packet.dx[k] * ocx + packet.dy[k] * ocy + packet.dz[k] * ocz;
+            real c = (ocx * ocx + ocy * ocy + ocz * ocz) - r2;
+            discriminant[k] = h[k] * h[k] - a[k] * c;
+            any |= int(discriminant[k] >= 0);
+        }
+        if (!any) return 0;
+
+#pragma omp simd
+        for (int k = 0; k < max_packet_size; ++k) {
+            real sqrtd = sqrt(discriminant[k] >= 0 ? discriminant[k] : real(0));
+            real near_root = (h[k] - sqrtd) / a[k];
+            real far_root = (h[k] + sqrtd) / a[k];
+            //用按位运算代替短路求值，循环体内没有分支
+            bool near_ok = (near_root > t_min) & (near_root < t_max[k]);
+            bool far_ok = (far_root > t_min) & (far_root < t_max[k]);
+            roots[k] = near_ok ? near_root : far_root;
+            found[k] = (discriminant[k] >= 0) & (near_ok | far_ok);
+        }
+
+        uint32_t hits = 0;
+        for_each_lane(active, [&](int k) {
+            if (!found[k]) return;
+            const ray& r = packet.rays[k];
+            set_record(r, is_moving ? sphere_center(r.time()) : center1, roots[k], recs[k]);
+            t_max[k] = roots[k];
+            hits |= 1u << k;
+        });
+        return hits;
+    }
+
     aabb bounding_box() const override {
         return bbox;
     }
 
+    //包围盒和运动向量原样保存，由两个中心重新求出可能差一位
+    template <class W>
+    void save_snapshot(W& w) const {
+        w.vec(center1);
+        w.vec(center_vec);
+        w.f64(radius);
+        w.u32(is_moving);
+        w.box(bbox);
+        w.ref(mat);
+    }
+    template <class R>
+    static shared_ptr<sphere> load_snapshot(R& r) {
+        point3 center = r.vec();
+        vec3 motion = r.vec();
+        double radius = r.f64();
+        bool moving = r.u32() != 0;
+        aabb box = r.box();
+        auto sp = make_shared<sphere>(center, radius, r.material_ref());
+        sp->center_vec = motion;
+        sp->is_moving = moving;
+        sp->bbox = box;
+        return sp;
+    }
+
     double pdf_value(const point3& origin, const vec3& direction) const override {
         // This method only works for stationary spheres.
 
@@ -120,6 +239,31 @@ public:
         uvw.build_from_w(direction);
         return uvw.local(random_to_sphere(radius, distance_squared));
     }
+
+    //在从origin看去的圆锥内均匀采样方向，取该方向与球面较近的交点。origin在球内时无法采样
+    bool sample_light(const point3& origin, hit_record& rec, double& pdf) const override {
+        vec3 oc = center1 - origin;
+        double distance_squared = oc.length_squared();
+        double radius_squared = double(radius) * radius;
+        if (!(distance_squared > radius_squared)) return false;
+        onb uvw;
+        uvw.build_from_w(oc);
+        vec3 direction = normalize(uvw.local(random_to_sphere(radius, distance_squared)));
+        //圆锥边缘的方向与球相切，判别式可能因舍入略小于0
+        double h = dot(direction, oc);
+        double t = h - sqrt(fmax(0.0, h * h - (distance_squared - radius_squared)));
+        set_record(ray(origin, direction), center1, real(t), rec);
+        rec.cone_width = 0;
+        double cos_theta_max = sqrt(1 - radius_squared / distance_squared);
+        pdf = 1 / (2 * pi * (1 - cos_theta_max));
+        return true;
+    }
+
+    //pdf_value和random只对静止的球成立，运动的球不作为光源采样
+    double emitted_power() const override {
+        if (is_moving || !mat) return 0.0;
+        return pi * 4 * pi * radius * radius * luminance(mat->mean_emission());
+    }
 };
 
 #endif
\ No newline at end of file
@@ -2,7 +2,7 @@
 #define TEXTURE_H
 
 #include "rtweekend.h"
-#include "rtw_stb_image.h"
+#include "mipmap.h"
 #include "perlin.h"
 //实现texture虚拟类，以及solid_color类
 class texture
@@ -10,6 +10,10 @@ class texture
 public:
 
     virtual color value(double u, double v, const point3& p) const = 0;
+    //footprint为交点处需要覆盖的纹理坐标范围，供图像纹理选择mip层级，其他纹理忽略它
+    virtual color filtered_value(double u, double v, const point3& p, double footprint) const {
+        return value(u, v, p);
+    }
     virtual ~texture() = default;
 };
 
@@ -23,6 +27,11 @@ public:
     color value(double u, double v, const point3& p) const override {
         return albedo;
     }
+
+    template <class W>
+    void save_snapshot(W& w) const { w.vec(albedo); }
+    template <class R>
+    static shared_ptr<solid_color> load_snapshot(R& r) { return make_shared<solid_color>(r.vec()); }
 };
 
 class checker_texture : public texture {
@@ -37,44 +46,170 @@ public:
     checker_texture(double scale, const color& e, const color& o)
         :inv_scale{ 1.0 / scale }, even{ make_shared<solid_color>(e) }, odd{ make_shared<solid_color>(o) } {};
     color value(double u, double v, const point3& p) const override {
+        return filtered_value(u, v, p, 0.0);
+    }
+    color filtered_value(double u, double v, const point3& p, double footprint) const override {
         int x_scaled_int = int(std::floor(inv_scale * p.x()));
         int y_scaled_int = int(std::floor(inv_scale * p.y()));
         int z_scaled_int = int(std::floor(inv_scale * p.z()));
         bool is_even = (x_scaled_int + y_scaled_int + z_scaled_int) % 2 == 0;
-        return is_even ? even->value(u, v, p) : odd->value(u, v, p);
+        return is_even ? even->filtered_value(u, v, p, footprint) : odd->filtered_value(u, v, p, footprint);
+    }
+
+    //保存inv_scale本身，由scale重新求倒数可能差一位
+    template <class W>
+    void save_snapshot(W& w) const {
+        w.f64(inv_scale);
+        w.ref(even);
+        w.ref(odd);
+    }
+    template <class R>
+    static shared_ptr<checker_texture> load_snapshot(R& r) {
+        double inv_scale = r.f64();
+        auto even = r.texture_ref();
+        auto odd = r.texture_ref();
+        auto t = make_shared<checker_texture>(1.0 / inv_scale, even, odd);
+        t->inv_scale = inv_scale;
+        return t;
     }
 };
 
+//图像纹理共享texture_cache中的mipmap，按光锥的覆盖范围做三线性过滤。从快照读入时mipmap直接指向映射的文件
 class image_texture : public texture {
 private:
-    rtw_image image;
+    shared_ptr<const mipmap> image;
+
+    image_texture() = default;
 
 public:
-    image_texture(const char* filmname) :image{ filmname } {};
+    image_texture(const char* filmname) :image{ texture_cache::get(filmname) } {}
 
     color value(double u, double v, const point3& p) const override {
-        if (image.height() <= 0) return color(0.0, 1.0, 1.0);
-        u = interval(0.0, 1.0).clamp(u);
-        v = 1.0 - interval(0.0, 1.0).clamp(v);
-        int i = int(u * image.width());
-        int j = int(v * image.height());
-        auto c = image.pixel_data(i, j);
-        double scale = 1.0 / 255.0;
-        return color(c[0] * scale, c[1] * scale, c[2] * scale);
+        return filtered_value(u, v, p, 0.0);
+    }
+
+    color filtered_value(double u, double v, const point3& p, double footprint) const override {
+        if (image->level_count() == 0) return color(0.0, 1.0, 1.0);
+        return image->sample(u, v, footprint);
+    }
+
+    //保存生成好的mipmap，读入时直接指向映射的文件，不再解码
+    template <class W>
+    void save_snapshot(W& w) const {
+        w.u32(uint32_t(image->width()));
+        w.u32(uint32_t(image->height()));
+        w.data(image->data(), image->size() * sizeof(uint32_t));
+    }
+    template <class R>
+    static shared_ptr<image_texture> load_snapshot(R& r) {
+        int width = int(r.u32()), height = int(r.u32());
+        size_t n;
+        const char* texels = r.data(n);
+        if (r.failed || n != mipmap::texel_count(width, height) * sizeof(uint32_t)) return nullptr;
+        shared_ptr<image_texture> t(new image_texture());
+        t->image = make_shared<mipmap>(width, height, reinterpret_cast<const uint32_t*>(texels), r.storage);
+        return t;
     }
 };
 
+//大理石纹理：沿z方向的正弦条纹被7个倍频的湍流扰动。可选把湍流烘焙到物体包围盒上的三维网格中，
+//盒内的查询变为一次三线性插值，代价是网格间距以下的细节被平滑掉
 class noise_texture : public texture {
 private:
     perlin noise;
     double scale;
+    //烘焙的湍流，resolution为0时不使用。网格点在包围盒内均匀分布(含边界)，按x最快、z最慢的顺序存放
+    aabb bake_box;
+    int resolution{ 0 };
+    const float* grid{ nullptr };
+    shared_ptr<const void> grid_storage;
+
+    double turb(const point3& p) const {
+        if (resolution > 0 && bake_box.x.contains(p.x()) && bake_box.y.contains(p.y()) && bake_box.z.contains(p.z())) {
+            return baked_turb(p);
+        }
+        return noise.turb(p, 7);
+    }
+
+    double baked_turb(const point3& p) const {
+        double c[3];
+        int i[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            const interval& range = bake_box.axis_interval(axis);
+            double x = (p[axis] - range.min) / range.size() * (resolution - 1);
+            i[axis] = std::min(int(x), resolution - 2);
+            c[axis] = x - i[axis];
+        }
+        size_t n = size_t(resolution);
+        const float* g = grid + (size_t(i[2]) * n + i[1]) * n + i[0];
+        size_t dy = n, dz = n * n;
+        double g00 = g[0] + c[0] * (g[1] - g[0]);
+        double g10 = g[dy] + c[0] * (g[dy + 1] - g[dy]);
+        double g01 = g[dz] + c[0] * (g[dz + 1] - g[dz]);
+        double g11 = g[dz + dy] + c[0] * (g[dz + dy + 1] - g[dz + dy]);
+        double g0 = g00 + c[1] * (g10 - g00);
+        double g1 = g01 + c[1] * (g11 - g01);
+        return g0 + c[2] * (g1 - g0);
+    }
 
 public:
     noise_texture() {}
     noise_texture(double s) :scale{ s } {}
+    //在bounds内以每边res个点烘焙湍流，res小于2或包围盒为空时不烘焙
+    noise_texture(double s, const aabb& bounds, int res) :scale{ s } {
+        if (res < 2 || !(bounds.x.size() > 0 && bounds.y.size() > 0 && bounds.z.size() > 0)) return;
+        size_t n = size_t(res);
+        auto values = make_shared<vector<float>>(n * n * n);
+        float* out = values->data();
+        vec3 step((bounds.x.max - bounds.x.min) / (res - 1), (bounds.y.max - bounds.y.min) / (res - 1),
+            (bounds.z.max - bounds.z.min) / (res - 1));
+#pragma omp parallel for schedule(dynamic)
+        for (int k = 0; k < res; ++k) {
+            for (int j = 0; j < res; ++j) {
+                for (int i = 0; i < res; ++i) {
+                    point3 p(bounds.x.min + i * step.x(), bounds.y.min + j * step.y(), bounds.z.min + k * step.z());
+                    out[(size_t(k) * n + j) * n + i] = float(noise.turb(p, 7));
+                }
+            }
+        }
+        bake_box = bounds;
+        resolution = res;
+        grid = out;
+        grid_storage = values;
+    }
+
     color value(double u, double v, const point3& p) const override {
-        return color(.5, .5, .5) * (1 + sin(scale * p.z() + 10 * noise.turb(p, 7)));
+        return color(.5, .5, .5) * (1 + sin(scale * p.z() + 10 * turb(p)));
+    }
+
+    //噪声表由种子重新生成，只保存种子；烘焙的网格原样保存
+    template <class W>
+    void save_snapshot(W& w) const {
+        w.f64(scale);
+        w.u64(noise.seed());
+        w.u32(uint32_t(resolution));
+        w.box(bake_box);
+        w.data(grid, resolution > 0 ? size_t(resolution) * resolution * resolution * sizeof(float) : 0);
+    }
+    template <class R>
+    static shared_ptr<noise_texture> load_snapshot(R& r) {
+        auto t = make_shared<noise_texture>(r.f64());
+        t->noise = perlin(r.u64());
+        int res = int(r.u32());
+        aabb box = r.box();
+        size_t n;
+        const char* values = r.data(n);
+        if (r.failed || res < 0 || res > 4096) return nullptr;
+        if (res > 0) {
+            if (res < 2 || n != size_t(res) * res * res * sizeof(float)) return nullptr;
+            if (!(box.x.size() > 0 && box.y.size() > 0 && box.z.size() > 0)) return nullptr;
+            t->bake_box = box;
+            t->resolution = res;
+            t->grid = reinterpret_cast<const float*>(values);
+            t->grid_storage = r.storage;
+        }
+        return t;
     }
 };
 
-#endif
\ No newline at end of file
+#endif
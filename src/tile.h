@@ -0,0 +1,79 @@
+#ifndef TILE_H
+#define TILE_H
+
+#include "rtweekend.h"
+#include <algorithm>
+#include <cstdint>
+
+//实现了渲染分块。图像被切成tile_size见方的块(右、下边缘的块可能更小)，块是调度、进度统计的基本单位。
+//块的处理顺序可以是Z序(Morton)、从中心向外的螺旋序或逐行扫描序
+
+enum class tile_order { morton, spiral, scanline };
+
+class render_tile {
+public:
+    int index{ 0 };      //按行优先的块编号，与处理顺序无关
+    int x0{ 0 }, y0{ 0 };
+    int x1{ 0 }, y1{ 0 };  //右下角(不含)
+
+    int width() const { return x1 - x0; }
+    int height() const { return y1 - y0; }
+    int pixel_count() const { return width() * height(); }
+};
+
+//把16位整数的各位间隔开，用于交织出Morton码
+inline uint32_t spread_bits(uint32_t v) {
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+inline uint32_t morton_code(uint32_t x, uint32_t y) {
+    return spread_bits(x) | (spread_bits(y) << 1);
+}
+
+//生成覆盖整幅图像的块，并按指定顺序排列
+inline vector<render_tile> make_tiles(int image_width, int image_height, int tile_size, tile_order order) {
+    tile_size = std::max(1, tile_size);
+    int tiles_x = (image_width + tile_size - 1) / tile_size;
+    int tiles_y = (image_height + tile_size - 1) / tile_size;
+
+    vector<render_tile> tiles;
+    tiles.reserve(tiles_x * tiles_y);
+    for (int ty = 0; ty < tiles_y; ++ty) {
+        for (int tx = 0; tx < tiles_x; ++tx) {
+            render_tile t;
+            t.index = ty * tiles_x + tx;
+            t.x0 = tx * tile_size;
+            t.y0 = ty * tile_size;
+            t.x1 = std::min(image_width, t.x0 + tile_size);
+            t.y1 = std::min(image_height, t.y0 + tile_size);
+            tiles.push_back(t);
+        }
+    }
+
+    if (order == tile_order::morton) {
+        std::stable_sort(tiles.begin(), tiles.end(), [tiles_x](const render_tile& a, const render_tile& b) {
+            return morton_code(a.index % tiles_x, a.index / tiles_x) < morton_code(b.index % tiles_x, b.index / tiles_x);
+        });
+    }
+    else if (order == tile_order::spiral) {
+        //先按到中心块的切比雪夫距离分圈，同一圈内按角度排列
+        double cx = 0.5 * (tiles_x - 1);
+        double cy = 0.5 * (tiles_y - 1);
+        auto key = [=](const render_tile& t) {
+            double dx = t.index % tiles_x - cx;
+            double dy = t.index / tiles_x - cy;
+            return std::make_pair(int(std::max(fabs(dx), fabs(dy)) + 0.5), atan2(dy, dx));
+        };
+        std::stable_sort(tiles.begin(), tiles.end(), [&key](const render_tile& a, const render_tile& b) {
+            return key(a) < key(b);
+        });
+    }
+    return tiles;
+}
+
+#endif
@@ -0,0 +1,464 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "rtweekend.h"
+#include "hittable.h"
+#include "bvh.h"
+#include "mapped_file.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+
+//实现了带下标的三角形网格。顶点坐标、法线和纹理坐标按SoA存放为float数组，三角形只保存三个顶点下标，
+//整个网格是一个hittable，内部用自己的bvh_tree组织三角形，百万级三角形也不需要为每个三角形分配一个物体。
+//求交使用Woop等人的watertight算法，相邻三角形的公共边上不会漏掉交点。
+//网格可以保存为二进制格式(.zmesh)，读取时直接内存映射，顶点和下标数组不拷贝，bvh也不需要重新构建
+
+//构建网格用的顶点和下标数据，法线和纹理坐标可以为空
+class mesh_data {
+public:
+    vector<float> x, y, z;      //顶点坐标
+    vector<float> nx, ny, nz;   //顶点法线，为空时使用三角形的几何法线
+    vector<float> u, v;         //顶点纹理坐标，为空时使用重心坐标
+    vector<uint32_t> indices;   //每三个下标组成一个三角形，逆时针方向为正面
+
+    size_t vertex_count() const { return x.size(); }
+    size_t triangle_count() const { return indices.size() / 3; }
+    bool has_normals() const { return !nx.empty(); }
+    bool has_uvs() const { return !u.empty(); }
+
+    uint32_t add_vertex(const point3& p) {
+        x.push_back(float(p.x()));
+        y.push_back(float(p.y()));
+        z.push_back(float(p.z()));
+        return uint32_t(x.size() - 1);
+    }
+
+    void add_triangle(uint32_t a, uint32_t b, uint32_t c) {
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    }
+};
+
+//二进制网格文件头，之后依次是x,y,z，(有法线时)nx,ny,nz，(有纹理坐标时)u,v，按bvh叶子顺序排列的下标，以及bvh的二叉节点
+struct mesh_file_header {
+    char magic[4];            //"ZMSH"
+    uint32_t version;
+    uint32_t vertex_count;
+    uint32_t triangle_count;
+    uint32_t node_count;
+    uint32_t flags;           //mesh_has_normals | mesh_has_uvs
+    uint32_t reserved[2];
+};
+
+static_assert(sizeof(mesh_file_header) == 32, "mesh_file_header must stay 32 bytes");
+
+const uint32_t mesh_file_version = 1;
+const uint32_t mesh_has_normals = 1;
+const uint32_t mesh_has_uvs = 2;
+
+class triangle_mesh : public hittable {
+private:
+    //三角形求交前对每条光线只做一次的准备：选出方向分量绝对值最大的轴kz，把光线变换为沿kz的剪切坐标系
+    struct watertight_ray {
+        int kx, ky, kz;
+        real sx, sy, sz;
+        point3 org;
+
+        watertight_ray() = default;
+        watertight_ray(const ray& r) {
+            const vec3& d = r.direction();
+            real ax = fabs(d.x()), ay = fabs(d.y()), az = fabs(d.z());
+            kz = ax > ay ? (ax > az ? 0 : 2) : (ay > az ? 1 : 2);
+            kx = (kz + 1) % 3;
+            ky = (kx + 1) % 3;
+            //保持三角形的环绕方向不变
+            if (d[kz] < 0) std::swap(kx, ky);
+            sx = d[kx] / d[kz];
+            sy = d[ky] / d[kz];
+            sz = 1 / d[kz];
+            org = r.origin();
+        }
+    };
+
+    shared_ptr<const void> storage;   //持有mesh_data或者映射的文件，下面的指针都指向其中
+    size_t nverts{ 0 };
+    size_t ntris{ 0 };
+    const float* px{ nullptr };
+    const float* py{ nullptr };
+    const float* pz{ nullptr };
+    const float* pnx{ nullptr };
+    const float* pny{ nullptr };
+    const float* pnz{ nullptr };
+    const float* pu{ nullptr };
+    const float* pv{ nullptr };
+    const uint32_t* idx{ nullptr };
+    bvh_tree tree;
+    shared_ptr<material> mat;
+
+    triangle_mesh(shared_ptr<material> m, const bvh_build_options& opt) :tree{ opt }, mat{ m } {}
+
+    point3 vertex(uint32_t i) const {
+        return point3(px[i], py[i], pz[i]);
+    }
+
+    //命中时写入t和三个顶点的重心坐标权重
+    bool intersect(const watertight_ray& wr, size_t tri, const interval& ray_t, real& t, real bary[3]) const {
+        const uint32_t* i = idx + 3 * tri;
+        vec3 a = vertex(i[0]) - wr.org;
+        vec3 b = vertex(i[1]) - wr.org;
+        vec3 c = vertex(i[2]) - wr.org;
+
+        real ax = a[wr.kx] - wr.sx * a[wr.kz];
+        real ay = a[wr.ky] - wr.sy * a[wr.kz];
+        real bx = b[wr.kx] - wr.sx * b[wr.kz];
+        real by = b[wr.ky] - wr.sy * b[wr.kz];
+        real cx = c[wr.kx] - wr.sx * c[wr.kz];
+        real cy = c[wr.ky] - wr.sy * c[wr.kz];
+
+        //三条边的有向面积，光线穿过三角形时符号相同
+        real eu = cx * by - cy * bx;
+        real ev = ax * cy - ay * cx;
+        real ew = bx * ay - by * ax;
+        //float精度下交点恰好落在边上时面积可能算成0，改用double重算，保证公共边两侧的三角形判断一致
+        if (sizeof(real) < sizeof(double) && (eu == 0 || ev == 0 || ew == 0)) {
+            eu = real(double(cx) * double(by) - double(cy) * double(bx));
+            ev = real(double(ax) * double(cy) - double(ay) * double(cx));
+            ew = real(double(bx) * double(ay) - double(by) * double(ax));
+        }
+        if ((eu < 0 || ev < 0 || ew < 0) && (eu > 0 || ev > 0 || ew > 0)) return false;
+
+        real det = eu + ev + ew;
+        if (det == 0) return false;
+
+        real az = wr.sz * a[wr.kz];
+        real bz = wr.sz * b[wr.kz];
+        real cz = wr.sz * c[wr.kz];
+        real root = (eu * az + ev * bz + ew * cz) / det;
+        if (!ray_t.surrounds(root)) return false;
+
+        t = root;
+        bary[0] = eu / det;
+        bary[1] = ev / det;
+        bary[2] = ew / det;
+        return true;
+    }
+
+    //遍历结束后只为最近的交点填写一次记录
+    void set_record(const ray& r, size_t tri, real t, const real bary[3], hit_record& rec) const {
+        const uint32_t* i = idx + 3 * tri;
+        point3 v0 = vertex(i[0]);
+        vec3 n_geom = cross(vertex(i[1]) - v0, vertex(i[2]) - v0);
+        rec.t = t;
+        rec.p = r.at(t);
+        rec.set_face_normal(r, normalize(n_geom));
+        if (pnx) {
+            vec3 n = bary[0] * vec3(pnx[i[0]], pny[i[0]], pnz[i[0]])
+                + bary[1] * vec3(pnx[i[1]], pny[i[1]], pnz[i[1]])
+                + bary[2] * vec3(pnx[i[2]], pny[i[2]], pnz[i[2]]);
+            //插值法线只改变着色，正反面仍由几何法线决定
+            if (n.length_squared() > 0) {
+                n = normalize(n);
+                rec.normal = rec.front_face ? n : -n;
+            }
+        }
+        //uv_density取纹理坐标面积与三角形面积之比的平方根
+        real world_area = n_geom.length();
+        if (pu) {
+            rec.u = bary[0] * pu[i[0]] + bary[1] * pu[i[1]] + bary[2] * pu[i[2]];
+            rec.v = bary[0] * pv[i[0]] + bary[1] * pv[i[1]] + bary[2] * pv[i[2]];
+            real uv_area = std::fabs((pu[i[1]] - pu[i[0]]) * (pv[i[2]] - pv[i[0]]) - (pu[i[2]] - pu[i[0]]) * (pv[i[1]] - pv[i[0]]));
+            rec.uv_density = world_area > 0 ? std::sqrt(uv_area / world_area) : 0;
+        }
+        else {
+            rec.u = bary[1];
+            rec.v = bary[2];
+            rec.uv_density = world_area > 0 ? 1 / std::sqrt(world_area) : 0;
+        }
+        rec.mat = mat.get();
+    }
+
+    void set_arrays(const float* x, const float* y, const float* z, const float* nx, const float* ny, const float* nz,
+        const float* u, const float* v, const uint32_t* indices) {
+        px = x; py = y; pz = z;
+        pnx = nx; pny = ny; pnz = nz;
+        pu = u; pv = v;
+        idx = indices;
+    }
+
+    //映射的数据来自文件，使用前检查下标不会越界
+    static bool indices_in_range(const uint32_t* indices, size_t nt, size_t nv) {
+        for (size_t i = 0; i < 3 * nt; ++i) {
+            if (indices[i] >= nv) return false;
+        }
+        return true;
+    }
+
+public:
+    //由网格数据构建，三角形下标按bvh的叶子顺序重新排列。下标越界的三角形被丢弃，长度不符的法线和纹理坐标被忽略
+    triangle_mesh(mesh_data data, shared_ptr<material> m, const bvh_build_options& opt = bvh_build_options())
+        :tree{ opt }, mat{ m } {
+        nverts = data.vertex_count();
+        if (data.y.size() != nverts || data.z.size() != nverts) {
+            std::cerr << "ERROR: Mesh vertex arrays have different lengths.\n";
+            nverts = 0;
+            data.indices.clear();
+        }
+        if (data.nx.size() != nverts || data.ny.size() != nverts || data.nz.size() != nverts) {
+            data.nx.clear(); data.ny.clear(); data.nz.clear();
+        }
+        if (data.u.size() != nverts || data.v.size() != nverts) {
+            data.u.clear(); data.v.clear();
+        }
+
+        vector<uint32_t> valid;
+        valid.reserve(data.indices.size());
+        for (size_t t = 0; t + 2 < data.indices.size(); t += 3) {
+            const uint32_t* i = &data.indices[t];
+            if (i[0] < nverts && i[1] < nverts && i[2] < nverts) valid.insert(valid.end(), i, i + 3);
+        }
+        ntris = valid.size() / 3;
+
+        auto owned = make_shared<mesh_data>(std::move(data));
+        set_arrays(owned->x.data(), owned->y.data(), owned->z.data(),
+            owned->has_normals() ? owned->nx.data() : nullptr, owned->ny.data(), owned->nz.data(),
+            owned->has_uvs() ? owned->u.data() : nullptr, owned->v.data(), valid.data());
+
+        long long count = (long long)ntris;
+        vector<aabb> boxes(ntris);
+#pragma omp parallel for schedule(static) if(count > 4096)
+        for (long long t = 0; t < count; ++t) {
+            point3 a = vertex(valid[3 * t]), b = vertex(valid[3 * t + 1]), c = vertex(valid[3 * t + 2]);
+            point3 lo(fmin(a.x(), fmin(b.x(), c.x())), fmin(a.y(), fmin(b.y(), c.y())), fmin(a.z(), fmin(b.z(), c.z())));
+            point3 hi(fmax(a.x(), fmax(b.x(), c.x())), fmax(a.y(), fmax(b.y(), c.y())), fmax(a.z(), fmax(b.z(), c.z())));
+            boxes[t] = aabb(lo, hi);
+        }
+        vector<size_t> order = tree.build(boxes);
+
+        owned->indices.resize(3 * ntris);
+        for (size_t t = 0; t < ntris; ++t) {
+            std::memcpy(&owned->indices[3 * t], &valid[3 * order[t]], 3 * sizeof(uint32_t));
+        }
+        idx = owned->indices.data();
+        storage = owned;
+    }
+
+    //读取save_binary写出的文件，失败时返回空指针。文件被映射到内存，顶点和下标直接在映射中访问
+    static shared_ptr<triangle_mesh> load_binary(const std::string& path, shared_ptr<material> m,
+        const bvh_build_options& opt = bvh_build_options()) {
+        auto file = make_shared<mapped_file>();
+        if (!file->open(path)) {
+            std::cerr << "ERROR: Could not open mesh file '" << path << "'.\n";
+            return nullptr;
+        }
+        return from_memory(file->data(), file->size(), file, m, opt, path);
+    }
+
+    //从内存中的二进制网格构建，网格直接引用[data, data + size)中的数组，storage负责让这段内存在网格的生命周期内有效。
+    //数据需要4字节对齐；name只用于错误信息
+    static shared_ptr<triangle_mesh> from_memory(const char* data, size_t size, shared_ptr<const void> storage,
+        shared_ptr<material> m, const bvh_build_options& opt, const std::string& name) {
+        mesh_file_header header;
+        if (size < sizeof(header)) {
+            std::cerr << "ERROR: Mesh file '" << name << "' is truncated.\n";
+            return nullptr;
+        }
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, "ZMSH", 4) != 0 || header.version != mesh_file_version) {
+            std::cerr << "ERROR: '" << name << "' is not a version " << mesh_file_version << " mesh file.\n";
+            return nullptr;
+        }
+
+        size_t nv = header.vertex_count, nt = header.triangle_count, nn = header.node_count;
+        size_t float_arrays = 3 + ((header.flags & mesh_has_normals) ? 3 : 0) + ((header.flags & mesh_has_uvs) ? 2 : 0);
+        size_t expected = sizeof(header) + float_arrays * nv * sizeof(float)
+            + 3 * nt * sizeof(uint32_t) + nn * sizeof(bvh_linear_node);
+        if (size < expected || (nt > 0 && nn == 0)) {
+            std::cerr << "ERROR: Mesh file '" << name << "' is truncated.\n";
+            return nullptr;
+        }
+
+        const char* cursor = data + sizeof(header);
+        auto next_floats = [&]() {
+            const float* p = reinterpret_cast<const float*>(cursor);
+            cursor += nv * sizeof(float);
+            return p;
+        };
+        const float* x = next_floats();
+        const float* y = next_floats();
+        const float* z = next_floats();
+        const float *nx = nullptr, *ny = nullptr, *nz = nullptr, *u = nullptr, *v = nullptr;
+        if (header.flags & mesh_has_normals) {
+            nx = next_floats();
+            ny = next_floats();
+            nz = next_floats();
+        }
+        if (header.flags & mesh_has_uvs) {
+            u = next_floats();
+            v = next_floats();
+        }
+        const uint32_t* indices = reinterpret_cast<const uint32_t*>(cursor);
+        cursor += 3 * nt * sizeof(uint32_t);
+
+        if (!indices_in_range(indices, nt, nv)) {
+            std::cerr << "ERROR: Mesh file '" << name << "' has an out-of-range vertex index.\n";
+            return nullptr;
+        }
+        vector<bvh_linear_node> nodes(nn);
+        if (nn > 0) std::memcpy(nodes.data(), cursor, nn * sizeof(bvh_linear_node));
+
+        shared_ptr<triangle_mesh> mesh(new triangle_mesh(m, opt));
+        mesh->nverts = nv;
+        mesh->ntris = nt;
+        mesh->set_arrays(x, y, z, nx, ny, nz, u, v, indices);
+        if (!mesh->tree.assign(std::move(nodes), nt)) {
+            std::cerr << "ERROR: Mesh file '" << name << "' has an invalid BVH.\n";
+            return nullptr;
+        }
+        mesh->storage = storage;
+        return mesh;
+    }
+
+    //写出二进制网格，下标和bvh节点按当前顺序保存，读取时不需要重新构建
+    bool save_binary(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary);
+        if (!out) {
+            std::cerr << "ERROR: Could not open output file '" << path << "'.\n";
+            return false;
+        }
+        return write_binary(out);
+    }
+
+    bool write_binary(std::ostream& out) const {
+        const vector<bvh_linear_node>& nodes = tree.linear_nodes();
+        mesh_file_header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "ZMSH", 4);
+        header.version = mesh_file_version;
+        header.vertex_count = uint32_t(nverts);
+        header.triangle_count = uint32_t(ntris);
+        header.node_count = uint32_t(nodes.size());
+        header.flags = (pnx ? mesh_has_normals : 0) | (pu ? mesh_has_uvs : 0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        const float* arrays[] = { px, py, pz, pnx, pny, pnz, pu, pv };
+        for (int a = 0; a < 8; ++a) {
+            if (a >= 3 && a < 6 && !pnx) continue;
+            if (a >= 6 && !pu) continue;
+            out.write(reinterpret_cast<const char*>(arrays[a]), nverts * sizeof(float));
+        }
+        out.write(reinterpret_cast<const char*>(idx), 3 * ntris * sizeof(uint32_t));
+        out.write(reinterpret_cast<const char*>(nodes.data()), nodes.size() * sizeof(bvh_linear_node));
+        return bool(out);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        watertight_ray wr(r);
+        size_t best = 0;
+        real best_t = 0;
+        real bary[3], best_bary[3];
+        bool hit_anything = tree.traverse(r, ray_t, [&](int tri, interval& t) {
+            if (!intersect(wr, tri, t, best_t, bary)) return false;
+            t.max = best_t;
+            best = tri;
+            best_bary[0] = bary[0];
+            best_bary[1] = bary[1];
+            best_bary[2] = bary[2];
+            return true;
+        });
+        if (hit_anything) set_record(r, best, best_t, best_bary, rec);
+        return hit_anything;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        watertight_ray wr(r);
+        real t_hit;
+        real bary[3];
+        return tree.traverse_any(r, ray_t, [&](int tri, interval& t) {
+            return intersect(wr, tri, t, t_hit, bary);
+        });
+    }
+
+    //光线包共用网格的bvh遍历，叶子中的三角形对每条光线逐条求交
+    uint32_t hit_packet(ray_packet& packet, uint32_t active, real t_min, real t_max[], hit_record recs[]) const override {
+        watertight_ray wr[max_packet_size];
+        size_t best[max_packet_size];
+        real bary[max_packet_size][3];
+        for_each_lane(active, [&](int k) { wr[k] = watertight_ray(packet.rays[k]); });
+
+        uint32_t hits = tree.traverse_packet(packet, active, t_min, t_max, [&](int tri, uint32_t mask) {
+            uint32_t found = 0;
+            for_each_lane(mask, [&](int k) {
+                real t;
+                if (!intersect(wr[k], tri, interval(t_min, t_max[k]), t, bary[k])) return;
+                t_max[k] = t;
+                best[k] = tri;
+                found |= 1u << k;
+            });
+            return found;
+        });
+        for_each_lane(hits, [&](int k) { set_record(packet.rays[k], best[k], t_max[k], bary[k], recs[k]); });
+        return hits;
+    }
+
+    aabb bounding_box() const override {
+        return tree.bounding_box();
+    }
+
+    //数组和bvh分别作为数据块保存，读入时直接指向快照的映射
+    template <class W>
+    void save_snapshot(W& w) const {
+        w.ref(mat);
+        w.u64(nverts);
+        w.u64(ntris);
+        w.u32((pnx ? mesh_has_normals : 0u) | (pu ? mesh_has_uvs : 0u));
+        const float* arrays[] = { px, py, pz, pnx, pny, pnz, pu, pv };
+        for (const float* a : arrays) {
+            if (a) w.data(a, nverts * sizeof(float));
+        }
+        w.data(idx, 3 * ntris * sizeof(uint32_t));
+        tree.save_snapshot(w);
+    }
+    template <class R>
+    static shared_ptr<triangle_mesh> load_snapshot(R& r) {
+        auto m = r.material_ref();
+        size_t nv = size_t(r.u64()), nt = size_t(r.u64());
+        uint32_t flags = r.u32();
+        if (r.failed || nv > r.remaining() / sizeof(float) || nt > r.remaining() / (3 * sizeof(uint32_t))) return nullptr;
+        const float* arrays[8] = {};
+        for (int k = 0; k < 8; ++k) {
+            if ((k >= 3 && k < 6 && !(flags & mesh_has_normals)) || (k >= 6 && !(flags & mesh_has_uvs))) continue;
+            size_t n;
+            arrays[k] = reinterpret_cast<const float*>(r.data(n));
+            if (r.failed || n != nv * sizeof(float)) return nullptr;
+        }
+        size_t n;
+        const uint32_t* indices = reinterpret_cast<const uint32_t*>(r.data(n));
+        if (r.failed || n != 3 * nt * sizeof(uint32_t)) return nullptr;
+        if (!indices_in_range(indices, nt, nv)) return nullptr;
+
+        shared_ptr<triangle_mesh> mesh(new triangle_mesh(m, bvh_build_options()));
+        mesh->nverts = nv;
+        mesh->ntris = nt;
+        mesh->set_arrays(arrays[0], arrays[1], arrays[2], arrays[3], arrays[4], arrays[5], arrays[6], arrays[7], indices);
+        mesh->storage = r.storage;
+        if (!mesh->tree.load_snapshot(r, nt)) return nullptr;
+        return mesh;
+    }
+
+    size_t vertex_count() const { return nverts; }
+    size_t triangle_count() const { return ntris; }
+    size_t node_count() const { return tree.node_count(); }
+    double sah_cost() const { return tree.sah_cost(); }
+
+    void accumulate_bvh_stats(bvh_stats& stats) const override {
+        if (!stats.first_visit(this)) return;
+        stats.nodes += tree.node_count();
+        stats.sah_cost += tree.sah_cost();
+    }
+};
+
+#endif
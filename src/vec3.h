@@ -5,88 +5,120 @@
 
 //之后的内联函数实现了重载输出流，+，-，逐项乘*，数乘*，/。定义了dot点乘，cross叉乘，正规化
 
+//向量按标量类型T模板化，vec3/point3使用rtweekend.h中的real(默认double，定义ZRT_USE_FLOAT时为float)。
+//Padded为true时补齐到4个分量并按16字节对齐，float版本正好是一个SSE/NEON寄存器，double版本是两个
+
 #include "rtweekend.h"
 
-class vec3 {
+template <class T, bool Padded = false>
+class basic_vec3 {
 public:
-    double e[3]{ 0.0,0.0,0.0 };
+    using scalar = T;
+    static const int lanes = Padded ? 4 : 3;
+
+    alignas(Padded ? 16 : alignof(T)) T e[lanes]{ 0,0,0 };
+
+    basic_vec3() = default;
+    basic_vec3(T f1, T f2, T f3) :e{ f1,f2,f3 } {}
 
-    vec3() = default;
-    vec3(double f1, double f2, double f3) :e{ f1,f2,f3 } {}
+    //不同精度、不同布局之间的显式转换
+    template <class U, bool P>
+    explicit basic_vec3(const basic_vec3<U, P>& v) :e{ T(v.e[0]),T(v.e[1]),T(v.e[2]) } {}
 
-    double x() const { return e[0]; }
-    double y() const { return e[1]; }
-    double z() const { return e[2]; }
+    T x() const { return e[0]; }
+    T y() const { return e[1]; }
+    T z() const { return e[2]; }
 
-    vec3 operator- () const { return vec3(-e[0], -e[1], -e[2]); }
+    basic_vec3 operator- () const { return basic_vec3(-e[0], -e[1], -e[2]); }
 
-    double operator[] (int i) const { return e[i]; }
-    double& operator[] (int i) { return e[i]; }
+    T operator[] (int i) const { return e[i]; }
+    T& operator[] (int i) { return e[i]; }
 
-    vec3& operator+= (const vec3& v) {
+    basic_vec3& operator+= (const basic_vec3& v) {
         e[0] += v.e[0];
         e[1] += v.e[1];
         e[2] += v.e[2];
         return *this;
     }
 
-    vec3& operator*= (double f) {
+    basic_vec3& operator*= (T f) {
         e[0] *= f;
         e[1] *= f;
         e[2] *= f;
         return *this;
     }
 
-    vec3& operator/= (double f) {
+    basic_vec3& operator/= (T f) {
         e[0] /= f;
         e[1] /= f;
         e[2] /= f;
         return *this;
     }
 
-    double length() const { return sqrt(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]); }
+    T length() const { return sqrt(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]); }
 
-    double length_squared() const { return (e[0] * e[0] + e[1] * e[1] + e[2] * e[2]); }
+    T length_squared() const { return (e[0] * e[0] + e[1] * e[1] + e[2] * e[2]); }
 
     bool near_zero() const {
-        double s = 1e-8;
+        T s = T(1e-8);
         return (fabs(e[0]) < s) && (fabs(e[1]) < s) && (fabs(e[2]) < s);
     }
 
-    static vec3 random() { return vec3(random_double(), random_double(), random_double()); }
+    static basic_vec3 random() { return basic_vec3(T(random_double()), T(random_double()), T(random_double())); }
 
-    static vec3 random(double min, double max) { return vec3(random_double(min, max), random_double(min, max), random_double(min, max)); }
+    static basic_vec3 random(double min, double max) { return basic_vec3(T(random_double(min, max)), T(random_double(min, max)), T(random_double(min, max))); }
 
 };
 
+using vec3 = basic_vec3<real>;
 using point3 = vec3;
 
-inline std::ostream& operator<<(std::ostream& out, const vec3& v) {
+using vec3f = basic_vec3<float>;
+using vec3d = basic_vec3<double>;
+//16字节对齐、补齐到4个分量的版本
+using vec3a = basic_vec3<real, true>;
+using vec3fa = basic_vec3<float, true>;
+
+static_assert(sizeof(vec3f) == 12 && sizeof(vec3d) == 24, "unpadded vectors are tightly packed");
+static_assert(sizeof(vec3fa) == 16 && alignof(vec3fa) == 16, "padded float vectors fill one 128-bit register");
+
+template <class T, bool P>
+inline std::ostream& operator<<(std::ostream& out, const basic_vec3<T, P>& v) {
     return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
-inline vec3 operator+ (const vec3& v1, const vec3& v2) { return vec3(v1.e[0] + v2.e[0], v1.e[1] + v2.e[1], v1.e[2] + v2.e[2]); }
+//标量参数写成basic_vec3<T, P>::scalar，不参与模板推导，整数和double字面量都可以直接乘除
+template <class T, bool P>
+inline basic_vec3<T, P> operator+ (const basic_vec3<T, P>& v1, const basic_vec3<T, P>& v2) { return basic_vec3<T, P>(v1.e[0] + v2.e[0], v1.e[1] + v2.e[1], v1.e[2] + v2.e[2]); }
 
-inline vec3 operator- (const vec3& v1, const vec3& v2) { return vec3(v1.e[0] - v2.e[0], v1.e[1] - v2.e[1], v1.e[2] - v2.e[2]); }
+template <class T, bool P>
+inline basic_vec3<T, P> operator- (const basic_vec3<T, P>& v1, const basic_vec3<T, P>& v2) { return basic_vec3<T, P>(v1.e[0] - v2.e[0], v1.e[1] - v2.e[1], v1.e[2] - v2.e[2]); }
 
-inline vec3 operator* (const vec3& v1, const vec3& v2) { return vec3(v1.e[0] * v2.e[0], v1.e[1] * v2.e[1], v1.e[2] * v2.e[2]); }
+template <class T, bool P>
+inline basic_vec3<T, P> operator* (const basic_vec3<T, P>& v1, const basic_vec3<T, P>& v2) { return basic_vec3<T, P>(v1.e[0] * v2.e[0], v1.e[1] * v2.e[1], v1.e[2] * v2.e[2]); }
 
-inline vec3 operator* (double f, const vec3& v) { return vec3(f * v.e[0], f * v.e[1], f * v.e[2]); }
+template <class T, bool P>
+inline basic_vec3<T, P> operator* (typename basic_vec3<T, P>::scalar f, const basic_vec3<T, P>& v) { return basic_vec3<T, P>(f * v.e[0], f * v.e[1], f * v.e[2]); }
 
-inline vec3 operator* (const vec3& v, double f) { return vec3(f * v.e[0], f * v.e[1], f * v.e[2]); }
+template <class T, bool P>
+inline basic_vec3<T, P> operator* (const basic_vec3<T, P>& v, typename basic_vec3<T, P>::scalar f) { return basic_vec3<T, P>(f * v.e[0], f * v.e[1], f * v.e[2]); }
 
-inline vec3 operator/ (const vec3& v, double f) { return vec3(v.e[0] / f, v.e[1] / f, v.e[2] / f); }
+template <class T, bool P>
+inline basic_vec3<T, P> operator/ (const basic_vec3<T, P>& v, typename basic_vec3<T, P>::scalar f) { return basic_vec3<T, P>(v.e[0] / f, v.e[1] / f, v.e[2] / f); }
 
-inline double dot(const vec3& v1, const vec3& v2) { return (v1.e[0] * v2.e[0] + v1.e[1] * v2.e[1] + v1.e[2] * v2.e[2]); }
+template <class T, bool P>
+inline T dot(const basic_vec3<T, P>& v1, const basic_vec3<T, P>& v2) { return (v1.e[0] * v2.e[0] + v1.e[1] * v2.e[1] + v1.e[2] * v2.e[2]); }
 
-inline vec3 cross(const vec3& v1, const vec3& v2) { return vec3(v1.e[1] * v2.e[2] - v1.e[2] * v2.e[1], v1.e[2] * v2.e[0] - v1.e[0] * v2.e[2], v1.e[0] * v2.e[1] - v1.e[1] * v2.e[0]); }
+template <class T, bool P>
+inline basic_vec3<T, P> cross(const basic_vec3<T, P>& v1, const basic_vec3<T, P>& v2) { return basic_vec3<T, P>(v1.e[1] * v2.e[2] - v1.e[2] * v2.e[1], v1.e[2] * v2.e[0] - v1.e[0] * v2.e[2], v1.e[0] * v2.e[1] - v1.e[1] * v2.e[0]); }
 
-inline vec3 normalize(const vec3& v) { return v / v.length(); }
+template <class T, bool P>
+inline basic_vec3<T, P> normalize(const basic_vec3<T, P>& v) { return v / v.length(); }
 
 //实现在单位圆盘内部随机向量
 inline vec3 random_in_unit_disk() {
     while (true) {
-        vec3 v = vec3(random_double(-1.0, 1.0), random_double(-1.0, 1.0), 0.0);
+        vec3 v = vec3(real(random_double(-1.0, 1.0)), real(random_double(-1.0, 1.0)), 0);
         if (v.length_squared() < 1) return v;
     }
 }
@@ -113,7 +145,7 @@ inline vec3 reflect(const vec3& v, const vec3& n) {
 }
 
 inline vec3 refract(const vec3& v, const vec3& n, double eta_over_etap) {
-    double cos_ans = fmin(1.0, -dot(v, n));
+    real cos_ans = fmin(real(1), -dot(v, n));
     vec3 refract_orth = eta_over_etap * (v + cos_ans * n);
     vec3 refract_para = -sqrt(fabs(1 - refract_orth.length_squared())) * n;
     return refract_orth + refract_para;
@@ -128,7 +160,7 @@ inline vec3 random_cosine_direction() {
     auto y = sin(phi)*sqrt(r2);
     auto z = sqrt(1-r2);
 
-    return vec3(x, y, z);
+    return vec3(real(x), real(y), real(z));
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,254 @@
+#ifndef VOLUME_H
+#define VOLUME_H
+
+#include "rtweekend.h"
+#include "hittable.h"
+#include "material.h"
+#include "texture.h"
+#include <algorithm>
+#include <functional>
+
+//实现了参与介质：
+//homogeneous_fog是挂在相机上的均匀雾，默认充满整个空间，也可以限制在一个包围盒内。它不是场景中的物体，
+//不参与求交，散射距离和透射率都按解析式求出，没有雾的光线不多做任何计算；
+//grid_medium是密度随位置变化的介质，密度保存在三维网格中，按块求出密度的上界(majorant)，
+//求交用delta tracking，阴影光线的透射率用ratio tracking，光线逐块前进，稀薄的块很快跨过，空的块直接跳过
+
+class homogeneous_fog {
+public:
+    double density{ 0.0 };                //消光系数，0表示没有雾
+    color  albedo{ 1.0,1.0,1.0 };         //散射系数与消光系数之比
+    aabb   bounds{ aabb::universe };      //雾所在的范围
+
+    bool enabled() const { return density > 0.0; }
+
+    //光线在ray_t内与雾发生散射时返回true，t为散射点。没有散射的概率恰好是这一段的透射率，
+    //调用者按这个概率继续追踪到表面时吞吐量不变，散射时吞吐量乘以albedo
+    bool sample(const ray& r, interval ray_t, real& t) const {
+        if (!enabled() || !bounds.clip(r, ray_t)) return false;
+        double distance = -log(1.0 - random_double()) / density;
+        real candidate = ray_t.min + real(distance / r.direction().length());
+        if (!(candidate < ray_t.max)) return false;
+        t = candidate;
+        return true;
+    }
+
+    double transmittance(const ray& r, interval ray_t) const {
+        if (!enabled() || !bounds.clip(r, ray_t)) return 1.0;
+        return exp(-density * (ray_t.max - ray_t.min) * r.direction().length());
+    }
+};
+
+class grid_medium : public hittable {
+public:
+    //每个majorant块在各轴上覆盖的体素数
+    static const int block = 4;
+
+    //在bounds内以每边res个点对density采样(网格点含边界)，点之间三线性插值
+    grid_medium(const aabb& bounds, int res, const std::function<double(const point3&)>& density, shared_ptr<texture> tex)
+        :phase_function{ make_shared<isotropic>(tex) } {
+        build(bounds, res, density);
+    }
+
+    grid_medium(const aabb& bounds, int res, const std::function<double(const point3&)>& density, const color& albedo)
+        :phase_function{ make_shared<isotropic>(albedo) } {
+        build(bounds, res, density);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        double length = r.direction().length();
+        bool found = false;
+        march(r, ray_t, [&](real t0, real t1, double majorant) {
+            //在上界为majorant的均匀介质里采样，按density/majorant接受真实碰撞，否则是虚碰撞，继续向前
+            for (real t = t0;;) {
+                t -= real(log(1.0 - random_double()) / (majorant * length));
+                if (!(t < t1)) return false;
+                if (random_double() * majorant < density(r.at(t))) {
+                    rec.t = t;
+                    found = true;
+                    return true;
+                }
+            }
+        });
+        if (!found) return false;
+
+        rec.p = r.at(rec.t);
+        rec.normal = vec3(1, 0, 0);  // arbitrary
+        rec.front_face = true;       // also arbitrary
+        rec.uv_density = 0;
+        rec.mat = phase_function.get();
+        return true;
+    }
+
+    //每次虚碰撞把透射率乘以1-density/majorant，结果是透射率的无偏估计
+    double transmittance(const ray& r, interval ray_t) const override {
+        double length = r.direction().length();
+        double result = 1.0;
+        march(r, ray_t, [&](real t0, real t1, double majorant) {
+            for (real t = t0;;) {
+                t -= real(log(1.0 - random_double()) / (majorant * length));
+                if (!(t < t1)) return false;
+                result *= 1.0 - density(r.at(t)) / majorant;
+                if (result <= 0.0) return true;
+            }
+        });
+        return fmax(result, 0.0);
+    }
+
+    aabb bounding_box() const override { return bounds; }
+
+    //块的上界由网格重新求出，不保存
+    template <class W>
+    void save_snapshot(W& w) const {
+        w.box(bounds);
+        w.u32(uint32_t(resolution));
+        w.ref(phase_function);
+        w.data(grid, resolution > 0 ? size_t(resolution) * resolution * resolution * sizeof(float) : 0);
+    }
+    template <class R>
+    static shared_ptr<grid_medium> load_snapshot(R& r) {
+        aabb box = r.box();
+        int res = int(r.u32());
+        auto phase = r.material_ref();
+        size_t n;
+        const char* values = r.data(n);
+        if (r.failed || res < 0 || res > 4096) return nullptr;
+        shared_ptr<grid_medium> medium(new grid_medium());
+        medium->bounds = box;
+        medium->phase_function = phase;
+        if (res > 0) {
+            if (res < 2 || n != size_t(res) * res * res * sizeof(float)) return nullptr;
+            if (!(box.x.size() > 0 && box.y.size() > 0 && box.z.size() > 0)) return nullptr;
+            medium->resolution = res;
+            medium->grid = reinterpret_cast<const float*>(values);
+            medium->grid_storage = r.storage;
+            medium->build_majorants();
+        }
+        return medium;
+    }
+
+private:
+    aabb bounds;
+    //密度网格，按x最快、z最慢的顺序存放
+    int resolution{ 0 };
+    const float* grid{ nullptr };
+    shared_ptr<const void> grid_storage;
+    shared_ptr<material> phase_function;
+    //每块内网格点的最大值。三线性插值不会超过8个角点的最大值，所以它是块内密度的严格上界
+    int blocks{ 0 };
+    vector<float> majorants;
+    vec3 block_size;
+
+    grid_medium() = default;
+
+    void build(const aabb& box, int res, const std::function<double(const point3&)>& density) {
+        if (res < 2 || !(box.x.size() > 0 && box.y.size() > 0 && box.z.size() > 0)) return;
+        size_t n = size_t(res);
+        auto values = make_shared<vector<float>>(n * n * n);
+        float* out = values->data();
+        vec3 step(box.x.size() / (res - 1), box.y.size() / (res - 1), box.z.size() / (res - 1));
+#pragma omp parallel for schedule(dynamic)
+        for (int k = 0; k < res; ++k) {
+            for (int j = 0; j < res; ++j) {
+                for (int i = 0; i < res; ++i) {
+                    point3 p(box.x.min + i * step.x(), box.y.min + j * step.y(), box.z.min + k * step.z());
+                    out[(size_t(k) * n + j) * n + i] = float(fmax(density(p), 0.0));
+                }
+            }
+        }
+        bounds = box;
+        resolution = res;
+        grid = out;
+        grid_storage = values;
+        build_majorants();
+    }
+
+    //由密度网格求出每块的上界，快照读入网格后也调用它
+    void build_majorants() {
+        size_t n = size_t(resolution);
+        blocks = (resolution - 2) / block + 1;
+        block_size = vec3(bounds.x.size(), bounds.y.size(), bounds.z.size()) * (double(block) / (resolution - 1));
+        majorants.assign(size_t(blocks) * blocks * blocks, 0.0f);
+        for (int k = 0; k < resolution; ++k) {
+            for (int j = 0; j < resolution; ++j) {
+                for (int i = 0; i < resolution; ++i) {
+                    float value = grid[(size_t(k) * n + j) * n + i];
+                    //块边界上的网格点同时属于两侧的块
+                    for (int bk = std::max(0, (k - 1) / block); bk <= std::min(blocks - 1, k / block); ++bk)
+                        for (int bj = std::max(0, (j - 1) / block); bj <= std::min(blocks - 1, j / block); ++bj)
+                            for (int bi = std::max(0, (i - 1) / block); bi <= std::min(blocks - 1, i / block); ++bi) {
+                                float& m = majorants[(size_t(bk) * blocks + bj) * blocks + bi];
+                                m = std::max(m, value);
+                            }
+                }
+            }
+        }
+    }
+
+    double density(const point3& p) const {
+        double c[3];
+        int i[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            const interval& range = bounds.axis_interval(axis);
+            double x = (p[axis] - range.min) / range.size() * (resolution - 1);
+            x = std::min(std::max(x, 0.0), double(resolution - 1));
+            i[axis] = std::min(int(x), resolution - 2);
+            c[axis] = x - i[axis];
+        }
+        size_t n = size_t(resolution);
+        const float* g = grid + (size_t(i[2]) * n + i[1]) * n + i[0];
+        size_t dy = n, dz = n * n;
+        double g00 = g[0] + c[0] * (g[1] - g[0]);
+        double g10 = g[dy] + c[0] * (g[dy + 1] - g[dy]);
+        double g01 = g[dz] + c[0] * (g[dz + 1] - g[dz]);
+        double g11 = g[dz + dy] + c[0] * (g[dz + dy + 1] - g[dz + dy]);
+        double g0 = g00 + c[1] * (g10 - g00);
+        double g1 = g01 + c[1] * (g11 - g01);
+        return g0 + c[2] * (g1 - g0);
+    }
+
+    //用三维DDA按顺序访问光线在ray_t内穿过的块，对每段[t0, t1)调用f(t0, t1, majorant)，f返回true时停止。
+    //上界为0的块直接跳过
+    template <typename F>
+    void march(const ray& r, interval ray_t, F&& f) const {
+        if (resolution == 0 || !bounds.clip(r, ray_t)) return;
+        const point3& origin = r.origin();
+        const vec3& direction = r.direction();
+        point3 start = r.at(ray_t.min);
+        int cell[3], step[3];
+        real next_t[3], delta_t[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            double lo = bounds.axis_interval(axis).min;
+            cell[axis] = std::min(std::max(int(floor((start[axis] - lo) / block_size[axis])), 0), blocks - 1);
+            if (direction[axis] > 0) {
+                step[axis] = 1;
+                next_t[axis] = real((lo + (cell[axis] + 1) * block_size[axis] - origin[axis]) / direction[axis]);
+                delta_t[axis] = real(block_size[axis] / direction[axis]);
+            }
+            else if (direction[axis] < 0) {
+                step[axis] = -1;
+                next_t[axis] = real((lo + cell[axis] * block_size[axis] - origin[axis]) / direction[axis]);
+                delta_t[axis] = real(-block_size[axis] / direction[axis]);
+            }
+            else {
+                step[axis] = 0;
+                next_t[axis] = real(infinity);
+                delta_t[axis] = real(infinity);
+            }
+        }
+
+        real t = ray_t.min;
+        while (t < ray_t.max) {
+            int axis = next_t[0] < next_t[1] ? (next_t[0] < next_t[2] ? 0 : 2) : (next_t[1] < next_t[2] ? 1 : 2);
+            real t_next = std::min(next_t[axis], ray_t.max);
+            float majorant = majorants[(size_t(cell[2]) * blocks + cell[1]) * blocks + cell[0]];
+            if (majorant > 0.0f && t_next > t && f(t, t_next, double(majorant))) return;
+            t = t_next;
+            cell[axis] += step[axis];
+            if (cell[axis] < 0 || cell[axis] >= blocks) return;
+            next_t[axis] += delta_t[axis];
+        }
+    }
+};
+
+#endif